@@ -67,7 +67,8 @@ typedef double fType;
   template <class Graph>
   auto BC(Graph& G, const uintE& start, bool use_dense_forward=false, bool print_stats=false) {
     size_t n = G.num_vertices();
-    auto vtxs = G.fetch_all_vertices();
+    auto flat = G.flat_vertices();
+    const auto& vtxs = *flat;
 
     auto NumPaths = pbbs::sequence<fType>(n, [] (size_t i) { return 0.0; });
     auto Visited = pbbs::sequence<bool>(n, [] (size_t i) { return 0; });
@@ -45,7 +45,8 @@ void BFS_Fetch(Graph& G, uintV src, bool print_statistics=false) {
   timer bfs_t; bfs_t.start();
   size_t n = G.num_vertices();
   timer ss; ss.start();
-  auto vtxs = G.fetch_all_vertices();
+  auto flat = G.flat_vertices();
+  const auto& vtxs = *flat;
   if (print_statistics) {
     ss.stop(); ss.reportTotal("snapshot time");
   }
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../pbbslib/random.h"
+
+#include <algorithm>
+
+// Connected components by concurrent union-find with neighbor sampling
+// (Afforest, Sutton et al. 2018), over a flat snapshot of the graph:
+//  1. each vertex is linked with its first few neighbors, which on most
+//     graphs already puts nearly all of the largest component in one tree,
+//  2. the largest component is estimated by sampling vertices, and
+//  3. only the vertices outside it are linked with the rest of their
+//     neighbors.
+// On a symmetric graph an edge between the largest component and another
+// vertex is seen from the other vertex in step 3, so the largest
+// component's (remaining) edges are never read. Directed graphs get weakly
+// connected components over the out-edges, reading every edge.
+//
+// Roots are always linked to smaller roots, so a component's label is its
+// least vertex, and every successful link joins two trees, so the edges
+// that made them form a spanning forest.
+namespace connectivity {
+
+  constexpr size_t neighbor_rounds = 2;
+  constexpr size_t num_samples = 1024;
+
+  inline uintV find(uintV* parents, uintV i) {
+    uintV p = parents[i];
+    while (p != i) {
+      // path halving
+      uintV gp = parents[p];
+      if (gp != p) parents[i] = gp;
+      i = p; p = gp;
+    }
+    return p;
+  }
+
+  // Links the trees of u and v, calling on_link(root, u, v) with the root
+  // that was linked if they were different trees.
+  template <class L>
+  inline void link(uintV* parents, uintV u, uintV v, L& on_link) {
+    while (true) {
+      uintV ru = find(parents, u), rv = find(parents, v);
+      if (ru == rv) return;
+      if (ru < rv) std::swap(ru, rv);
+      if (pbbs::atomic_compare_and_swap(&parents[ru], ru, rv)) {
+        on_link(ru, u, v);
+        return;
+      }
+    }
+  }
+
+  template <class Graph, class L>
+  auto components(Graph& GA, bool symmetric, bool print_stats, L on_link) {
+    size_t n = GA.num_vertices();
+    timer cc_t; cc_t.start();
+    auto flat = GA.flat_vertices();
+    const auto& vtxs = *flat;
+    auto parents = pbbs::sequence<uintV>(n, [&] (size_t i) { return (uintV)i; });
+    auto P = parents.begin();
+
+    timer sample_t; sample_t.start();
+    parallel_for(0, n, [&] (size_t i) {
+      size_t k = 0;
+      vtxs[i].iter_elms_cond(i, [&] (const uintV& ngh) {
+        link(P, i, ngh, on_link);
+        return ++k == neighbor_rounds;
+      });
+    }, 256);
+    parallel_for(0, n, [&] (size_t i) { P[i] = find(P, i); });
+    sample_t.stop();
+
+    // The most frequent root of a sample of the vertices.
+    uintV largest = UINT_V_MAX;
+    if (symmetric && n > 0) {
+      auto r = pbbs::random();
+      auto sample = pbbs::sequence<uintV>(num_samples, [&] (size_t i) {
+        return find(P, r.ith_rand(i) % n);
+      });
+      std::sort(sample.begin(), sample.end());
+      size_t best = 0;
+      for (size_t i = 0, j; i < num_samples; i = j) {
+        for (j = i; j < num_samples && sample[j] == sample[i]; j++);
+        if (j - i > best) { best = j - i; largest = sample[i]; }
+      }
+    }
+
+    timer finish_t; finish_t.start();
+    parallel_for(0, n, [&] (size_t i) {
+      // The root of the largest component can change as other trees are
+      // linked to it.
+      if (largest != UINT_V_MAX && find(P, i) == find(P, largest)) return;
+      // The first neighbor_rounds neighbors were linked above.
+      auto map_f = [&] (const uintV& ngh, size_t ind) {
+        if (ind >= neighbor_rounds) link(P, i, ngh, on_link);
+      };
+      size_t deg = vtxs[i].degree();
+      if (deg > neighbor_rounds) Graph::map_out_edges(i, vtxs[i], deg, map_f, 0);
+    }, 256);
+    parallel_for(0, n, [&] (size_t i) { P[i] = find(P, i); });
+    finish_t.stop();
+
+    if (print_stats) {
+      sample_t.reportTotal("sampling time");
+      finish_t.reportTotal("finish time");
+      cc_t.report(cc_t.stop(), "connectivity time");
+    }
+    return parents;
+  }
+
+} // namespace connectivity
+
+// Returns the label of every vertex's component, which is the least vertex
+// in it.
+template <class Graph>
+auto Connectivity(Graph& GA, bool symmetric=true, bool print_stats=false) {
+  auto no_op = [] (uintV root, uintV u, uintV v) {};
+  return connectivity::components(GA, symmetric, print_stats, no_op);
+}
+
+// Returns the component labels, as Connectivity does, and the edges of a
+// spanning forest of the graph.
+template <class Graph>
+auto SpanningForest(Graph& GA, bool symmetric=true, bool print_stats=false) {
+  size_t n = GA.num_vertices();
+  // The edge that linked each root; each root is linked at most once.
+  auto linked_by = pbbs::sequence<pair<uintV, uintV>>(n, make_pair(UINT_V_MAX, UINT_V_MAX));
+  auto on_link = [&] (uintV root, uintV u, uintV v) { linked_by[root] = make_pair(u, v); };
+  auto labels = connectivity::components(GA, symmetric, print_stats, on_link);
+  auto forest = pbbs::filter(linked_by, [] (const pair<uintV, uintV>& e) {
+    return e.first != UINT_V_MAX;
+  });
+  return make_pair(std::move(labels), std::move(forest));
+}
@@ -56,7 +56,9 @@ auto LDD(Graph& GA, double beta, bool permute=true, bool print_stats=false) {
   auto cluster_ids = pbbs::sequence<uintV>(n);
   parallel_for(0, n, [&] (size_t i) { cluster_ids[i] = UINT_V_MAX; });
 
-  timer sparse_t, dense_t, fetch_t, other_t;
+  auto flat = GA.flat_vertices();
+  const auto& vtxs = *flat;
+  timer sparse_t, dense_t, other_t;
   size_t last_round = total_rounds(n, beta);
   size_t round = 0, num_visited = 0;
   vertex_subset frontier(n); // Initially empty
@@ -85,7 +87,7 @@ auto LDD(Graph& GA, double beta, bool permute=true, bool print_stats=false) {
     if (num_visited >= n) break;
 
     auto ldd_f = LDD_F(cluster_ids.begin());
-    auto next_frontier = GA.edge_map(frontier, ldd_f, sparse_t, dense_t, fetch_t, other_t);
+    auto next_frontier = GA.edge_map(frontier, ldd_f, vtxs, sparse_t, dense_t, other_t);
     frontier.del();
     frontier = next_frontier;
 
@@ -68,7 +68,8 @@ template <class Graph>
 auto MIS(Graph& G, bool print_stats=false) {
   timer init_t; init_t.start();
   size_t n = G.num_vertices();
-  auto vtxs = G.fetch_all_vertices();
+  auto flat = G.flat_vertices();
+  const auto& vtxs = *flat;
 
   // 1. Compute the priority DAG
   auto priorities = pbbs::sequence<intV>(n);
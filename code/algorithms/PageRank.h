@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cmath>
+
+// PageRank, with dangling vertices leaking their rank as in Ligra: the ranks
+// are the fixpoint of p[v] = (1-d)/n + d * sum_{u->v} p[u]/deg(u).
+
+struct PR_F {
+  double* p_curr;
+  double* p_next;
+  uintE* degs;
+  PR_F(double* _p_curr, double* _p_next, uintE* _degs) :
+    p_curr(_p_curr), p_next(_p_next), degs(_degs) {}
+  inline bool update(uintV s, uintV d) {
+    p_next[d] += p_curr[s] / degs[s];
+    return 1;
+  }
+  inline bool updateAtomic(uintV s, uintV d) {
+    pbbs::write_add(&p_next[d], p_curr[s] / degs[s]);
+    return 1;
+  }
+  inline bool cond(uintV d) { return true; }
+};
+
+// Computes PageRank by power iteration until the L1 norm of the change in the
+// ranks is at most epsilon.
+template <class Graph>
+pbbs::sequence<double> PageRank(Graph& G, double epsilon=1e-7, double damping=0.85,
+                                size_t max_iters=100, bool print_statistics=false) {
+  timer pr_t; pr_t.start();
+  size_t n = G.num_vertices();
+  auto vtxs = G.fetch_all_vertices();
+  auto degs = pbbs::sequence<uintE>(n, [&] (size_t i) { return (uintE)vtxs[i].degree(); });
+  auto p_curr = pbbs::sequence<double>(n, 1.0/n);
+  auto p_next = pbbs::sequence<double>(n, 0.0);
+  auto all = pbbs::new_array_no_init<bool>(n);
+  parallel_for(0, n, [&] (size_t i) { all[i] = true; });
+  auto frontier = vertex_subset(n, all);
+
+  timer sparse_t, dense_t, other_t;
+  size_t iter = 0;
+  while (iter++ < max_iters) {
+    G.edge_map(frontier, PR_F(p_curr.begin(), p_next.begin(), degs.begin()), vtxs,
+               sparse_t, dense_t, other_t, no_output | stay_dense);
+    parallel_for(0, n, [&] (size_t i) {
+      p_next[i] = (1 - damping) / n + damping * p_next[i];
+    });
+    auto diffs = pbbs::delayed_seq<double>(n, [&] (size_t i) {
+      return std::fabs(p_next[i] - p_curr[i]);
+    });
+    double L1 = pbbs::reduce(diffs, pbbs::addm<double>());
+    std::swap(p_curr, p_next);
+    parallel_for(0, n, [&] (size_t i) { p_next[i] = 0.0; });
+    if (L1 <= epsilon) break;
+  }
+  frontier.del();
+  if (print_statistics) {
+    cout << "PageRank iterations = " << std::min(iter, max_iters) << endl;
+    pr_t.report(pr_t.stop(), "PageRank time");
+  }
+  return p_curr;
+}
+
+struct PR_Push_F {
+  double* r;
+  double* delta;
+  uintE* degs;
+  bool* queued;
+  double damping, threshold;
+  PR_Push_F(double* _r, double* _delta, uintE* _degs, bool* _queued, double _damping, double _threshold) :
+    r(_r), delta(_delta), degs(_degs), queued(_queued), damping(_damping), threshold(_threshold) {}
+  inline bool update(uintV s, uintV d) {
+    r[d] += damping * delta[s] / degs[s];
+    return std::fabs(r[d]) > threshold;
+  }
+  inline bool updateAtomic(uintV s, uintV d) {
+    pbbs::write_add(&r[d], damping * delta[s] / degs[s]);
+    return std::fabs(r[d]) > threshold &&
+      !queued[d] && pbbs::atomic_compare_and_swap(&queued[d], false, true);
+  }
+  inline bool cond(uintV d) { return true; }
+};
+
+// Updates p, the ranks of a previous version of G, to the ranks of G, where D
+// is the diff from the previous version to G (see graph_diff.h). Only the
+// residuals of vertices whose rank equation changed are recomputed: the
+// touched vertices, the endpoints of changed edges, and the out-neighbors of
+// touched vertices. Residuals larger than epsilon/n are then pushed to
+// out-neighbors until none is left, which bounds the L1 error added by the
+// update by about epsilon. A small batch still moves the ranks of much of the
+// graph a little, so with the epsilon of a full recomputation the pushes reach
+// most vertices; the work drops quickly with a larger epsilon. If the number
+// of vertices changed, every rank equation changes and all residuals are
+// recomputed. Returns the number of pushes.
+template <class Graph>
+size_t PageRank_incremental(Graph& G, pbbs::sequence<double>& p, const graph_diff& D,
+                            double epsilon=1e-7, double damping=0.85,
+                            bool print_statistics=false) {
+  timer pr_t; pr_t.start();
+  size_t n = G.num_vertices();
+  auto vtxs = G.fetch_all_vertices();
+  auto degs = pbbs::sequence<uintE>(n, [&] (size_t i) { return (uintE)vtxs[i].degree(); });
+  double threshold = epsilon / n;
+
+  // 1. Find the vertices whose residual changed.
+  auto queued = pbbs::sequence<bool>(n, false);
+  bool resized = (p.size() != n);
+  if (resized) {
+    auto old_p = std::move(p);
+    p = pbbs::sequence<double>(n, [&] (size_t i) { return (i < old_p.size()) ? old_p[i] : 0.0; });
+    parallel_for(0, n, [&] (size_t i) { queued[i] = true; });
+  } else {
+    auto mark = [&] (uintV v) { if (!queued[v]) queued[v] = true; };
+    parallel_for(0, D.touched.size(), [&] (size_t i) {
+      uintV u = D.touched[i];
+      mark(u);
+      if (u < n) vtxs[u].map_elms(u, [&] (const uintV& ngh, size_t j) { mark(ngh); });
+    }, 1);
+    parallel_for(0, D.inserted.size(), [&] (size_t i) { mark(get<1>(D.inserted[i])); });
+    parallel_for(0, D.deleted.size(), [&] (size_t i) { mark(get<1>(D.deleted[i])); });
+  }
+  auto affected = pbbs::pack_index<uintV>(queued);
+
+  // 2. Recompute their residuals over the in-edges of G.
+  auto r = pbbs::sequence<double>(n, 0.0);
+  parallel_for(0, affected.size(), [&] (size_t i) {
+    uintV v = affected[i];
+    double sum = 0.0;
+    Graph::in_edges(vtxs[v]).iter_elms(v, [&] (uintV u) { sum += p[u] / degs[u]; });
+    r[v] = (1 - damping) / n + damping * sum - p[v];
+    queued[v] = std::fabs(r[v]) > threshold;
+  }, 1);
+  auto frontier_ids = pbbs::filter(affected, [&] (uintV v) { return queued[v]; });
+  size_t num_affected = affected.size();
+  affected.clear();
+
+  // 3. Push residuals until every one is at most the threshold.
+  auto delta = pbbs::sequence<double>(n, 0.0);
+  size_t fs = frontier_ids.size();
+  auto frontier = vertex_subset(n, fs, frontier_ids.to_array());
+  timer sparse_t, dense_t, other_t;
+  size_t rounds = 0, pushes = 0;
+  while (!frontier.is_empty()) {
+    rounds++;
+    pushes += frontier.size();
+    frontier.to_sparse();
+    parallel_for(0, frontier.size(), [&] (size_t i) {
+      uintV v = frontier.s[i];
+      delta[v] = r[v];
+      p[v] += r[v];
+      r[v] = 0.0;
+      queued[v] = false;
+    });
+    auto output = G.edge_map(frontier,
+        PR_Push_F(r.begin(), delta.begin(), degs.begin(), queued.begin(), damping, threshold),
+        vtxs, sparse_t, dense_t, other_t);
+    frontier.del();
+    frontier = output;
+    frontier.to_sparse();
+    parallel_for(0, frontier.size(), [&] (size_t i) { queued[frontier.s[i]] = true; });
+  }
+  frontier.del();
+  if (print_statistics) {
+    cout << "affected vertices = " << num_affected << " rounds = " << rounds
+         << " pushes = " << pushes << (resized ? " (vertex count changed)" : "") << endl;
+    pr_t.report(pr_t.stop(), "incremental PageRank time");
+  }
+  return pushes;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "../graph/graph_diff.h"
+
+// Triangle counting on symmetric graphs.
+
+namespace triangle_utils {
+
+  // Size of the intersection of two sorted arrays.
+  inline size_t intersect(uintV const* l, size_t l_size, uintV const* r, size_t r_size) {
+    size_t ct = 0, l_i = 0, r_i = 0;
+    while (l_i < l_size && r_i < r_size) {
+      if (l[l_i] < r[r_i]) l_i++;
+      else if (r[r_i] < l[l_i]) r_i++;
+      else { ct++; l_i++; r_i++; }
+    }
+    return ct;
+  }
+
+  // Number of triangles of G that contain at least one edge of E. E is sorted,
+  // holds both directions of each edge, and is a subset of the edges of G.
+  //
+  // Summing |N(u) & N(v)| over the edges (u, v) of E counts a triangle once
+  // for each of its edges in E. A triangle with two edges in E has one wedge
+  // of E (two edges of E sharing an endpoint) that G closes, and one with
+  // three edges in E has three, all of which E itself closes. With S the sum,
+  // W the wedges of E closed by G and W3 those closed by E, the count is
+  // S - W + W3/3.
+  template <class Graph>
+  size_t triangles_on_edges(Graph& G, const pbbs::sequence<graph_diff::edge>& E) {
+    size_t k = E.size();
+    if (k == 0) return 0;
+    auto has_edge = [&] (uintV u, uintV v) {
+      return std::binary_search(E.begin(), E.end(), make_tuple(u, v));
+    };
+
+    // 1. S, intersecting the edge lists of both endpoints in G.
+    auto S = pbbs::sequence<size_t>(k, (size_t)0);
+    parallel_for(0, k, [&] (size_t i) {
+      uintV u = get<0>(E[i]), v = get<1>(E[i]);
+      if (u < v) {
+        auto mu = G.find_vertex(u); auto mv = G.find_vertex(v);
+        if (mu.valid && mv.valid) {
+          auto tu = mu.value; auto tv = mv.value;
+          S[i] = tree_plus::intersect(tu, u, tv, v);
+        }
+      }
+    }, 1);
+
+    // 2. The wedges of E, grouped by their middle vertex.
+    auto W = pbbs::sequence<size_t>(k, (size_t)0);
+    auto W3 = pbbs::sequence<size_t>(k, (size_t)0);
+    auto starts = pbbs::pack_index<size_t>(pbbs::delayed_seq<bool>(k, [&] (size_t i) {
+      return i == 0 || get<0>(E[i]) != get<0>(E[i-1]);
+    }));
+    size_t num_starts = starts.size();
+    parallel_for(0, num_starts, [&] (size_t s) {
+      size_t start = starts[s];
+      size_t end = (s == num_starts - 1) ? k : starts[s+1];
+      parallel_for(start, end, [&] (size_t i) {
+        uintV u = get<1>(E[i]);
+        auto mu = G.find_vertex(u);
+        for (size_t j=i+1; j<end; j++) {
+          uintV v = get<1>(E[j]);
+          if (mu.valid && mu.value.contains(u, v)) {
+            W[i]++;
+            if (has_edge(u, v)) W3[i]++;
+          }
+        }
+      }, 1);
+    }, 1);
+
+    size_t s_sum = pbbs::reduce(S, pbbs::addm<size_t>());
+    size_t w_sum = pbbs::reduce(W, pbbs::addm<size_t>());
+    size_t w3_sum = pbbs::reduce(W3, pbbs::addm<size_t>());
+    return s_sum - w_sum + w3_sum / 3;
+  }
+
+} // namespace triangle_utils
+
+// Counts the triangles of G. Each edge is oriented from the endpoint of lower
+// degree to the one of higher degree (breaking ties by id), and each triangle
+// is found once, by intersecting the oriented lists of the endpoints of its
+// lowest edge. The oriented lists have O(sqrt(m)) edges each, which bounds the
+// work by O(m^{3/2}).
+template <class Graph>
+size_t TriangleCount(Graph& G, bool print_statistics=false) {
+  timer tc_t; tc_t.start();
+  size_t n = G.num_vertices();
+  auto vtxs = G.fetch_all_vertices();
+  auto degs = pbbs::sequence<uintE>(n, [&] (size_t i) { return (uintE)vtxs[i].degree(); });
+  auto before = [&] (uintV u, uintV v) {
+    return degs[u] < degs[v] || (degs[u] == degs[v] && u < v);
+  };
+
+  // 1. Build the oriented lists, which are sorted by id.
+  auto offs = pbbs::sequence<size_t>(n+1, (size_t)0);
+  parallel_for(0, n, [&] (size_t u) {
+    size_t ct = 0;
+    vtxs[u].iter_elms(u, [&] (uintV v) { if (before(u, v)) ct++; });
+    offs[u] = ct;
+  }, 1);
+  size_t m_oriented = pbbs::scan_inplace(offs.slice(), pbbs::addm<size_t>());
+  auto nghs = pbbs::sequence<uintV>(m_oriented);
+  parallel_for(0, n, [&] (size_t u) {
+    size_t off = offs[u];
+    vtxs[u].iter_elms(u, [&] (uintV v) { if (before(u, v)) nghs[off++] = v; });
+  }, 1);
+
+  // 2. Intersect the oriented lists of the endpoints of every oriented edge.
+  auto counts = pbbs::sequence<size_t>(n);
+  parallel_for(0, n, [&] (size_t u) {
+    uintV const* nu = nghs.begin() + offs[u];
+    size_t du = offs[u+1] - offs[u];
+    auto per_edge = pbbs::delayed_seq<size_t>(du, [&] (size_t i) {
+      uintV v = nu[i];
+      return triangle_utils::intersect(nu, du, nghs.begin() + offs[v], offs[v+1] - offs[v]);
+    });
+    counts[u] = pbbs::reduce(per_edge, pbbs::addm<size_t>());
+  }, 1);
+  size_t count = pbbs::reduce(counts, pbbs::addm<size_t>());
+  if (print_statistics) {
+    cout << "triangles = " << count << " oriented edges = " << m_oriented << endl;
+    tc_t.report(tc_t.stop(), "triangle count time");
+  }
+  return count;
+}
+
+// Returns the number of triangles of B, given the number count of triangles of
+// A and the diff D from A to B (see graph_diff.h). A triangle is in only one
+// of A and B iff it has an edge in D, so the triangles of A on deleted edges
+// are subtracted and those of B on inserted edges added. The work depends only
+// on the changed edges and their endpoints' degrees, not on the graph.
+template <class Graph>
+size_t TriangleCount_incremental(Graph& A, Graph& B, const graph_diff& D, size_t count,
+                                 bool print_statistics=false) {
+  timer tc_t; tc_t.start();
+  size_t removed = triangle_utils::triangles_on_edges(A, D.deleted);
+  size_t added = triangle_utils::triangles_on_edges(B, D.inserted);
+  if (print_statistics) {
+    cout << "triangles removed = " << removed << " added = " << added << endl;
+    tc_t.report(tc_t.stop(), "incremental triangle count time");
+  }
+  return count - removed + added;
+}
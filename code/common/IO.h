@@ -105,6 +105,58 @@ auto read_unweighted_graph(const char* fname, bool is_symmetric, bool mmap=false
   return make_tuple(n, m, offsets, edges);
 }
 
+// Reads a graph in the WeightedAdjacencyGraph format (the AdjacencyGraph
+// format followed by one weight per edge).
+template <class W>
+auto read_weighted_graph(const char* fname, bool is_symmetric, bool mmap=false) {
+  pbbs::sequence<char*> tokens;
+  pbbs::sequence<char> S;
+  if (mmap) {
+    auto SS = mmapStringFromFile(fname);
+    char *bytes = pbbs::new_array_no_init<char>(SS.second);
+    // Cannot mutate the graph unless we copy.
+    parallel_for(0, SS.second, [&] (size_t i) {
+      bytes[i] = SS.first[i];
+    });
+    if (munmap(SS.first, SS.second) == -1) {
+      perror("munmap");
+      exit(-1);
+    }
+    S = pbbs::sequence<char>(bytes, SS.second);
+  } else {
+    S = readStringFromFile(fname);
+  }
+  tokens = pbbs::tokenize(S, [] (const char c) { return pbbs::is_space(c); });
+  if (tokens[0] != (string) "WeightedAdjacencyGraph") {
+    cout << fname << " is not a WeightedAdjacencyGraph" << endl;
+    exit(0);
+  }
+
+  size_t n = atol(tokens[1]);
+  size_t m = atol(tokens[2]);
+
+  cout << "n = " << n << " m = " << m << endl;
+  assert(tokens.size() - 1 == n + 2*m + 2);
+
+  uintE* offsets = pbbs::new_array_no_init<uintE>(n);
+  uintV* edges = pbbs::new_array_no_init<uintV>(m);
+  W* weights = pbbs::new_array_no_init<W>(m);
+
+  parallel_for(0, n, [&] (size_t i) { offsets[i] = atol(tokens[i + 3]); });
+  parallel_for(0, m, [&] (size_t i) {
+    edges[i] = atol(tokens[i+n+3]);
+    if (std::is_floating_point<W>::value) {
+      weights[i] = atof(tokens[i+n+m+3]);
+    } else {
+      weights[i] = atol(tokens[i+n+m+3]);
+    }
+  });
+
+  S.clear();
+  tokens.clear();
+  return make_tuple(n, m, offsets, edges, weights);
+}
+
 auto read_o_direct(const char* fname) {
   int fd;
   if ( (fd = open(fname, O_RDONLY | O_DIRECT) ) != -1) {
@@ -206,3 +258,130 @@ auto read_compressed_graph(const char* fname, bool is_symmetric, bool mmap=false
 
   return make_tuple(n, m, ret_offsets, ret_edges);
 }
+
+// Binary CSR format, written by tools/write_binary_graph.cpp. The file is
+// mmapped and read in place; the layout is
+//
+// binary_csr_header
+// uint64_t offsets[n+1] (offsets[n] = m)
+// uintV edges[m]
+//
+// The checksum is binary_csr_checksum over all of the offsets and edges.
+static constexpr const uint64_t binary_csr_magic = 0x5253434e45505341; // "ASPENCSR"
+static constexpr const uint64_t binary_csr_version = 1;
+
+struct binary_csr_header {
+  uint64_t magic;
+  uint64_t version;
+  uint64_t vtx_bytes; // sizeof(uintV) used when writing
+  uint64_t num_vertices;
+  uint64_t num_edges;
+  uint64_t checksum;
+};
+
+struct binary_csr {
+  char* s;
+  size_t s_size;
+  size_t n;
+  size_t m;
+  uint64_t* offsets;
+  uintV* edges;
+  uint64_t checksum;
+};
+
+// Order-dependent hashes of the offsets in [lo, hi) and the edges in
+// [lo, hi). Sums of disjoint ranges combine by addition.
+uint64_t binary_csr_offsets_checksum(const uint64_t* offsets, size_t lo, size_t hi) {
+  auto S = pbbs::delayed_seq<uint64_t>(hi - lo, [&] (size_t i) {
+    return pbbs::hash64(offsets[lo + i] + pbbs::hash64(2*(lo + i)));
+  });
+  return pbbs::reduce(S, pbbs::addm<uint64_t>());
+}
+
+uint64_t binary_csr_edges_checksum(const uintV* edges, size_t lo, size_t hi) {
+  auto S = pbbs::delayed_seq<uint64_t>(hi - lo, [&] (size_t i) {
+    return pbbs::hash64(edges[lo + i] + pbbs::hash64(2*(lo + i) + 1));
+  });
+  return pbbs::reduce(S, pbbs::addm<uint64_t>());
+}
+
+void write_binary_csr(const char* fname, size_t n, size_t m, const uintE* offsets, const uintV* edges) {
+  size_t offsets_start = sizeof(binary_csr_header);
+  size_t edges_start = offsets_start + (n+1)*sizeof(uint64_t);
+  size_t total_bytes = edges_start + m*sizeof(uintV);
+  auto out = pbbs::sequence<char>(total_bytes);
+
+  auto H = (binary_csr_header*)out.begin();
+  auto out_offsets = (uint64_t*)(out.begin() + offsets_start);
+  auto out_edges = (uintV*)(out.begin() + edges_start);
+  parallel_for(0, n, [&] (size_t i) { out_offsets[i] = offsets[i]; });
+  out_offsets[n] = m;
+  parallel_for(0, m, [&] (size_t i) { out_edges[i] = edges[i]; });
+
+  H->magic = binary_csr_magic;
+  H->version = binary_csr_version;
+  H->vtx_bytes = sizeof(uintV);
+  H->num_vertices = n;
+  H->num_edges = m;
+  H->checksum = binary_csr_offsets_checksum(out_offsets, 0, n+1) +
+                binary_csr_edges_checksum(out_edges, 0, m);
+
+  std::ofstream file(fname, std::ios::out | std::ios::binary);
+  if (!file.is_open()) {
+    std::cout << "Unable to open file: " << fname << std::endl;
+    abort();
+  }
+  file.write(out.begin(), total_bytes);
+  file.close();
+}
+
+// Maps a binary CSR file and checks its header. Nothing but the header is
+// read, so the caller decides how the offsets and edges are paged in.
+binary_csr mmap_binary_csr(const char* fname) {
+  auto SS = mmapStringFromFile(fname);
+  char* s = SS.first;
+  size_t s_size = SS.second;
+
+  auto H = (binary_csr_header*)s;
+  if (s_size < sizeof(binary_csr_header) || H->magic != binary_csr_magic) {
+    cout << fname << " is not a binary CSR graph" << endl;
+    exit(0);
+  }
+  if (H->version != binary_csr_version || H->vtx_bytes != sizeof(uintV)) {
+    cout << "Binary CSR version " << H->version << " (vertex bytes = " << H->vtx_bytes
+         << ") is incompatible with this build" << endl;
+    exit(0);
+  }
+  size_t n = H->num_vertices, m = H->num_edges;
+  size_t edges_start = sizeof(binary_csr_header) + (n+1)*sizeof(uint64_t);
+  if (edges_start + m*sizeof(uintV) != s_size) {
+    cout << fname << " is truncated" << endl;
+    exit(0);
+  }
+  cout << "n = " << n << " m = " << m << endl;
+  return {s, s_size, n, m, (uint64_t*)(s + sizeof(binary_csr_header)),
+          (uintV*)(s + edges_start), H->checksum};
+}
+
+void unmap_binary_csr(binary_csr& G) {
+  if (munmap(G.s, G.s_size) == -1) {
+    perror("munmap");
+    exit(-1);
+  }
+}
+
+// Drops the pages of a read-only mapping that lie entirely inside
+// [begin, end), once they have been consumed, so a streaming build keeps only
+// a window of its input resident.
+void release_pages(const void* begin, const void* end) {
+  size_t pgsize = getpagesize();
+  size_t b = ((((size_t)begin) + pgsize - 1) / pgsize) * pgsize;
+  size_t e = (((size_t)end) / pgsize) * pgsize;
+  if (b < e) {
+    madvise((void*)b, e - b, MADV_DONTNEED);
+  }
+}
+
+void release_binary_csr_edges(binary_csr& G, size_t lo, size_t hi) {
+  release_pages(G.edges + lo, G.edges + hi);
+}
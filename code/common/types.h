@@ -2,6 +2,7 @@
 
 #include <limits>
 #include <cstdint>
+#include <tuple>
 #include "../pbbslib/utilities.h"
 
 #ifndef NDEBUG
@@ -40,4 +41,8 @@ typedef unsigned int uintE;
 typedef unsigned int timestamp;
 typedef unsigned int ref_count;
 
+// (u, v, insert): an insertion of the edge (u, v) if insert is set, and a
+// deletion otherwise.
+typedef std::tuple<uintV, uintV, bool> edge_update;
+
 constexpr size_t TOP_BIT = ((size_t)std::numeric_limits<long>::max()) + 1;
@@ -1,28 +1,43 @@
 #pragma once
 
-//#include "versioned_graph_waitfree.h"
+// Building with -DWAITFREE selects the wait-free versioning backend.
+#ifdef WAITFREE
+#include "versioned_graph_waitfree.h"
+#else
 #include "versioned_graph.h"
+#endif
 //#include "versioned_graph_2.h"
+#include "tree_plus/immutable_graph_weighted.h"
+#include "tree_plus/immutable_graph_tree_plus_directed.h"
+#include "update_pipeline.h"
 #include "../pbbslib/parse_command_line.h"
 #include "../common/IO.h"
 #include "../common/byte-pd-amortized.h"
 //#include "other/immutable_graph.h"
 
 using treeplus_graph = traversable_graph<sym_immutable_graph_tree_plus>;
+using directed_treeplus_graph = traversable_graph<asym_immutable_graph_tree_plus>;
+template <class W>
+using weighted_graph = sym_immutable_graph_weighted<W>;
 //using simple_graph = traversable_graph<sym_immutable_graph>;
 
 static const string default_file_name = "";
 
-auto build_large_compressed_graph(string fname, bool is_symmetric, size_t n_parts=1) {
-
+// Builds a graph from a compressed (.bytepda) input without decompressing it
+// into an edge array: each vertex's bytepd_amortized blocks are decoded
+// straight into C-tree chunks, and vertices are built in parallel. Vertices
+// are processed in ranges whose transient memory (the resident part of the
+// input and the staged vertex entries) stays within mem_budget bytes; the
+// input pages of a range are released once it is built. Self-loops and
+// duplicate edges are dropped.
+auto build_compressed_graph(string fname, size_t mem_budget) {
   auto SS = mmapStringFromFile(fname.c_str());
   char* s = SS.first;
   size_t s_size = SS.second;
 
   long* sizes = (long*) s;
-  size_t n = sizes[0];
-//  size_t m = sizes[1];
-  cout << "sz[0] = " << sizes[0] << " sz[1] = " << sizes[1] << " sz[2] = " << sizes[2] << endl;
+  size_t n = sizes[0], m = sizes[1];
+  cout << "n = " << n << " m = " << m << endl;
 
   uintE* offsets = (uintE*) (s+3*sizeof(long));
   long skip = 3*sizeof(long) + (n+1)*sizeof(uintE);
@@ -30,140 +45,43 @@ auto build_large_compressed_graph(string fname, bool is_symmetric, size_t n_part
   skip += n*sizeof(uintV);
   uchar* edges = (uchar*)(s+skip);
 
-  cout << "Building compressed graph, nparts = " << n_parts << endl;
-
-  size_t vtxs_per_batch = n/n_parts;
-  size_t vertices_finished = 0;
-  size_t edges_finished = 0;
-
-  size_t bs = std::min(n-vertices_finished, vtxs_per_batch);
-  pbbs::sequence<uintE> offs = pbbs::sequence<uintE>(bs);
-  parallel_for (0, bs, [&] (size_t i) {
-    size_t degree = Degrees[i];
-    uintE v = vertices_finished + i;
-    size_t actual_degree = 0;
-    if (degree > 0) {
-      uchar* start = edges + offsets[v];
-      auto it = bytepd_amortized::simple_iter(start, degree, v);
-      uintV ngh = it.cur();
-      if (ngh != v) {
-        actual_degree++;
-      }
-      while (it.has_next()) {
-        uintV nxt = it.next();
-        if (nxt != ngh || nxt != v) {
-          actual_degree++;
-        }
-        ngh = nxt;
-      }
+  using KV = pair<uintV, sym_immutable_graph_tree_plus::edge_struct>;
+  size_t vertex_bytes = sizeof(uintE) + sizeof(uintV) + sizeof(KV);
+  auto range_bytes = [&] (size_t lo, size_t hi) {
+    return (offsets[hi] - offsets[lo]) + (hi - lo)*vertex_bytes;
+  };
+  // the largest range starting at lo that fits in the budget
+  auto next_range = [&] (size_t lo) -> size_t {
+    size_t a = lo + 1, b = n;
+    while (a < b) {
+      size_t mid = (a + b + 1) / 2;
+      if (range_bytes(lo, mid) <= mem_budget) a = mid; else b = mid - 1;
     }
-    offs[i] = actual_degree;
-  }, 1);
-  uintE n_edges = pbbs::scan_inplace(offs.slice(), pbbs::addm<uintE>());
-  cout << "Next batch num edges = " << n_edges << endl;
-  edges_finished += n_edges;
-
-  auto init_batch_edges = pbbs::new_array_no_init<uintV>(n_edges);
-  parallel_for(0, bs, [&] (size_t i) {
-    size_t off = offs[i];
-    size_t original_degree = Degrees[i];
-    size_t degree = ((i == (bs-1)) ? (n_edges) : offs[i+1]) - off;
-    if (degree > 0) {
-      uintE v = vertices_finished + i;
-      uchar* start = edges + offsets[v];
-      auto it = bytepd_amortized::simple_iter(start, original_degree, v);
+    return a;
+  };
+  auto build_vertex = [&] (size_t v) {
+    size_t degree = Degrees[v];
+    return sym_immutable_graph_tree_plus::edge_struct::from_stream(v, [&] (auto emit) {
+      if (degree == 0) return;
+      auto it = bytepd_amortized::simple_iter(edges + offsets[v], degree, v);
       uintV ngh = it.cur();
-      size_t k = 0;
-      if (ngh != v) {
-        init_batch_edges[off] = ngh;
-        k++;
-      }
+      if (ngh != v) emit(ngh);
       while (it.has_next()) {
         uintV nxt = it.next();
-        if (nxt != ngh || nxt != v) {
-          init_batch_edges[off + k++] = nxt;
-        }
+        if (nxt != ngh && nxt != v) emit(nxt);
         ngh = nxt;
       }
-      assert(k == degree);
-    }
-  }, 1);
-
-  cout << "Inserting next batch, bs = " << bs << endl;
-  // Treeplus graph handles freeing offs and the edges.
-  auto G = treeplus_graph(bs, n_edges, offs.to_array(), init_batch_edges);
-  debug(cout << "Deleting" << endl;);
-  debug(cout << "Done!" << endl;);
-  G.print_stats();
-  cout << "vertices remaining: " << (n - vertices_finished) << endl;
-  vertices_finished += bs;
-
-  while (vertices_finished < n) {
-    size_t bs = std::min(n-vertices_finished, vtxs_per_batch);
-    offs = pbbs::sequence<uintE>(bs);
-    parallel_for (0, bs, [&] (size_t i) {
-      uintE v = vertices_finished + i;
-      size_t degree = Degrees[v];
-      size_t actual_degree = 0;
-      if (degree > 0) {
-        uchar* start = edges + offsets[v];
-        auto it = bytepd_amortized::simple_iter(start, degree, v);
-        uintV ngh = it.cur();
-        if (ngh != v) {
-          actual_degree++;
-        }
-        while (it.has_next()) {
-          uintV nxt = it.next();
-          if (nxt != ngh || nxt != v) {
-            actual_degree++;
-          }
-          ngh = nxt;
-        }
-      }
-      offs[i] = actual_degree;
-//      assert(actual_degree == degree);
-    }, 1);
-    n_edges = pbbs::scan_inplace(offs.slice(), pbbs::addm<uintE>());
-    debug(cout << "Next batch num edges = " << n_edges << endl;);
-    edges_finished += n_edges;
-
-    auto batch_edges = pbbs::new_array_no_init<uintV>(n_edges);
-    parallel_for(0, bs, [&] (size_t i) {
-      size_t off = offs[i];
-      size_t original_degree = Degrees[vertices_finished + i];
-      size_t degree = ((i == (bs-1)) ? (n_edges) : offs[i+1]) - off;
-      if (degree > 0) {
-        uintE v = vertices_finished + i;
-        uchar* start = edges + offsets[v];
-        auto it = bytepd_amortized::simple_iter(start, original_degree, v);
-        uintV ngh = it.cur();
-        size_t k = 0;
-        if (ngh != v) {
-          batch_edges[off] = ngh;
-          k++;
-        }
-        while (it.has_next()) {
-          uintV nxt = it.next();
-          if (nxt != ngh || nxt != v) {
-            batch_edges[off + k++] = nxt;
-          }
-          ngh = nxt;
-        }
-//        assert(k == degree);
-      }
-    }, 1);
-
-    debug(cout << endl;
-    cout << "Inserting next batch, bs = " << bs << endl;);
-    // TODO: check who deletes edges and offs.
-    auto G_next = G.insert_edges_batch(bs, n_edges, offs.to_array(), batch_edges, vertices_finished);
-    debug(cout << "Done!" << endl;);
-    G.print_stats();
-    G = G_next;
-    debug(cout << "vertices remaining: " << (n - vertices_finished) << endl;);
-    vertices_finished += bs;
-  }
-  cout << "Inserted n = " << vertices_finished << " vertices and m = " << edges_finished << " edges " << endl;
+    });
+  };
+  auto on_range = [&] (size_t lo, size_t hi) {
+    release_pages(edges + offsets[lo], edges + offsets[hi]);
+    release_pages(offsets + lo, offsets + hi);
+    release_pages(Degrees + lo, Degrees + hi);
+  };
+
+  cout << "Building compressed graph, memory budget = " << mem_budget << " bytes" << endl;
+  auto G = treeplus_graph::build_by_ranges(n, m, next_range, build_vertex, on_range);
+  cout << "Inserted n = " << G.num_vertices() << " vertices and m = " << G.num_edges() << " edges " << endl;
 
   // Munmap the mmap'd file.
   if (munmap(s, s_size) == -1) {
@@ -174,42 +92,111 @@ auto build_large_compressed_graph(string fname, bool is_symmetric, size_t n_part
   return versioned_graph<treeplus_graph>(std::move(G));
 }
 
-auto initialize_graph(string fname="", bool mmap=false, bool is_symmetric=true, bool compressed=false, size_t n_parts=1) {
+// The default memory budget for building compressed graphs.
+static const size_t default_mem_budget = (size_t)16 << 30;
+
+auto initialize_graph(string fname="", bool mmap=false, bool is_symmetric=true, bool compressed=false, size_t mem_budget=default_mem_budget) {
   if (fname == "") {
     cout << "Unimplemented!" << endl;
     exit(0);
   }
-  if (compressed && n_parts > 1) {
-    cout << "Building large compressed graph" << endl;
-    return build_large_compressed_graph(fname, is_symmetric, n_parts);
+  if (compressed) {
+    cout << "Building compressed graph" << endl;
+    return build_compressed_graph(fname, mem_budget);
   }
   size_t n; size_t m;
   uintE* offsets; uintV* edges;
-  if (!compressed) {
-    cout << "Reading Unweighted Graph" << endl;
-    std::tie(n, m, offsets, edges) = read_unweighted_graph(fname.c_str(), is_symmetric, mmap);
-    cout << "Read Unweighted Graph" << endl;
-  } else {
-    cout << "Reading Compressed Graph" << endl;
-    std::tie(n, m, offsets, edges) = read_compressed_graph(fname.c_str(), is_symmetric, mmap);
-    cout << "Read Compressed Graph" << endl;
-  }
+  cout << "Reading Unweighted Graph" << endl;
+  std::tie(n, m, offsets, edges) = read_unweighted_graph(fname.c_str(), is_symmetric, mmap);
+  cout << "Read Unweighted Graph" << endl;
   return versioned_graph<treeplus_graph>(n, m, offsets, edges);
 }
 
 
+// Loads a directed graph in the AdjacencyGraph format, where the adjacency
+// list of a vertex holds its out-neighbors. The input is not symmetrized.
+auto initialize_directed_graph(string fname, bool mmap=false) {
+  size_t n; size_t m;
+  uintE* offsets; uintV* edges;
+  cout << "Reading Directed Graph" << endl;
+  std::tie(n, m, offsets, edges) = read_unweighted_graph(fname.c_str(), /*is_symmetric=*/false, mmap);
+  cout << "Read Directed Graph" << endl;
+  return versioned_graph<directed_treeplus_graph>(n, m, offsets, edges);
+}
+
 auto empty_treeplus_graph() {
   return versioned_graph<treeplus_graph>();
 }
 
+// Loads a graph in the WeightedAdjacencyGraph format.
+template <class W>
+auto initialize_weighted_graph(string fname, bool mmap=false, bool is_symmetric=true) {
+  size_t n; size_t m;
+  uintE* offsets; uintV* edges; W* weights;
+  cout << "Reading Weighted Graph" << endl;
+  std::tie(n, m, offsets, edges, weights) = read_weighted_graph<W>(fname.c_str(), is_symmetric, mmap);
+  cout << "Read Weighted Graph" << endl;
+  return versioned_graph<weighted_graph<W>>(weighted_graph<W>(n, m, offsets, edges, weights));
+}
+
+// Loads a graph written by write_snapshot (see sym_immutable_graph_tree_plus).
+auto initialize_graph_from_snapshot(string fname) {
+  cout << "Reading Snapshot" << endl;
+  auto G = treeplus_graph::read_snapshot(fname.c_str());
+  cout << "Read Snapshot" << endl;
+  return versioned_graph<treeplus_graph>(std::move(G));
+}
+
+// Loads a graph in the binary CSR format (see write_binary_csr in IO.h). The
+// file is mmapped and its vertices are built a range of about range_edges
+// edges at a time, straight from the mapping. Each range is checksummed as it
+// is consumed and its pages are released afterwards.
+auto initialize_graph_from_binary(string fname, size_t range_edges=(1 << 26)) {
+  cout << "Reading Binary Graph" << endl;
+  auto B = mmap_binary_csr(fname.c_str());
+  uint64_t checksum = 0;
+  auto on_range = [&] (size_t lo, size_t hi) {
+    size_t e_lo = B.offsets[lo], e_hi = B.offsets[hi];
+    checksum += binary_csr_offsets_checksum(B.offsets, lo, hi);
+    checksum += binary_csr_edges_checksum(B.edges, e_lo, e_hi);
+    release_binary_csr_edges(B, e_lo, e_hi);
+  };
+  auto G = treeplus_graph::build_streaming(B.n, B.m, B.offsets, B.edges, range_edges, on_range);
+  checksum += binary_csr_offsets_checksum(B.offsets, B.n, B.n+1);
+  if (checksum != B.checksum) {
+    cout << fname << ": checksum mismatch, the file is corrupt" << endl;
+    exit(0);
+  }
+  unmap_binary_csr(B);
+  cout << "Read Binary Graph" << endl;
+  return versioned_graph<treeplus_graph>(std::move(G));
+}
+
+// Writes the latest version of VG to fname in the native snapshot format.
+template <class VG>
+void write_snapshot(VG& vg, string fname) {
+  auto S = vg.acquire_version();
+  S.graph.write_snapshot(fname.c_str());
+  vg.release_version(std::move(S));
+}
+
 auto initialize_treeplus_graph(commandLine& P) {
   string fname = string(P.getOptionValue("-f", default_file_name.c_str()));
   bool mmap = P.getOption("-m");
   bool is_symmetric = P.getOption("-s");
   bool compressed = P.getOption("-c");
-  size_t n_parts = P.getOptionLongValue("-nparts", 1);
+  bool snapshot = P.getOption("-snap");
+  bool binary = P.getOption("-b");
+  size_t mem_budget = P.getOptionDoubleValue("-mem_budget_gb", (double)default_mem_budget / (1 << 30)) * (1 << 30);
+
+  if (snapshot) {
+    return initialize_graph_from_snapshot(fname);
+  }
+  if (binary) {
+    return initialize_graph_from_binary(fname, P.getOptionLongValue("-range_edges", (1 << 26)));
+  }
 
-  return initialize_graph(fname, mmap, is_symmetric, compressed, n_parts);
+  return initialize_graph(fname, mmap, is_symmetric, compressed, mem_budget);
 }
 
 auto get_graph_edges(const char* fname, bool is_symmetric, bool mmap=false) {
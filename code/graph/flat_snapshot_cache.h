@@ -0,0 +1,150 @@
+#pragma once
+
+// Flat snapshots (the array fetch_all_vertices returns) of the live versions
+// of a versioned_graph, shared by all readers of a version. A version's
+// snapshot is built by the first reader to ask for it, while later readers
+// wait for it. Since versions are built by path copying, the snapshot of a
+// version is refreshed from the last one built instead of walking the whole
+// vertex tree: the array is reused (or copied, if readers still hold it) and
+// only the entries of vertices that are not shared by the two vertex trees
+// are rewritten, as in graph_diff.h. Entries are dropped when their version
+// is freed (see versioned_graph::free_version).
+#include "graph_diff.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+
+template <class Graph>
+struct flat_snapshot_cache {
+  using edge_struct = typename Graph::edge_struct;
+  using Node = typename Graph::Node;
+  using Tree = typename Graph::vertices::Tree;
+  using flat = pbbs::sequence<edge_struct>;
+  using flat_ptr = std::shared_ptr<const flat>;
+
+  std::mutex mtx;
+  std::condition_variable cv;
+  // By root; a null snapshot is being built.
+  std::map<Node*, std::shared_ptr<flat>> entries;
+  // The last snapshot built, from which the next one is refreshed.
+  Node* base_root = nullptr;
+  // Roots being diffed against, which must not be freed meanwhile.
+  std::multiset<Node*> bases_in_use;
+
+  size_t hits = 0, full_builds = 0, refreshes = 0, entries_rewritten = 0;
+
+  flat_ptr get(Graph& G) {
+    Node* root = G.get_root();
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+      auto it = entries.find(root);
+      if (it == entries.end()) break;
+      if (it->second) { hits++; return it->second; }
+      cv.wait(lk);
+    }
+    entries[root] = nullptr;
+    Node* from = nullptr;
+    std::shared_ptr<flat> from_vtxs;
+    bool owned = false;
+    auto base = entries.find(base_root);
+    if (base_root && base != entries.end() && base->second) {
+      from = base_root;
+      bases_in_use.insert(from);
+      from_vtxs = base->second;
+      // If only the cache held the base's array, take it over; readers of
+      // the base's version that ask again get a new one.
+      if (from_vtxs.use_count() == 2) {
+        entries.erase(base);
+        owned = true;
+      }
+    }
+    lk.unlock();
+
+    std::shared_ptr<flat> vtxs;
+    size_t rewritten = 0;
+    if (from) {
+      vtxs = refresh(G, from, std::move(from_vtxs), owned, rewritten);
+    } else {
+      vtxs = std::make_shared<flat>(G.fetch_all_vertices());
+    }
+
+    lk.lock();
+    if (from) {
+      bases_in_use.erase(bases_in_use.find(from));
+      refreshes++;
+      entries_rewritten += rewritten;
+    } else {
+      full_builds++;
+    }
+    entries[root] = vtxs;
+    base_root = root;
+    cv.notify_all();
+    return vtxs;
+  }
+
+  // Drops the snapshot of the version rooted at root, which is about to be
+  // freed, waiting until no snapshot is being refreshed from it.
+  void erase(Node* root) {
+    std::unique_lock<std::mutex> lk(mtx);
+    cv.wait(lk, [&] { return bases_in_use.count(root) == 0; });
+    entries.erase(root);
+    if (base_root == root) {
+      // Any other cached snapshot is a better base than none.
+      base_root = nullptr;
+      for (auto& e : entries) {
+        if (e.first && e.second) { base_root = e.first; break; }
+      }
+    }
+  }
+
+  void print_stats() {
+    std::lock_guard<std::mutex> lk(mtx);
+    std::cout << "flat snapshots: " << entries.size() << " cached, " << hits << " hits, "
+              << full_builds << " full builds, " << refreshes << " refreshes rewriting "
+              << entries_rewritten << " entries" << std::endl;
+  }
+
+private:
+  static bool same_edges(const edge_struct& a, const edge_struct& b) {
+    const auto& ao = Graph::out_edges(a); const auto& bo = Graph::out_edges(b);
+    const auto& ai = Graph::in_edges(a); const auto& bi = Graph::in_edges(b);
+    return ao.plus == bo.plus && ao.root == bo.root && ai.plus == bi.plus && ai.root == bi.root;
+  }
+
+  std::shared_ptr<flat> refresh(Graph& G, Node* from, std::shared_ptr<flat> from_vtxs,
+                                bool owned, size_t& rewritten) {
+    size_t n = G.num_vertices();
+    std::shared_ptr<flat> vtxs;
+    if (owned && from_vtxs->size() == n) {
+      vtxs = std::move(from_vtxs);
+    } else {
+      const flat& old = *from_vtxs;
+      vtxs = std::make_shared<flat>(n, [&] (size_t i) {
+        return (i < old.size()) ? old[i] : edge_struct();
+      });
+    }
+    flat& V = *vtxs;
+    Node* root = G.get_root();
+    using entry_t = typename std::remove_reference<decltype(Tree::get_entry(root))>::type;
+    auto same = [&] (const entry_t& x, const entry_t& y) { return same_edges(x.second, y.second); };
+    std::atomic<size_t> count(0);
+    // Vertices added or changed, then vertices deleted.
+    diff_utils::unshared_entries<Tree>(root, from, same, [&] (const entry_t& x, const entry_t* y) {
+      V[x.first] = x.second;
+      count++;
+    });
+    diff_utils::unshared_entries<Tree>(from, root, same, [&] (const entry_t& x, const entry_t* y) {
+      if (!y && x.first < n) {
+        V[x.first] = edge_struct();
+        count++;
+      }
+    });
+    rewritten = count;
+    return vtxs;
+  }
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+// Structural diff between two versions of a graph.
+//
+// Versions are built by path copying, so a subtree that is unchanged between
+// two versions is the same node in both. A node of one tree appears in the
+// other iff searching the other tree for its key ends at that same node, which
+// lets the diff prune shared subtrees with one search per unshared node. The
+// vertex trees are walked this way to find the vertices whose edges differ,
+// and the C-trees of those vertices to find the chunks that differ, so the
+// cost is about O(k log^2 n) for k changed edges, rather than O(m) for
+// comparing all edges.
+#include "../common/types.h"
+#include "../pbbslib/seq.h"
+#include "tree_plus/tree_plus.h"
+
+#include <vector>
+
+struct graph_diff {
+  using edge = tuple<uintV, uintV>;
+  pbbs::sequence<edge> inserted; // in b but not in a, sorted
+  pbbs::sequence<edge> deleted;  // in a but not in b, sorted
+  pbbs::sequence<uintV> touched; // vertices whose out-edges differ, sorted
+};
+
+namespace diff_utils {
+
+  // The node of the tree rooted at t holding key k, or nullptr.
+  template <class Tree, class node, class K>
+  node* find_node(node* t, const K& k) {
+    while (t) {
+      const auto& tk = Tree::get_entry(t).first;
+      if (k < tk) t = t->lc;
+      else if (tk < k) t = t->rc;
+      else return t;
+    }
+    return nullptr;
+  }
+
+  // Calls f(entry, other) on every entry of the tree rooted at a that is not
+  // an equal entry (by eq) of the tree rooted at b, where other is the entry
+  // of b with the same key, or nullptr. Subtrees of a that are also subtrees
+  // of b are skipped. Entries are visited in key order if run_seq.
+  template <class Tree, class node, class Eq, class F>
+  void unshared_entries(node* a, node* b, const Eq& eq, const F& f, bool run_seq=false) {
+    if (!a) return;
+    const auto& entry = Tree::get_entry(a);
+    node* other = find_node<Tree>(b, entry.first);
+    if (other == a) return; // shared subtree
+    bool parallel = !run_seq && Tree::size(a) >= utils::node_limit;
+    if (parallel) {
+      utils::fork_no_result(true,
+        [&] () { unshared_entries<Tree>(a->lc, b, eq, f, run_seq); },
+        [&] () { unshared_entries<Tree>(a->rc, b, eq, f, run_seq); });
+    } else {
+      unshared_entries<Tree>(a->lc, b, eq, f, run_seq);
+    }
+    if (!other) {
+      f(entry, (decltype(&entry))nullptr);
+    } else if (!eq(entry, Tree::get_entry(other))) {
+      f(entry, &Tree::get_entry(other));
+    }
+    if (!parallel) {
+      unshared_entries<Tree>(a->rc, b, eq, f, run_seq);
+    }
+  }
+
+  // Appends the edges of the chunks of a that are not chunks of b, in sorted
+  // order. Edges in chunks shared by a and b are in both edge lists.
+  inline void unshared_edges(uintV src, const tree_plus::treeplus& a,
+                             const tree_plus::treeplus& b, std::vector<uintV>& out) {
+    using Tree = tree_plus::treeplus::Tree;
+    using Entry = tree_plus::treeplus::Entry;
+    auto push = [&] (uintV v) { out.push_back(v); };
+    if (a.plus && a.plus != b.plus) {
+      lists::iter_elms(a.plus, src, push);
+    }
+    auto same_chunk = [&] (const Entry& x, const Entry& y) { return x.second == y.second; };
+    auto chunk_f = [&] (const Entry& entry, const Entry* other) {
+      out.push_back(entry.first);
+      lists::iter_elms(entry.second, src, push);
+    };
+    unshared_entries<Tree>(a.root, b.root, same_chunk, chunk_f, true);
+  }
+
+  // Sets ins (del) to the neighbors of src in b (a) that are not in a (b).
+  inline void diff_edges(uintV src, const tree_plus::treeplus& a, const tree_plus::treeplus& b,
+                         std::vector<uintV>& ins, std::vector<uintV>& del) {
+    std::vector<uintV> from_a, from_b;
+    unshared_edges(src, a, b, from_a);
+    unshared_edges(src, b, a, from_b);
+    size_t i = 0, j = 0;
+    while (i < from_a.size() || j < from_b.size()) {
+      if (j == from_b.size() || (i < from_a.size() && from_a[i] < from_b[j])) {
+        del.push_back(from_a[i++]);
+      } else if (i == from_a.size() || from_b[j] < from_a[i]) {
+        ins.push_back(from_b[j++]);
+      } else {
+        i++; j++;
+      }
+    }
+  }
+
+  // Diffs the out-edges of two vertex trees. out_edges maps a vertex-tree
+  // value to the treeplus holding its out-edges.
+  template <class Tree, class node, class O>
+  graph_diff diff(node* a, node* b, const O& out_edges) {
+    using entry_t = typename std::remove_reference<decltype(Tree::get_entry(a))>::type;
+    using vtx = tuple<uintV, const tree_plus::treeplus*, const tree_plus::treeplus*>;
+
+    // 1. Find the vertices whose out-edges differ. Each worker collects its
+    // own, since the walk is parallel.
+    auto per_worker = std::vector<std::vector<vtx>>(num_workers());
+    auto same_out = [&] (const entry_t& x, const entry_t& y) {
+      const auto& ox = out_edges(x.second); const auto& oy = out_edges(y.second);
+      return ox.plus == oy.plus && ox.root == oy.root;
+    };
+    unshared_entries<Tree>(a, b, same_out, [&] (const entry_t& x, const entry_t* y) {
+      auto oy = y ? &out_edges(y->second) : nullptr;
+      per_worker[worker_id()].push_back(make_tuple(x.first, &out_edges(x.second), oy));
+    });
+    unshared_entries<Tree>(b, a, same_out, [&] (const entry_t& y, const entry_t* x) {
+      if (!x) { // vertices in both versions were found above
+        per_worker[worker_id()].push_back(make_tuple(y.first, nullptr, &out_edges(y.second)));
+      }
+    });
+    std::vector<vtx> touched;
+    for (auto& w : per_worker) touched.insert(touched.end(), w.begin(), w.end());
+    std::sort(touched.begin(), touched.end(), [&] (const vtx& l, const vtx& r) {
+      return get<0>(l) < get<0>(r);
+    });
+
+    // 2. Diff the edges of each touched vertex.
+    size_t k = touched.size();
+    auto ins = std::vector<std::vector<uintV>>(k);
+    auto del = std::vector<std::vector<uintV>>(k);
+    tree_plus::treeplus empty;
+    parallel_for(0, k, [&] (size_t i) {
+      uintV u = get<0>(touched[i]);
+      const auto& ea = get<1>(touched[i]) ? *get<1>(touched[i]) : empty;
+      const auto& eb = get<2>(touched[i]) ? *get<2>(touched[i]) : empty;
+      diff_edges(u, ea, eb, ins[i], del[i]);
+    }, 1);
+
+    // 3. Flatten. A vertex whose list was rebuilt without changing its edges
+    // is not reported as touched.
+    auto changed = pbbs::sequence<bool>(k, [&] (size_t i) {
+      return ins[i].size() > 0 || del[i].size() > 0;
+    });
+    auto ids = pbbs::pack_index<size_t>(changed);
+    auto flatten = [&] (std::vector<std::vector<uintV>>& nghs) {
+      auto offs = pbbs::sequence<size_t>(k+1, [&] (size_t i) { return (i < k) ? nghs[i].size() : 0; });
+      size_t total = pbbs::scan_inplace(offs.slice(), pbbs::addm<size_t>());
+      auto edges = pbbs::sequence<graph_diff::edge>(total);
+      parallel_for(0, k, [&] (size_t i) {
+        uintV u = get<0>(touched[i]);
+        for (size_t j=0; j<nghs[i].size(); j++) {
+          edges[offs[i] + j] = make_tuple(u, nghs[i][j]);
+        }
+      }, 1);
+      return edges;
+    };
+    graph_diff res;
+    res.inserted = flatten(ins);
+    res.deleted = flatten(del);
+    res.touched = pbbs::sequence<uintV>(ids.size(), [&] (size_t i) { return get<0>(touched[ids[i]]); });
+    return res;
+  }
+
+} // namespace diff_utils
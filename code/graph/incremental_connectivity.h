@@ -0,0 +1,312 @@
+#pragma once
+
+// Connected components of a versioned_graph, maintained across update batches
+// instead of recomputed, and queryable at any live version.
+//
+// This is a union-find forest without path compression whose parent pointers
+// are timestamped: every vertex has a list of (from, parent) entries, newest
+// first, and at version t its parent is that of its newest entry with
+// from <= t (itself if there is none). Entries of version t are written before
+// t is published, so readers of older versions never follow them. Roots are
+// linked by random priority, the parent having the higher one, which keeps
+// trees O(log n) deep in expectation (Goel et al., "Disjoint set union with
+// randomized linking", 2014).
+//
+// Inserted edges link the trees of their endpoints in parallel with CAS.
+// Deleted edges can only split the components containing their endpoints, and
+// every piece of a split component contains an endpoint, so the new graph is
+// searched from the endpoints, labeling vertices by the endpoint that reached
+// them and merging labels where searches meet. The search stops as soon as the
+// endpoints of every affected component have met (nothing was split), and
+// otherwise covers exactly the affected components, whose vertices then get
+// entries pointing at the root of their piece.
+//
+// Entries that no live version can read are freed when the writer next touches
+// their vertex. The graph must be symmetric.
+
+#include "../pbbslib/utilities.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <tuple>
+
+template <class snapshot_graph>
+struct incremental_connectivity {
+  struct entry {
+    uint64_t from;
+    uintV parent;
+    entry* older;
+  };
+
+  size_t n;
+  entry** head;
+  uintV* label; // scratch for deletions; UINT_V_MAX between batches
+
+  size_t links = 0, deletion_batches = 0, early_exits = 0;
+  size_t searched = 0, relabeled = 0, freed = 0;
+
+  // Builds the components of G, the version at timestamp t. Earlier versions
+  // cannot be queried.
+  incremental_connectivity(snapshot_graph& G, uint64_t t) : n(G.num_vertices()) {
+    head = pbbs::new_array_no_init<entry*>(n);
+    label = pbbs::new_array_no_init<uintV>(n);
+    parallel_for(0, n, [&] (size_t i) { head[i] = nullptr; label[i] = UINT_V_MAX; });
+    auto flat = G.flat_vertices();
+    const auto& vtxs = *flat;
+    std::atomic<size_t> linked(0);
+    parallel_for(0, n, [&] (size_t i) {
+      auto map_f = [&] (const uintV& ngh, size_t ind) {
+        if (i < ngh && link(i, ngh, t, 0)) linked++;
+      };
+      snapshot_graph::map_out_edges(i, vtxs[i], vtxs[i].degree(), map_f, 0);
+    }, 256);
+    links += linked;
+  }
+
+  ~incremental_connectivity() {
+    parallel_for(0, n, [&] (size_t i) { free_chain(head[i]); });
+    pbbs::free_array(head);
+    pbbs::free_array(label);
+  }
+
+  // ======================= Readers =======================
+
+  // The root of v's tree at version t, which identifies its component there.
+  uintV find(uintV v, uint64_t t) const {
+    while (true) {
+      entry* e = __atomic_load_n(&head[v], __ATOMIC_ACQUIRE);
+      while (e && e->from > t) e = e->older;
+      if (!e || e->parent == v) return v;
+      v = e->parent;
+    }
+  }
+
+  bool same_component(uintV u, uintV v, uint64_t t) const {
+    return find(u, t) == find(v, t);
+  }
+
+  // ======================= Writer =======================
+  // t is the timestamp of the version being built, which must not be visible
+  // yet, and every live version must be at least floor.
+
+  void insert_edges(size_t m, tuple<uintV, uintV>* edges, uint64_t t, uint64_t floor) {
+    check_range(m, [&] (size_t i) { return edges[i]; });
+    std::atomic<size_t> linked(0);
+    parallel_for(0, m, [&] (size_t i) {
+      if (link(get<0>(edges[i]), get<1>(edges[i]), t, floor)) linked++;
+    });
+    links += linked;
+  }
+
+  void delete_edges(snapshot_graph& G_next, size_t m, tuple<uintV, uintV>* edges, uint64_t t, uint64_t floor) {
+    check_range(m, [&] (size_t i) { return edges[i]; });
+    auto ends = pbbs::sequence<uintV>(2*m, [&] (size_t i) {
+      return (i & 1) ? get<1>(edges[i/2]) : get<0>(edges[i/2]);
+    });
+    split_components(G_next, ends, t, floor);
+  }
+
+  // updates must already be resolved (one update per edge, see
+  // resolve_updates).
+  void apply_updates(snapshot_graph& G_next, size_t m, edge_update* updates, uint64_t t, uint64_t floor) {
+    check_range(m, [&] (size_t i) { return make_tuple(get<0>(updates[i]), get<1>(updates[i])); });
+    auto dels = pbbs::filter(pbbs::make_range(updates, updates + m), [] (const edge_update& u) { return !get<2>(u); });
+    if (dels.size() > 0) {
+      auto ends = pbbs::sequence<uintV>(2*dels.size(), [&] (size_t i) {
+        return (i & 1) ? get<1>(dels[i/2]) : get<0>(dels[i/2]);
+      });
+      split_components(G_next, ends, t, floor);
+    }
+    std::atomic<size_t> linked(0);
+    parallel_for(0, m, [&] (size_t i) {
+      if (get<2>(updates[i]) && link(get<0>(updates[i]), get<1>(updates[i]), t, floor)) linked++;
+    });
+    links += linked;
+  }
+
+  void print_stats() {
+    std::cout << "connectivity: " << links << " links, " << deletion_batches << " deletion batches ("
+              << early_exits << " without splits), " << searched << " vertices searched, "
+              << relabeled << " relabeled, " << freed << " entries freed" << std::endl;
+  }
+
+private:
+  static uint64_t priority(uintV v) {
+    return (static_cast<uint64_t>(pbbs::hash32(v)) << 32) | v;
+  }
+
+  template <class E>
+  void check_range(size_t m, E edge) {
+    auto bad = pbbs::delayed_seq<size_t>(m, [&] (size_t i) {
+      auto e = edge(i);
+      return (size_t)(get<0>(e) >= n || get<1>(e) >= n);
+    });
+    if (pbbs::reduce(bad, pbbs::addm<size_t>()) > 0) {
+      std::cout << "incremental_connectivity: vertex ids must be less than " << n << std::endl;
+      exit(0);
+    }
+  }
+
+  // The root of v's tree in the version being built.
+  uintV find_latest(uintV v) const {
+    while (true) {
+      entry* e = __atomic_load_n(&head[v], __ATOMIC_ACQUIRE);
+      if (!e || e->parent == v) return v;
+      v = e->parent;
+    }
+  }
+
+  static void free_chain(entry* e) {
+    while (e) { entry* older = e->older; delete e; e = older; }
+  }
+
+  // Frees the entries of e's list that no version at or after floor reads.
+  // Only the writer of e's vertex may call this.
+  void trim(entry* e, uint64_t floor) {
+    while (e && e->from > floor) e = e->older;
+    if (e && e->older) {
+      entry* rest = e->older;
+      e->older = nullptr;
+      size_t k = 0;
+      for (entry* x = rest; x; x = x->older) k++;
+      free_chain(rest);
+      pbbs::fetch_and_add(&freed, k);
+    }
+  }
+
+  // Links the trees of u and v. Returns false if they were already one tree.
+  bool link(uintV u, uintV v, uint64_t t, uint64_t floor) {
+    while (true) {
+      uintV ru = find_latest(u), rv = find_latest(v);
+      if (ru == rv) return false;
+      if (priority(ru) > priority(rv)) std::swap(ru, rv);
+      entry* h = __atomic_load_n(&head[ru], __ATOMIC_ACQUIRE);
+      if (h && h->parent != ru) continue; // linked meanwhile
+      entry* e = new entry{t, rv, h};
+      if (pbbs::atomic_compare_and_swap(&head[ru], h, e)) {
+        trim(e, floor);
+        return true;
+      }
+      delete e;
+    }
+  }
+
+  // Points v at root from version t on, unless it already is.
+  void set_parent(uintV v, uintV root, uint64_t t, uint64_t floor) {
+    entry* h = head[v];
+    if (h ? h->parent == root : v == root) return;
+    entry* e = new entry{t, root, h};
+    __atomic_store_n(&head[v], e, __ATOMIC_RELEASE);
+    trim(e, floor);
+  }
+
+  // Recomputes the components that contain the vertices in ends, as they are
+  // in G_next, if any of them was split.
+  void split_components(snapshot_graph& G_next, pbbs::sequence<uintV>& ends, uint64_t t, uint64_t floor) {
+    deletion_batches++;
+    pbbs::sample_sort_inplace(ends.slice(), std::less<uintV>());
+    auto first = pbbs::delayed_seq<bool>(ends.size(), [&] (size_t i) {
+      return i == 0 || ends[i] != ends[i-1];
+    });
+    auto srcs = pbbs::pack(ends, first);
+    size_t k = srcs.size();
+
+    // Searches that meet are merged, in a union-find over the sources.
+    auto src_parent = pbbs::sequence<uintV>(k, [&] (size_t i) { return (uintV)i; });
+    auto find_src = [&] (uintV i) {
+      while (src_parent[i] != i) i = src_parent[i];
+      return i;
+    };
+    auto union_src = [&] (uintV a, uintV b) {
+      while (true) {
+        a = find_src(a); b = find_src(b);
+        if (a == b) return;
+        if (a < b) std::swap(a, b);
+        if (pbbs::atomic_compare_and_swap(&src_parent[a], a, b)) return;
+      }
+    };
+
+    // Sources grouped by their component before the batch.
+    auto by_comp = pbbs::sequence<pair<uintV, uintV>>(k, [&] (size_t i) {
+      return make_pair(find_latest(srcs[i]), (uintV)i);
+    });
+    pbbs::sample_sort_inplace(by_comp.slice(), [] (const pair<uintV, uintV>& a, const pair<uintV, uintV>& b) {
+      return a.first < b.first;
+    });
+    auto all_met = [&] () {
+      auto apart = pbbs::delayed_seq<size_t>(k, [&] (size_t i) {
+        return (size_t)(i > 0 && by_comp[i].first == by_comp[i-1].first &&
+                        find_src(by_comp[i].second) != find_src(by_comp[i-1].second));
+      });
+      return pbbs::reduce(apart, pbbs::addm<size_t>()) == 0;
+    };
+
+    parallel_for(0, k, [&] (size_t i) { label[srcs[i]] = i; });
+    std::vector<pbbs::sequence<uintV>> visited;
+    auto frontier = std::move(srcs);
+    bool split = true;
+    while (frontier.size() > 0) {
+      if (all_met()) { split = false; break; }
+      size_t fs = frontier.size();
+      auto nghs = pbbs::sequence<typename snapshot_graph::edge_struct>(fs);
+      auto offsets = pbbs::sequence<size_t>(fs + 1);
+      parallel_for(0, fs, [&] (size_t i) {
+        auto mv = G_next.find_vertex(frontier[i]);
+        nghs[i] = mv.valid ? mv.value : typename snapshot_graph::edge_struct();
+        offsets[i] = nghs[i].degree();
+      });
+      offsets[fs] = 0;
+      size_t total = pbbs::scan_inplace(offsets.slice(), pbbs::addm<size_t>());
+      auto next = pbbs::sequence<uintV>(total);
+      parallel_for(0, fs, [&] (size_t i) {
+        uintV x = frontier[i];
+        size_t off = offsets[i];
+        auto map_f = [&] (const uintV& ngh, size_t ind) {
+          if (label[ngh] == UINT_V_MAX && pbbs::atomic_compare_and_swap(&label[ngh], UINT_V_MAX, label[x])) {
+            next[off + ind] = ngh;
+          } else {
+            union_src(label[x], label[ngh]);
+            next[off + ind] = UINT_V_MAX;
+          }
+        };
+        snapshot_graph::map_out_edges(x, nghs[i], offsets[i+1] - off, map_f, 0);
+      }, 1);
+      visited.push_back(std::move(frontier));
+      frontier = pbbs::filter(next, [] (uintV v) { return v != UINT_V_MAX; });
+    }
+    if (frontier.size() > 0) visited.push_back(std::move(frontier));
+
+    // Each piece is rooted at its vertex of highest priority.
+    size_t num_visited = 0;
+    if (split) {
+      auto best = pbbs::sequence<uint64_t>(k, (uint64_t)0);
+      auto less = [] (uint64_t a, uint64_t b) { return a < b; };
+      for (auto& level : visited) {
+        parallel_for(0, level.size(), [&] (size_t i) {
+          uintV v = level[i];
+          pbbs::write_max(&best[find_src(label[v])], priority(v), less);
+        });
+      }
+      std::atomic<size_t> changed(0);
+      for (auto& level : visited) {
+        parallel_for(0, level.size(), [&] (size_t i) {
+          uintV v = level[i];
+          uintV root = best[find_src(label[v])] & std::numeric_limits<uint32_t>::max();
+          entry* h = head[v];
+          set_parent(v, root, t, floor);
+          if (head[v] != h) changed++;
+        });
+      }
+      relabeled += changed;
+    } else {
+      early_exits++;
+    }
+    for (auto& level : visited) {
+      num_visited += level.size();
+      parallel_for(0, level.size(), [&] (size_t i) { label[level[i]] = UINT_V_MAX; });
+    }
+    searched += num_visited;
+  }
+};
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "vertex_subset.h"
+#include "graph_diff.h"
+#include "flat_snapshot_cache.h"
 #include "../pbbslib/seq.h"
 
 typedef uint32_t flags;
@@ -25,14 +27,37 @@ struct traversable_graph : private graph {
   using Node = typename G::Node;
   using Node_GC = typename G::Node_GC; // same as Vertex_GC
 
-  // Underlying graph implementation must define edge_struct
+  // Underlying graph implementation must define edge_struct, and
+  // out_edges/in_edges that return the edges of a vertex in either direction
+  // (the dense edge_map pulls over in-edges)
   using edge_struct = typename G::edge_struct;
   using vtx = pair<uintV, edge_struct>;
 
+  // Set on the versions handed out by a versioned_graph, whose readers share
+  // flat snapshots through it (see flat_vertices).
+  flat_snapshot_cache<traversable_graph>* flat_cache = nullptr;
+
   // for coercing the underlying graph to an traversable_graph
   traversable_graph(graph&& m) { if (this != &m) {this->V.root = m.V.root; m.V.root = nullptr;} }
   traversable_graph() {}
 
+  // The edges of vertices of higher degree are mapped over in chunks of this
+  // many edges, each a separate task, so that a hub does not keep one worker
+  // busy while the others idle.
+  static constexpr size_t hub_chunk = 4096;
+
+  // EL.map_elms(v, f), where EL has deg edges.
+  template <class EL_t, class F>
+  static void map_out_edges(uintV v, const EL_t& EL, size_t deg, F& f, const flags fl) {
+    if (deg <= hub_chunk || (fl & run_sequential)) {
+      EL.map_elms(v, f);
+    } else {
+      parallel_for(0, (deg + hub_chunk - 1) / hub_chunk, [&] (size_t j) {
+        EL.map_elms_range(v, j*hub_chunk, (j+1)*hub_chunk, f);
+      }, 1);
+    }
+  }
+
   template <class F>
   auto edge_map_dense(vertex_subset& vs, F f, const flags fl=0) {
 //    cout << "Running dense" << endl;
@@ -41,34 +66,39 @@ struct traversable_graph : private graph {
     auto prev = vs.d;
     size_t granularity = utils::node_limit; // (fl & fine_parallel) ? 1 : utils::node_limit;
     if (should_output(fl)) {
-      auto next = pbbs::sequence<bool>(n, false);
+      // Vertices in the same word may be visited by different tasks.
+      size_t words = dense_buffers::num_words(n);
+      auto next = dense_buffers::alloc(words);
+      parallel_for(0, words, [&] (size_t w) { next[w] = 0; });
       auto map_f = [&] (const vertex_entry& entry, size_t ind) {
         const uintV& v = entry.first;
         const auto& el = entry.second;
+        bool added = false;
         auto search_f = [&] (uintV ngh) {
-          if (prev[ngh] && f.update(ngh, v)) {
-            next[v] = true;
+          if (dense_buffers::is_set(prev, ngh) && f.update(ngh, v)) {
+            added = true;
           }
           return !f.cond(v);
         };
         if (f.cond(v)) {
-          el.iter_elms_cond(v, search_f);
+          G::in_edges(el).iter_elms_cond(v, search_f);
         }
+        if (added) dense_buffers::set_atomic(next, v);
       };
       G::map_vertices(map_f, fl & run_sequential, granularity);
-      return vertex_subset(vs.n, next.to_array());
+      return vertex_subset(vs.n, next);
     } else {
       auto map_f = [&] (const vertex_entry& entry, size_t ind) {
         const uintV& v = entry.first;
         const auto& el = entry.second;
         auto search_f = [&] (uintV ngh) {
-          if (prev[ngh]) {
+          if (dense_buffers::is_set(prev, ngh)) {
             f.update(ngh, v);
           }
           return !f.cond(v);
         };
         if (f.cond(v)) {
-          el.iter_elms_cond(v, search_f);
+          G::in_edges(el).iter_elms_cond(v, search_f);
         }
       };
       G::map_vertices(map_f, fl & run_sequential, granularity);
@@ -84,27 +114,34 @@ struct traversable_graph : private graph {
     auto prev = vs.d;
     size_t parallel_granularity = (fl & fine_parallel) ? 1 : 1024;
     if (should_output(fl)) {
-      auto next = pbbs::new_array_no_init<bool>(n);
-      parallel_for(0, n, [&] (size_t i) { next[i] = 0; }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 0);
-      parallel_for(0, n, [&] (size_t i) {
-        auto search_f = [&] (uintV ngh) {
-          if (prev[ngh] && f.update(ngh, i)) {
-            next[i] = true;
-          }
-          return !f.cond(i);
-        };
-        if (f.cond(i)) vtxs[i].iter_elms_cond(i, search_f);
-      }, (fl & run_sequential) ? std::numeric_limits<long>::max() : parallel_granularity); // TODO: granularity
+      // Each task builds whole words of the output, so no atomics are needed
+      // and the output need not be cleared first.
+      size_t words = dense_buffers::num_words(n);
+      auto next = dense_buffers::alloc(words);
+      parallel_for(0, words, [&] (size_t w) {
+        uint64_t bits = 0;
+        size_t end = std::min(n, (w+1)*64);
+        for (size_t i = w*64; i < end; i++) {
+          auto search_f = [&] (uintV ngh) {
+            if (dense_buffers::is_set(prev, ngh) && f.update(ngh, i)) {
+              bits |= dense_buffers::bit(i);
+            }
+            return !f.cond(i);
+          };
+          if (f.cond(i)) G::in_edges(vtxs[i]).iter_elms_cond(i, search_f);
+        }
+        next[w] = bits;
+      }, (fl & run_sequential) ? std::numeric_limits<long>::max() : (parallel_granularity + 63) / 64); // TODO: granularity
       return vertex_subset(vs.n, next);
     } else {
       parallel_for(0, n, [&] (size_t i) {
         auto search_f = [&] (uintV ngh) {
-          if (prev[ngh]) {
+          if (dense_buffers::is_set(prev, ngh)) {
             f.update(ngh, i);
           }
           return !f.cond(i);
         };
-        if (f.cond(i)) vtxs[i].iter_elms_cond(i, search_f);
+        if (f.cond(i)) G::in_edges(vtxs[i]).iter_elms_cond(i, search_f);
       }, (fl & run_sequential) ? std::numeric_limits<long>::max() : parallel_granularity); // TODO: granularity
       return vertex_subset(vs.n);
     }
@@ -115,30 +152,31 @@ struct traversable_graph : private graph {
     // cout << "Running dense forward" << endl;
     vs.to_dense();
     size_t n = vs.n;
+    size_t words = dense_buffers::num_words(n);
     if (should_output(fl)) {
-      auto next = pbbs::new_array_no_init<bool>(n);
-      parallel_for(0, n, [&] (size_t i) { next[i] = 0; }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 0);
-      parallel_for(0, n, [&] (size_t i) {
-        if (vs.is_in(i)) {
-          auto map_f = [&] (uintV src, uintV ngh) {
-            if (f.cond(ngh) && f.updateAtomic(src, ngh)){
-              next[ngh] = true;
+      auto next = dense_buffers::alloc(words);
+      parallel_for(0, words, [&] (size_t w) { next[w] = 0; }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 0);
+      parallel_for(0, words, [&] (size_t w) {
+        dense_buffers::iter_word(vs.d[w], w, [&] (size_t i) {
+          auto map_f = [&] (const uintV& ngh, size_t ind) {
+            if (f.cond(ngh) && f.updateAtomic(i, ngh)){
+              dense_buffers::set_atomic(next, ngh);
             }
           };
-          vtxs[i].map_nghs(i, map_f);
-        }
+          map_out_edges(i, vtxs[i], vtxs[i].degree(), map_f, fl);
+        });
       }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 1); // TODO: granularity
       return vertex_subset(vs.n, next);
     } else {
-      parallel_for(0, n, [&] (size_t i) {
-        if (vs.is_in(i)) {
-          auto map_f = [&] (uintV src, uintV ngh) {
+      parallel_for(0, words, [&] (size_t w) {
+        dense_buffers::iter_word(vs.d[w], w, [&] (size_t i) {
+          auto map_f = [&] (const uintV& ngh, size_t ind) {
             if (f.cond(ngh)) {
-              f.updateAtomic(src, ngh);
+              f.updateAtomic(i, ngh);
             }
           };
-          vtxs[i].map_nghs(i, map_f);
-        }
+          map_out_edges(i, vtxs[i], vtxs[i].degree(), map_f, fl);
+        });
       }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 1); // TODO: granularity
       return vertex_subset(vs.n);
     }
@@ -177,7 +215,7 @@ struct traversable_graph : private graph {
               nghs_u[off + ind] = UINT_V_MAX;
             }
           };
-          EL.map_elms(v, map_f);
+          map_out_edges(v, EL, deg, map_f, fl);
         }
       }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 1); // TODO: granularity
 
@@ -196,7 +234,7 @@ struct traversable_graph : private graph {
         auto map_f = [&] (const uintV& ngh, size_t ind) {
           if (f.cond(ngh)) f.updateAtomic(v, ngh);
         };
-        EL.map_elms(v, map_f);
+        map_out_edges(v, EL, EL.degree(), map_f, fl);
       }
     }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 1); // TODO: granularity
     return vertex_subset(vs.n);
@@ -223,7 +261,7 @@ struct traversable_graph : private graph {
               nghs_u[off + ind] = UINT_V_MAX;
             }
           };
-          EL.map_elms(v, map_f);
+          map_out_edges(v, EL, deg, map_f, fl);
         }
       }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 1); // TODO: granularity
 
@@ -239,7 +277,7 @@ struct traversable_graph : private graph {
       auto map_f = [&] (const uintV& ngh, size_t ind) {
         if (f.cond(ngh)) f.updateAtomic(v, ngh);
       };
-      EL.map_elms(v, map_f);
+      map_out_edges(v, EL, EL.degree(), map_f, fl);
     }, (fl & run_sequential) ? std::numeric_limits<long>::max() : 1); // TODO: granularity
     return vertex_subset(vs.n);
   }
@@ -352,6 +390,14 @@ struct traversable_graph : private graph {
     return vtxs;
   }
 
+  // The same array as fetch_all_vertices, but shared with the other readers
+  // of this version if it came from a versioned_graph, and refreshed from the
+  // previous version's array rather than built from scratch.
+  std::shared_ptr<const pbbs::sequence<edge_struct>> flat_vertices() {
+    if (flat_cache) return flat_cache->get(*this);
+    return std::make_shared<const pbbs::sequence<edge_struct>>(fetch_all_vertices());
+  }
+
   traversable_graph insert_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn=std::numeric_limits<size_t>::max(), bool run_seq=false) const {
     return std::move(traversable_graph(G::insert_edges_batch(m, edges, sorted, remove_dups, nn, run_seq)));
   }
@@ -364,8 +410,36 @@ struct traversable_graph : private graph {
     return traversable_graph(G::delete_edges_batch(m, edges, sorted, remove_dups, nn, run_seq));
   }
 
+  traversable_graph apply_updates_batch(size_t m, edge_update* updates, bool sorted=false, bool run_seq=false) const {
+    return traversable_graph(G::apply_updates_batch(m, updates, sorted, run_seq));
+  }
+
+  static traversable_graph read_snapshot(const char* fname) {
+    return traversable_graph(G::read_snapshot(fname));
+  }
+
+  // The out-edges inserted and deleted from a to b, where b is a later (or
+  // earlier) version of a; see graph_diff.h.
+  static graph_diff diff(const traversable_graph& a, const traversable_graph& b) {
+    auto out = [&] (const edge_struct& e) -> const tree_plus::treeplus& { return G::out_edges(e); };
+    return diff_utils::diff<typename vertices::Tree>(a.get_root(), b.get_root(), out);
+  }
+
+  template <class R, class B, class F>
+  static traversable_graph build_by_ranges(size_t n, size_t m, R next_range, B build_vertex, F on_range) {
+    return traversable_graph(G::build_by_ranges(n, m, next_range, build_vertex, on_range));
+  }
+
+  template <class O, class F>
+  static traversable_graph build_streaming(size_t n, size_t m, const O* offsets, const uintV* edges,
+                                           size_t range_edges, F on_range) {
+    return traversable_graph(G::build_streaming(n, m, offsets, edges, range_edges, on_range));
+  }
+
 
 public:
+  using G::out_edges;
+  using G::in_edges;
   using G::num_vertices;
   using G::num_edges;
   using G::find_vertex;
@@ -375,7 +449,9 @@ public:
   using G::retrieve_edges;
   using G::check_edges;
   using G::size_in_bytes;
+  using G::unshared_bytes;
   using G::init;
+  using G::write_snapshot;
 
   using G::get_root;
   using G::clear_root;
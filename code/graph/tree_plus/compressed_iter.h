@@ -13,6 +13,14 @@ namespace compressed_lists {
     return static_cast<size_t>(0);
   }
 
+  // number of bytes used by the encoded node, including its header
+  size_t node_bytes(uchar* node) {
+    if (node) {
+      return *((uint16_t*)(node + sizeof(uint16_t)));
+    }
+    return static_cast<size_t>(0);
+  }
+
 }
 
 namespace compressed_iter {
@@ -20,6 +28,8 @@ namespace compressed_iter {
   using namespace compression;
   using uchar = unsigned char;
 
+  static constexpr const uint64_t encoding_id = 0;
+
   struct read_iter {
     uchar const* node;
     uchar const* start;
@@ -64,6 +74,16 @@ namespace compressed_iter {
     inline bool has_next() {
       return proc < deg;
     }
+
+    // Applies f(i, ngh) to the neighbors in order, stopping once f returns
+    // true. Returns true if f stopped the traversal.
+    template <class F>
+    inline bool decode_cond(const F& f) {
+      for (size_t i=0; i<deg; i++) {
+        if (f(i, next())) return true;
+      }
+      return false;
+    }
   };
 
   struct write_iter {
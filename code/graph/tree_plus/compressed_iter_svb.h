@@ -0,0 +1,251 @@
+#pragma once
+
+#include "../../common/compression.h"
+#include "compressed_nodes_2.h"
+
+#ifdef __SSSE3__
+#include <immintrin.h>
+#endif
+
+// Stream-vbyte variant of compressed_iter, selected by building with
+// -DSTREAMVBYTE. The node header is the same as in compressed_iter. The first
+// neighbor is byte-encoded relative to src as before; the remaining deg-1
+// differences are stored as 1--4 byte little-endian integers, with their
+// lengths in separate control bytes (2 bits per difference, 4 per byte):
+//
+// uint16_t deg
+// uint16_t size (bytes)
+// uint32_t refct
+// uint32_t last neighbor
+// first neighbor (byte-encoded)
+// uint8_t control[(deg-1+3)/4]
+// data bytes
+//
+// A control byte determines the layout of the next 4 differences, so they can
+// be decoded together with a single shuffle followed by a prefix-sum.
+namespace compressed_lists {
+
+  size_t node_size(uchar* node) {
+    if (node) {
+      return *((uint16_t*)node);
+    }
+    return static_cast<size_t>(0);
+  }
+
+  // number of bytes used by the encoded node, including its header
+  size_t node_bytes(uchar* node) {
+    if (node) {
+      return *((uint16_t*)(node + sizeof(uint16_t)));
+    }
+    return static_cast<size_t>(0);
+  }
+
+}
+
+namespace compressed_iter {
+
+  using namespace compression;
+  using uchar = unsigned char;
+
+  static constexpr const uint64_t encoding_id = 1;
+  static constexpr const size_t header_bytes = 2*sizeof(uint16_t) + 2*sizeof(uint32_t);
+
+  // For each control byte: the shuffle that spreads its 4 differences into
+  // 4 uint32s, and the number of data bytes they use.
+  struct svb_tables {
+    uint8_t shuffle[256][16];
+    uint8_t length[256];
+    constexpr svb_tables() : shuffle(), length() {
+      for (size_t c=0; c<256; c++) {
+        uint8_t off = 0;
+        for (size_t j=0; j<4; j++) {
+          size_t code = (c >> (2*j)) & 3;
+          for (size_t b=0; b<4; b++) {
+            shuffle[c][4*j + b] = (b <= code) ? (off + b) : 0x80;
+          }
+          off += code + 1;
+        }
+        length[c] = off;
+      }
+    }
+  };
+  static constexpr svb_tables tables = svb_tables();
+
+  static constexpr const uint32_t length_masks[4] = {0xff, 0xffff, 0xffffff, 0xffffffff};
+
+  static constexpr const size_t decode_block_size = 128;
+
+  struct read_iter {
+    uchar const* node;
+    uchar const* start;
+    uchar const* end;
+    uchar const* control;
+    uintV src;
+    uintV deg;
+    uintV ngh;
+    uintV proc;
+    bool is_valid;
+
+    read_iter(uchar const* node, uintV src) : node(node), src(src), deg(0), ngh(0), proc(0) {
+      is_valid = (node != nullptr);
+      if (is_valid) {
+        deg = *((uint16_t*)node);
+        assert(deg > 0);
+        start = node + header_bytes;
+        end = node + *((uint16_t*)(node + sizeof(uint16_t)));
+      }
+    }
+
+    bool valid() {
+      return is_valid;
+    }
+
+    inline uintV last_key() {
+      uint32_t* last_ngh_ptr = (uint32_t*)(node + 2*sizeof(uint16_t) + sizeof(uint32_t));
+      return *last_ngh_ptr;
+    }
+
+    inline uintV next() {
+      if (proc == 0) {
+        ngh = read_first_neighbor(start, src);
+        control = start;
+        start += (deg + 2) / 4; // data follows the control bytes
+      } else {
+        size_t k = proc - 1;
+        size_t code = (control[k >> 2] >> (2*(k & 3))) & 3;
+        uint32_t diff = 0;
+        if (start + sizeof(uint32_t) <= end) {
+          std::memcpy(&diff, start, sizeof(uint32_t));
+          diff &= length_masks[code];
+        } else {
+          std::memcpy(&diff, start, code + 1);
+        }
+        start += code + 1;
+        ngh += diff;
+      }
+      proc++;
+      return ngh;
+    }
+
+    // Decodes the next k neighbors into out.
+    inline void decode_block(uintV* out, size_t k) {
+      size_t i = 0;
+      while (i < k) {
+#ifdef __SSSE3__
+        if (proc > 0 && ((proc - 1) & 3) == 0 && i + 4 <= k && start + 16 <= end) {
+          uint8_t c = control[(proc - 1) >> 2];
+          __m128i v = _mm_loadu_si128((__m128i const*)start);
+          v = _mm_shuffle_epi8(v, _mm_loadu_si128((__m128i const*)tables.shuffle[c]));
+          v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+          v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+          v = _mm_add_epi32(v, _mm_set1_epi32(ngh));
+          _mm_storeu_si128((__m128i*)(out + i), v);
+          ngh = out[i + 3];
+          start += tables.length[c];
+          proc += 4; i += 4;
+          continue;
+        }
+#endif
+        out[i++] = next();
+      }
+    }
+
+    inline bool has_next() {
+      return proc < deg;
+    }
+
+    // Applies f(i, ngh) to the neighbors in order, stopping once f returns
+    // true. Returns true if f stopped the traversal. Neighbors are decoded a
+    // block at a time into a buffer on the stack. Since f may stop early, the
+    // first group is decoded one neighbor at a time, and blocks grow from there.
+    template <class F>
+    inline bool decode_cond(const F& f) {
+      size_t i = 0;
+      for (; i<std::min((size_t)deg, (size_t)5); i++) {
+        if (f(i, next())) return true;
+      }
+      uintV buf[decode_block_size];
+      size_t block_size = 16;
+      while (i < deg) {
+        size_t k = std::min(deg - i, block_size);
+        decode_block(buf, k);
+        for (size_t j=0; j<k; j++) {
+          if (f(i + j, buf[j])) return true;
+        }
+        i += k;
+        block_size = std::min(2*block_size, decode_block_size);
+      }
+      return false;
+    }
+  };
+
+  struct write_iter {
+    uchar* node_ptr;
+    size_t offset = 0; // end of the first neighbor
+    size_t proc = 0;
+    size_t node_size;
+    size_t control_start; // control and data bytes are staged here until finish()
+    size_t data_start;
+    size_t data_bytes = 0;
+
+    uintV src; uintV last_ngh;
+    uintV deg_ub;
+
+    write_iter(uintV src, size_t deg_ub) : src(src), deg_ub(deg_ub) {
+      proc = 0;
+      control_start = header_bytes + 5;
+      data_start = control_start + (deg_ub + 3) / 4;
+      std::tie(node_ptr, node_size) = compressed_lists::alloc_node(data_start + deg_ub*sizeof(uint32_t));
+      std::memset(node_ptr + control_start, 0, data_start - control_start);
+      offset = header_bytes;
+    }
+
+    void compress_next(const uintV& ngh) {
+      if (proc == 0) {
+        offset = compress_first_neighbor(node_ptr, offset, src, ngh);
+      } else {
+        uint32_t diff = ngh - last_ngh;
+        size_t code = (diff < (1 << 8)) ? 0 : (diff < (1 << 16)) ? 1 : (diff < (1 << 24)) ? 2 : 3;
+        size_t k = proc - 1;
+        node_ptr[control_start + (k >> 2)] |= (code << (2*(k & 3)));
+        std::memcpy(node_ptr + data_start + data_bytes, &diff, code + 1);
+        data_bytes += code + 1;
+      }
+      proc++;
+      last_ngh = ngh;
+    }
+
+    uchar* finish() {
+      uint16_t* deg = (uint16_t*)node_ptr;
+      uint16_t* total_size = (uint16_t*)(node_ptr + sizeof(uint16_t));
+      uint32_t* ref_ct = (uint32_t*)(node_ptr + 2*sizeof(uint16_t));
+      uint32_t* last_ngh_ptr = (uint32_t*)(node_ptr + 2*sizeof(uint16_t) + sizeof(uint32_t));
+
+      *deg = proc;
+      *total_size = node_size;
+      *ref_ct = 1;
+      *last_ngh_ptr = last_ngh;
+      if (proc == 0) {
+        compressed_lists::deallocate(node_ptr);
+        return nullptr;
+      }
+
+      // pack the control and data bytes right after the first neighbor
+      size_t control_bytes = (proc + 2) / 4;
+      std::memmove(node_ptr + offset, node_ptr + control_start, control_bytes);
+      std::memmove(node_ptr + offset + control_bytes, node_ptr + data_start, data_bytes);
+      size_t total = offset + control_bytes + data_bytes;
+
+      if (2*total <= node_size || (node_size > 16384 && total <= 16384)) {
+        uchar* old_arr = node_ptr;
+        std::tie(node_ptr, node_size) = compressed_lists::alloc_node(total);
+        std::memcpy(node_ptr, old_arr, total);
+        total_size = (uint16_t*)(node_ptr + sizeof(uint16_t));
+        compressed_lists::deallocate(old_arr);
+      }
+      *total_size = total;
+      return node_ptr;
+    }
+  };
+
+}; // namespace compressed_iter
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "../../common/compression.h"
+#include "compressed_lists.h"
+
+// Weighted variant of compressed_iter. A weighted node uses the same header as
+// an unweighted node, so it shares the compressed_lists allocators and ref-ct
+// helpers (copy_node, deallocate, node_size, node_bytes). The weights of the
+// node are stored as a packed array after the difference-encoded neighbors:
+//
+// uint16_t deg
+// uint16_t size (bytes, including weights)
+// uint32_t refct
+// uint32_t last neighbor
+// difference-encoded neighbors
+// W weights[deg]
+namespace compressed_weighted_iter {
+
+  using namespace compression;
+  using uchar = unsigned char;
+
+  static constexpr const size_t header_bytes = 2*sizeof(uint16_t) + 2*sizeof(uint32_t);
+
+  template <class W>
+  struct read_iter {
+    uchar const* node;
+    uchar const* start;
+    uchar const* weights;
+    uintV src;
+    uintV deg;
+    uintV ngh;
+    uintV proc;
+    bool is_valid;
+
+    read_iter(uchar const* node, uintV src) : node(node), src(src), deg(0), ngh(0), proc(0) {
+      is_valid = (node != nullptr);
+      if (is_valid) {
+        deg = *((uint16_t*)node);
+        assert(deg > 0);
+        size_t total_bytes = *((uint16_t*)(node + sizeof(uint16_t)));
+        start = node + header_bytes;
+        weights = node + total_bytes - deg*sizeof(W);
+      }
+    }
+
+    bool valid() {
+      return is_valid;
+    }
+
+    inline uintV last_key() {
+      uint32_t* last_ngh_ptr = (uint32_t*)(node + 2*sizeof(uint16_t) + sizeof(uint32_t));
+      return *last_ngh_ptr;
+    }
+
+    inline uintV next() {
+      if (proc == 0) {
+        ngh = read_first_neighbor(start, src);
+      } else {
+        ngh += read_neighbor(start);
+      }
+      proc++;
+      return ngh;
+    }
+
+    // weight of the neighbor last returned by next()
+    inline W weight() {
+      W w;
+      std::memcpy(&w, weights + (proc-1)*sizeof(W), sizeof(W));
+      return w;
+    }
+
+    inline bool has_next() {
+      return proc < deg;
+    }
+  };
+
+  template <class W>
+  struct write_iter {
+    uchar* node_ptr;
+    size_t offset = 0;
+    size_t proc = 0;
+    size_t node_size;
+    size_t weight_start; // weights are staged here until finish()
+
+    uintV src; uintV last_ngh;
+    uintV deg_ub;
+
+    write_iter(uintV src, size_t deg_ub) : src(src), deg_ub(deg_ub) {
+      proc = 0;
+      weight_start = header_bytes + deg_ub*5;
+      std::tie(node_ptr, node_size) = compressed_lists::alloc_node(weight_start + deg_ub*sizeof(W));
+      offset += header_bytes;
+    }
+
+    void compress_next(const uintV& ngh, const W& w) {
+      if (proc == 0) {
+        offset = compress_first_neighbor(node_ptr, offset, src, ngh);
+      } else {
+        uintV difference = ngh - last_ngh;
+        offset = compress_neighbor(node_ptr, offset, difference);
+      }
+      std::memcpy(node_ptr + weight_start + proc*sizeof(W), &w, sizeof(W));
+      proc++;
+      last_ngh = ngh;
+    }
+
+    uchar* finish() {
+      if (proc == 0) {
+        *((uint16_t*)(node_ptr + sizeof(uint16_t))) = node_size;
+        *((uint32_t*)(node_ptr + 2*sizeof(uint16_t))) = 1;
+        compressed_lists::deallocate(node_ptr);
+        return nullptr;
+      }
+      assert(offset <= weight_start);
+
+      // pack the weights right after the neighbors
+      size_t weight_bytes = proc*sizeof(W);
+      std::memmove(node_ptr + offset, node_ptr + weight_start, weight_bytes);
+      size_t total = offset + weight_bytes;
+
+      // move to a smaller size class if we used at most half of the node
+      if (2*total <= node_size || (node_size > 16384 && total <= 16384)) {
+        uchar* old_arr = node_ptr;
+        size_t old_size = node_size;
+        std::tie(node_ptr, node_size) = compressed_lists::alloc_node(total);
+        std::memcpy(node_ptr, old_arr, total);
+        *((uint16_t*)(old_arr + sizeof(uint16_t))) = old_size;
+        *((uint32_t*)(old_arr + 2*sizeof(uint16_t))) = 1;
+        compressed_lists::deallocate(old_arr);
+      }
+
+      *((uint16_t*)node_ptr) = proc;
+      *((uint16_t*)(node_ptr + sizeof(uint16_t))) = total;
+      *((uint32_t*)(node_ptr + 2*sizeof(uint16_t))) = 1;
+      *((uint32_t*)(node_ptr + 2*sizeof(uint16_t) + sizeof(uint32_t))) = last_ngh;
+      return node_ptr;
+    }
+  };
+
+} // namespace compressed_weighted_iter
+
+namespace compressed_weighted_lists {
+
+  using uchar = unsigned char;
+  using compressed_lists::is_head;
+  using compressed_lists::node_size;
+  using compressed_lists::copy_node;
+  using compressed_lists::deallocate;
+
+  // f : (ngh, weight, offset) -> void
+  template <class W, class F>
+  inline void map_array(uchar* node, const uintV& src, size_t offset, const F& f) {
+    if (node) {
+      auto it = compressed_weighted_iter::read_iter<W>(node, src);
+      size_t deg = it.deg;
+      for (size_t i=0; i<deg; i++) {
+        uintV ngh = it.next();
+        f(ngh, it.weight(), offset+i);
+      }
+    }
+  }
+
+  // f : (ngh, weight) -> bool (true to stop)
+  template <class W, class F>
+  inline bool iter_elms_cond(uchar* node, const uintV& src, const F& f) {
+    if (node) {
+      auto it = compressed_weighted_iter::read_iter<W>(node, src);
+      size_t deg = it.deg;
+      for (size_t i=0; i<deg; i++) {
+        uintV ngh = it.next();
+        if (f(ngh, it.weight())) return true;
+      }
+    }
+    return false;
+  }
+
+  template <class W, class F>
+  inline void iter_elms(uchar* node, const uintV& src, const F& f) {
+    if (node) {
+      auto it = compressed_weighted_iter::read_iter<W>(node, src);
+      size_t deg = it.deg;
+      for (size_t i=0; i<deg; i++) {
+        uintV ngh = it.next();
+        f(ngh, it.weight());
+      }
+    }
+  }
+
+  template <class W>
+  inline bool find(uchar* node, uintV src, uintV key, W& w) {
+    if (node) {
+      auto it = compressed_weighted_iter::read_iter<W>(node, src);
+      while (it.has_next()) {
+        uintV ngh = it.next();
+        if (ngh == key) { w = it.weight(); return true; }
+        if (ngh > key) return false;
+      }
+    }
+    return false;
+  }
+
+  // Encodes S[start, end) where S is a sequence of (ngh, weight) pairs.
+  template <class W, class SQ>
+  uchar* generate_node(uintV src, SQ const& S, size_t start, size_t end) {
+    if (start >= end) return nullptr;
+    auto it = compressed_weighted_iter::write_iter<W>(src, end - start);
+    for (size_t i=start; i<end; i++) {
+      it.compress_next(std::get<0>(S[i]), std::get<1>(S[i]));
+    }
+    return it.finish();
+  }
+
+} // namespace compressed_weighted_lists
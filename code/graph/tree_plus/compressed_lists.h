@@ -2,7 +2,11 @@
 
 #include "../../common/compression.h"
 //#include "compressed_iter_fat.h"
+#ifdef STREAMVBYTE
+#include "compressed_iter_svb.h"
+#else
 #include "compressed_iter.h"
+#endif
 
 // size_t head_frequency = 8;
 // size_t head_mask = (1 << head_frequency) - 1;
@@ -31,10 +35,10 @@ namespace compressed_lists {
   inline void map_array(uchar* node, const uintV& src, size_t offset, const F& f) {
     if (node) {
       auto read_iter = compressed_iter::read_iter(node, src);
-      size_t deg = read_iter.deg;
-      for (size_t i=0; i<deg; i++) {
-        f(read_iter.next(), offset+i);
-      }
+      read_iter.decode_cond([&] (size_t i, uintV ngh) {
+        f(ngh, offset+i);
+        return false;
+      });
     }
   }
 
@@ -42,10 +46,10 @@ namespace compressed_lists {
   inline void map_nghs(uchar* node, const uintV& src, const F& f) {
     if (node) {
       auto read_iter = compressed_iter::read_iter(node, src);
-      size_t deg = read_iter.deg;
-      for (size_t i=0; i<deg; i++) {
-        f(src, read_iter.next());
-      }
+      read_iter.decode_cond([&] (size_t i, uintV ngh) {
+        f(src, ngh);
+        return false;
+      });
     }
   }
 
@@ -54,10 +58,10 @@ namespace compressed_lists {
     size_t ct = 0;
     if (node) {
       auto read_iter = compressed_iter::read_iter(node, src);
-      size_t deg = read_iter.deg;
-      for (size_t i=0; i<deg; i++) {
-        if (p(src, read_iter.next())) ct++;
-      }
+      read_iter.decode_cond([&] (size_t i, uintV ngh) {
+        if (p(src, ngh)) ct++;
+        return false;
+      });
     }
     return ct;
   }
@@ -75,10 +79,9 @@ namespace compressed_lists {
   inline bool iter_elms_cond(uchar* node, const uintV& src, const F& f) {
     if (node) {
       auto read_iter = compressed_iter::read_iter(node, src);
-      size_t deg = read_iter.deg;
-      for (size_t i=0; i<deg; i++) {
-        if (f(read_iter.next())) return true;
-      }
+      return read_iter.decode_cond([&] (size_t i, uintV ngh) {
+        return f(ngh);
+      });
     }
     return false;
   }
@@ -87,10 +90,10 @@ namespace compressed_lists {
   inline void iter_elms(uchar* node, const uintV& src, const F& f) {
     if (node) {
       auto read_iter = compressed_iter::read_iter(node, src);
-      size_t deg = read_iter.deg;
-      for (size_t i=0; i<deg; i++) {
-        f(read_iter.next());
-      }
+      read_iter.decode_cond([&] (size_t i, uintV ngh) {
+        f(ngh);
+        return false;
+      });
     }
   }
 
@@ -195,6 +198,18 @@ namespace compressed_lists {
     return nullptr;
   }
 
+  // Allocates a new node holding a byte-for-byte copy of an encoded node (e.g.
+  // one read back from a snapshot). The copy starts with a ref-ct of 1.
+  uchar* node_from_bytes(uchar const* bytes) {
+    size_t num_bytes = *((uint16_t*)(bytes + sizeof(uint16_t)));
+    uchar* node; size_t alloc_size;
+    std::tie(node, alloc_size) = alloc_node(num_bytes);
+    std::memcpy(node, bytes, num_bytes);
+    uint32_t* ref_ct = (uint32_t*)(node + 2*sizeof(uint16_t));
+    *ref_ct = 1;
+    return node;
+  }
+
   uchar* union_its(compressed_iter::read_iter& l_it, size_t l_size,
                    compressed_iter::read_iter& r_it, size_t r_size,
                    uintV src) {
@@ -271,12 +286,17 @@ namespace compressed_lists {
     return write_iter.finish();
   }
 
-  // returns r_node / it
+  // returns r_node / it. Consumes exactly l_size elements of it, so that the
+  // caller can continue from the next element.
   uchar* difference_it_and_node(compressed_iter::read_iter& it, size_t l_size, uchar* r_node, uintV src) {
     assert(r_node);
     auto r_it = compressed_iter::read_iter(r_node, src);
     size_t r_size = r_it.deg;
-    return difference_its(it, l_size, r_it, r_size, src);
+    size_t l_end = it.proc + l_size;
+    auto ret = difference_its(it, l_size, r_it, r_size, src);
+    // difference_its stops reading it once r_node is exhausted
+    while (it.proc < l_end) it.next();
+    return ret;
   }
 
   // returns r / l
@@ -275,6 +275,9 @@ namespace compressed_lists {
       allocator_8192::num_used_bytes() +
       allocator_16384::num_used_bytes();
     cout << "Total bytes for node allocators: " << total_bytes << endl;
+#ifdef HUGEPAGES
+    huge_pages::print_stats();
+#endif
   }
 
   inline uintV underlying_array_size(uchar* node_int) {
@@ -24,6 +24,10 @@ struct sym_immutable_graph_tree_plus {
 
   using edge_struct = tree_plus::treeplus;
 
+  // The out- and in-edges of a vertex are the same in a symmetric graph.
+  static const edge_struct& out_edges(const edge_struct& e) { return e; }
+  static const edge_struct& in_edges(const edge_struct& e) { return e; }
+
   struct vertex_entry {
     using key_t = uintV;
     using val_t = edge_struct;
@@ -178,6 +182,23 @@ struct sym_immutable_graph_tree_plus {
     return edge_list_bytes + total_vertices*56 + total_el_nodes*48;
   }
 
+  // The bytes referenced only by this version of the graph, i.e. what
+  // releasing it would free. Versions share structure by path copying, so
+  // this is about the size of the vertices and edges it changed.
+  // The root's own count is not checked, since it counts the holders of
+  // this version rather than sharing with other versions.
+  size_t unshared_bytes() const { return unshared_bytes(V.root, true); }
+
+  static size_t unshared_bytes(Node* t, bool is_root=false) {
+    if (!t || (t->ref_cnt > 1 && !is_root)) return 0;
+    size_t l_bytes, r_bytes;
+    utils::fork_no_result(vertices_tree::size(t) >= utils::node_limit,
+      [&] () { l_bytes = unshared_bytes(t->lc); },
+      [&] () { r_bytes = unshared_bytes(t->rc); });
+    const auto& EL = vertices_tree::get_entry(t).second;
+    return vertices::node_size() + EL.unshared_bytes() + l_bytes + r_bytes;
+  }
+
   void check_edges() {
     size_t n = num_vertices();
     timer mapt; mapt.start();
@@ -316,7 +337,7 @@ struct sym_immutable_graph_tree_plus {
   }
 
 
-  void sort_updates(tuple<uintV, uintV>* edges, size_t m, size_t nn=std::numeric_limits<size_t>::max()) const {
+  static void sort_updates(tuple<uintV, uintV>* edges, size_t m, size_t nn=std::numeric_limits<size_t>::max()) {
     using edge = tuple<uintV, uintV>;
     auto E_orig = pbbs::make_range(edges, edges + m);
     size_t vtx_bits = pbbs::log2_up(nn);
@@ -488,6 +509,101 @@ struct sym_immutable_graph_tree_plus {
 
 
 
+  // Returns (a - del) + ins, without consuming the arguments.
+  static edge_struct update_edges(const edge_struct& a, const edge_struct& ins, const edge_struct& del, uintV v, bool run_seq) {
+    bool no_ins = !ins.plus && !ins.root;
+    bool no_del = !del.plus && !del.root;
+    if (no_del) {
+      return tree_plus::uniont(a, ins, v, run_seq);
+    } else if (no_ins) {
+      return tree_plus::difference(del, a, v, run_seq);
+    }
+    auto remaining = tree_plus::difference(del, a, v, run_seq);
+    auto ret = tree_plus::uniont(remaining, ins, v, run_seq);
+    lists::deallocate(remaining.plus);
+    tree_plus::Tree_GC::decrement_recursive(remaining.root, run_seq);
+    return ret;
+  }
+
+  // Sorts a batch of tagged updates by edge, and keeps the last update to
+  // each edge. Returns the remaining updates.
+  static pbbs::sequence<edge_update> resolve_updates(size_t m, edge_update* updates, bool sorted, bool run_seq) {
+    auto U = pbbs::make_range(updates, updates + m);
+    auto fl = run_seq ? pbbs::fl_sequential : pbbs::no_flag;
+    auto edge_less = [&] (const edge_update& a, const edge_update& b) {
+      return (get<0>(a) < get<0>(b)) || (get<0>(a) == get<0>(b) && get<1>(a) < get<1>(b));
+    };
+    if (!sorted) {
+      // stable, so that updates to the same edge stay in batch order
+      pbbs::sample_sort_inplace(U, edge_less, true);
+    }
+    auto last_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == m-1) || get<0>(U[i]) != get<0>(U[i+1]) || get<1>(U[i]) != get<1>(U[i+1]);
+    });
+    return pbbs::pack(U, last_im, fl);
+  }
+
+  // Applies a batch of insertions and deletions in a single pass over the
+  // vertex tree. If an edge is updated more than once, the last update in
+  // the batch wins. If sorted is set, the updates must already be sorted by
+  // edge (keeping the batch order of updates to the same edge).
+  auto apply_updates_batch(size_t m, edge_update* updates, bool sorted=false, bool run_seq=false) const {
+    auto fl = run_seq ? pbbs::fl_sequential : pbbs::no_flag;
+    auto U = resolve_updates(m, updates, sorted, run_seq);
+    m = U.size();
+
+    // pack starts
+    auto start_im = pbbs::delayed_seq<size_t>(m, [&] (size_t i) {
+      return (i == 0 || (get<0>(U[i]) != get<0>(U[i-1])));
+    });
+    auto starts = pbbs::pack_index<size_t>(start_im, fl);
+    size_t num_starts = starts.size();
+
+    // The insertions of each vertex are its new value in the vertex tree, and
+    // its deletions are kept on the side, at the same index.
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(num_starts);
+    auto deletions = pbbs::sequence<edge_struct>(num_starts);
+    parallel_for(0, num_starts, [&] (size_t i) {
+      size_t off = starts[i];
+      size_t deg = ((i == (num_starts-1)) ? m : starts[i+1]) - off;
+      uintV v = get<0>(U[off]);
+      auto R = U.slice(off, off + deg);
+
+      auto ins = pbbs::filter(R, [&] (const edge_update& u) { return get<2>(u); }, pbbs::fl_sequential);
+      auto S_ins = pbbs::delayed_seq<uintV>(ins.size(), [&] (size_t j) { return get<1>(ins[j]); });
+      if (ins.size() < deg) {
+        auto del = pbbs::filter(R, [&] (const edge_update& u) { return !get<2>(u); }, pbbs::fl_sequential);
+        auto S = pbbs::delayed_seq<uintV>(del.size(), [&] (size_t j) { return get<1>(del[j]); });
+        deletions[i] = edge_struct(S, v, fl);
+      } else {
+        deletions[i] = edge_struct();
+      }
+      new_verts[i] = make_pair(v, (ins.size() > 0) ? edge_struct(S_ins, v, fl) : edge_struct());
+    }, (run_seq) ? std::numeric_limits<long>::max() : 1);
+
+    auto keys = pbbs::delayed_seq<uintV>(num_starts, [&] (size_t i) { return new_verts[i].first; });
+    auto replace = [&] (const uintV& v, const edge_struct& a, const edge_struct& b) {
+      size_t i = pbbs::binary_search(keys, [&] (uintV k) { return k < v; });
+      auto ret = update_edges(a, b, deletions[i], v, run_seq);
+
+      lists::deallocate(a.plus);
+      tree_plus::Tree_GC::decrement_recursive(a.root, run_seq);
+      lists::deallocate(b.plus);
+      tree_plus::Tree_GC::decrement_recursive(b.root, run_seq);
+      return ret;
+    };
+
+    // Note that replace is only called if the element currently has a value.
+    auto V_next = vertices_tree::multi_insert_sorted_with_values(V.root, new_verts.begin(), num_starts, replace, true, run_seq);
+
+    parallel_for(0, num_starts, [&] (size_t i) {
+      lists::deallocate(deletions[i].plus);
+      tree_plus::Tree_GC::decrement_recursive(deletions[i].root, run_seq);
+    }, (run_seq) ? std::numeric_limits<long>::max() : 1);
+    return sym_immutable_graph_tree_plus(std::move(V_next));
+  }
+
   // frees offsets and edges
   // TODO(laxmand): clarify that this doesn't do union'ing and is only for
   // building the initial graph.
@@ -530,6 +646,191 @@ struct sym_immutable_graph_tree_plus {
     return sym_immutable_graph_tree_plus(std::move(V_next));
   }
 
+  // Native snapshot format. The vertex tree is written in key order along
+  // with each vertex's plus and edge-tree chunks, byte-for-byte as they are
+  // stored in the compressed_lists pools, so that loading a snapshot only
+  // copies chunks back into the pools and rebuilds the (balanced) trees.
+  //
+  // layout: snapshot_header
+  //         snapshot_vertex[num_vertices]
+  //         snapshot_tree_node[num_tree_nodes]
+  //         chunk bytes (each chunk carries its own size in its header)
+  static constexpr const uint64_t snapshot_magic = 0x504e534e45505341; // "ASPENSNP"
+  static constexpr const uint64_t snapshot_version = 2;
+  static constexpr const uint64_t snapshot_null = std::numeric_limits<uint64_t>::max();
+
+  struct snapshot_header {
+    uint64_t magic;
+    uint64_t version;
+    uint64_t vtx_bytes; // sizeof(uintV) used when writing
+    uint64_t num_vertices; // entries in the vertex tree
+    uint64_t num_edges;
+    uint64_t num_tree_nodes;
+    uint64_t chunk_bytes;
+    uint64_t chunk_encoding; // compressed_iter::encoding_id used when writing
+  };
+
+  struct snapshot_vertex {
+    uint64_t key;
+    uint64_t plus_off; // offset into the chunk bytes, or snapshot_null
+    uint64_t tree_start; // index of the first tree node of this vertex
+  };
+
+  struct snapshot_tree_node {
+    uint64_t key;
+    uint64_t chunk_off; // offset into the chunk bytes, or snapshot_null
+  };
+
+  void write_snapshot(const char* fname) const {
+    timer write_t; write_t.start();
+    using edge_list = tree_plus::edge_list;
+    size_t nv = V.size();
+    auto tree_offs = pbbs::sequence<uint64_t>(nv + 1);
+    auto byte_offs = pbbs::sequence<uint64_t>(nv + 1);
+    auto count_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      const auto& EL = E.second;
+      size_t n_nodes = 0;
+      size_t n_bytes = lists::node_bytes(EL.plus);
+      auto T = edge_list(); T.root = EL.root;
+      T.iter_elms([&] (const edge_struct::Entry& entry) {
+        n_nodes++;
+        n_bytes += lists::node_bytes(entry.second);
+      });
+      T.root = nullptr;
+      tree_offs[ind] = n_nodes;
+      byte_offs[ind] = n_bytes;
+    };
+    map_vertices(count_f);
+    tree_offs[nv] = 0; byte_offs[nv] = 0;
+    size_t num_tree_nodes = pbbs::scan_inplace(tree_offs.slice(), pbbs::addm<uint64_t>());
+    size_t chunk_bytes = pbbs::scan_inplace(byte_offs.slice(), pbbs::addm<uint64_t>());
+
+    size_t vtx_start = sizeof(snapshot_header);
+    size_t node_start = vtx_start + nv*sizeof(snapshot_vertex);
+    size_t chunk_start = node_start + num_tree_nodes*sizeof(snapshot_tree_node);
+    size_t total_bytes = chunk_start + chunk_bytes;
+    auto out = pbbs::sequence<char>(total_bytes);
+
+    auto H = (snapshot_header*)out.begin();
+    H->magic = snapshot_magic;
+    H->version = snapshot_version;
+    H->vtx_bytes = sizeof(uintV);
+    H->num_vertices = nv;
+    H->num_edges = num_edges();
+    H->num_tree_nodes = num_tree_nodes;
+    H->chunk_bytes = chunk_bytes;
+    H->chunk_encoding = compressed_iter::encoding_id;
+    auto vtx_recs = (snapshot_vertex*)(out.begin() + vtx_start);
+    auto node_recs = (snapshot_tree_node*)(out.begin() + node_start);
+    char* chunks = out.begin() + chunk_start;
+
+    auto write_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      const auto& EL = E.second;
+      size_t byte_off = byte_offs[ind];
+      size_t node_off = tree_offs[ind];
+      auto write_chunk = [&] (uchar* node) -> uint64_t {
+        if (!node) return snapshot_null;
+        size_t off = byte_off;
+        size_t n_bytes = lists::node_bytes(node);
+        std::memcpy(chunks + off, node, n_bytes);
+        byte_off += n_bytes;
+        return off;
+      };
+      vtx_recs[ind].key = E.first;
+      vtx_recs[ind].plus_off = write_chunk(EL.plus);
+      vtx_recs[ind].tree_start = node_off;
+      auto T = edge_list(); T.root = EL.root;
+      T.iter_elms([&] (const edge_struct::Entry& entry) {
+        node_recs[node_off].key = entry.first;
+        node_recs[node_off].chunk_off = write_chunk(entry.second);
+        node_off++;
+      });
+      T.root = nullptr;
+    };
+    map_vertices(write_f);
+
+    std::ofstream file(fname, std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+      std::cout << "Unable to open file: " << fname << std::endl;
+      abort();
+    }
+    file.write(out.begin(), total_bytes);
+    file.close();
+    cout << "Wrote snapshot: vertices = " << nv << " tree nodes = " << num_tree_nodes
+         << " chunk bytes = " << chunk_bytes << endl;
+    write_t.next("Snapshot write time");
+  }
+
+  // Rebuilds a graph from a snapshot written by write_snapshot. Chunks are
+  // copied into the compressed_lists pools as-is; no neighbor is re-encoded.
+  static sym_immutable_graph_tree_plus read_snapshot(const char* fname) {
+    timer read_t; read_t.start();
+    auto SS = mmapStringFromFile(fname);
+    char* s = SS.first;
+    size_t s_size = SS.second;
+
+    auto H = (snapshot_header*)s;
+    if (s_size < sizeof(snapshot_header) || H->magic != snapshot_magic) {
+      cout << fname << " is not an Aspen snapshot" << endl;
+      exit(0);
+    }
+    if (H->version != snapshot_version || H->vtx_bytes != sizeof(uintV) ||
+        H->chunk_encoding != compressed_iter::encoding_id) {
+      cout << "Snapshot version " << H->version << " (vertex bytes = " << H->vtx_bytes
+           << ", chunk encoding = " << H->chunk_encoding << ") is incompatible with this build" << endl;
+      exit(0);
+    }
+    size_t nv = H->num_vertices;
+    size_t m = H->num_edges;
+    size_t num_tree_nodes = H->num_tree_nodes;
+    size_t vtx_start = sizeof(snapshot_header);
+    size_t node_start = vtx_start + nv*sizeof(snapshot_vertex);
+    size_t chunk_start = node_start + num_tree_nodes*sizeof(snapshot_tree_node);
+    assert(chunk_start + H->chunk_bytes == s_size);
+    auto vtx_recs = (snapshot_vertex*)(s + vtx_start);
+    auto node_recs = (snapshot_tree_node*)(s + node_start);
+    uchar* chunks = (uchar*)(s + chunk_start);
+
+    init(nv, m);
+
+    auto read_chunk = [&] (uint64_t off) -> uchar* {
+      if (off == snapshot_null) return nullptr;
+      return lists::node_from_bytes(chunks + off);
+    };
+
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(nv);
+    parallel_for(0, nv, [&] (size_t i) {
+      const auto& rec = vtx_recs[i];
+      size_t start = rec.tree_start;
+      size_t end = (i == (nv-1)) ? num_tree_nodes : vtx_recs[i+1].tree_start;
+      size_t k = end - start;
+
+      auto plus = read_chunk(rec.plus_off);
+      edge_struct::Node* root = nullptr;
+      if (k > 0) {
+        using TKV = edge_struct::Entry;
+        auto kvs = pbbs::sequence<TKV>(k);
+        parallel_for(0, k, [&] (size_t j) {
+          const auto& node_rec = node_recs[start + j];
+          kvs[j] = make_pair((uintV)node_rec.key, read_chunk(node_rec.chunk_off));
+        }, 256);
+        root = edge_struct::Tree::from_array(kvs.begin(), k);
+      }
+      new_verts[i] = make_pair((uintV)rec.key, edge_struct(plus, root));
+    }, 1);
+
+    auto replace = [] (const edge_struct& a, const edge_struct& b) {return b;};
+    auto V_next = vertices_tree::multi_insert_sorted(nullptr, new_verts.begin(), new_verts.size(), replace, true);
+
+    if (munmap(s, s_size) == -1) {
+      perror("munmap");
+      exit(-1);
+    }
+    read_t.next("Snapshot read time");
+    return sym_immutable_graph_tree_plus(std::move(V_next));
+  }
+
   static void init(size_t n, size_t m) {
     // edge_lists are the 'tree nodes' in edgelists
     using edge_list = tree_plus::edge_list;
@@ -540,28 +841,84 @@ struct sym_immutable_graph_tree_plus {
     vertices::init(); vertices::reserve(n/300);
   }
 
-  // frees offsets and edges.
-  sym_immutable_graph_tree_plus(size_t n, size_t m, uintE* offsets, uintV* edges) {
-    init(n, m);
-
-    print_stats();
-    cout << "stats before build" << endl << endl;
-
-    timer build_t; build_t.start();
+  // Builds the edge_structs of vertices [lo, hi) of a CSR graph.
+  template <class O>
+  static auto build_vertices(size_t lo, size_t hi, size_t n, size_t m, const O* offsets, const uintV* edges) {
     using KV = pair<uintV, edge_struct>;
-    auto new_verts = pbbs::sequence<KV>(n);
-    parallel_for(0, n, [&] (size_t i) { // TODO: granularity
+    auto new_verts = pbbs::sequence<KV>(hi - lo);
+    parallel_for(0, hi - lo, [&] (size_t k) { // TODO: granularity
+      size_t i = lo + k;
       size_t off = offsets[i];
       size_t deg = ((i == (n-1)) ? m : offsets[i+1]) - off;
       auto S = pbbs::delayed_seq<uintV>(deg, [&] (size_t j) { return edges[off + j]; });
 
       if (deg > 0) {
-        new_verts[i] = make_pair(i, edge_struct(S, i));
+        new_verts[k] = make_pair(i, edge_struct(S, i));
       } else {
-        new_verts[i] = make_pair(i, edge_struct());
+        new_verts[k] = make_pair(i, edge_struct());
       }
-//      new_verts[i].second.check_consistency(i);
+//      new_verts[k].second.check_consistency(i);
     }, 1);
+    return new_verts;
+  }
+
+  // Builds the graph one range of vertices at a time. next_range(lo) returns
+  // the end of the range that starts at lo, and build_vertex(i) returns the
+  // edge_struct of vertex i. After the vertices in [lo, hi) are added to the
+  // tree, on_range(lo, hi) is called, so the caller can verify or release that
+  // part of the input before the next range is read.
+  template <class R, class B, class F>
+  static sym_immutable_graph_tree_plus build_by_ranges(size_t n, size_t m, R next_range,
+      B build_vertex, F on_range) {
+    init(n, m);
+    timer build_t; build_t.start();
+    using KV = pair<uintV, edge_struct>;
+    auto replace = [] (const edge_struct& a, const edge_struct& b) {return b;};
+    vertices_tree::node* root = nullptr;
+    size_t lo = 0, num_ranges = 0;
+    while (lo < n) {
+      size_t hi = std::max(lo + 1, next_range(lo));
+      auto new_verts = pbbs::sequence<KV>(hi - lo);
+      parallel_for(0, hi - lo, [&] (size_t k) {
+        new_verts[k] = make_pair(lo + k, build_vertex(lo + k));
+      }, 1);
+      root = vertices_tree::multi_insert_sorted(root, new_verts.begin(), new_verts.size(), replace, false);
+      on_range(lo, hi);
+      lo = hi;
+      num_ranges++;
+    }
+    cout << "built " << n << " vertices in " << num_ranges << " ranges" << endl;
+    build_t.next("Build time");
+    return sym_immutable_graph_tree_plus(vertices(root));
+  }
+
+  // Builds the graph from a CSR graph that it does not own. A range spans
+  // about range_edges edges.
+  template <class O, class F>
+  static sym_immutable_graph_tree_plus build_streaming(size_t n, size_t m, const O* offsets,
+      const uintV* edges, size_t range_edges, F on_range) {
+    auto next_range = [&] (size_t lo) -> size_t {
+      return std::upper_bound(offsets + lo + 1, offsets + n, offsets[lo] + range_edges) - offsets;
+    };
+    auto build_vertex = [&] (size_t i) {
+      size_t off = offsets[i];
+      size_t deg = ((i == (n-1)) ? m : offsets[i+1]) - off;
+      if (deg == 0) return edge_struct();
+      auto S = pbbs::delayed_seq<uintV>(deg, [&] (size_t j) { return edges[off + j]; });
+      return edge_struct(S, i);
+    };
+    return build_by_ranges(n, m, next_range, build_vertex, on_range);
+  }
+
+  // frees offsets and edges.
+  sym_immutable_graph_tree_plus(size_t n, size_t m, uintE* offsets, uintV* edges) {
+    init(n, m);
+
+    print_stats();
+    cout << "stats before build" << endl << endl;
+
+    timer build_t; build_t.start();
+    auto new_verts = build_vertices(0, n, n, m, offsets, edges);
     cout << "built all vertices" << endl;
 
     print_stats();
@@ -0,0 +1,524 @@
+#pragma once
+
+#include "immutable_graph_tree_plus.h"
+#include "../../pbbslib/merge.h"
+
+// A directed graph. Each vertex stores two C-trees: its out-neighbors and its
+// in-neighbors. Both live in the value of a single vertex-tree entry, so a
+// batch update produces one new root that reflects the update in both
+// directions, and a version never sees the two directions out of sync.
+struct asym_immutable_graph_tree_plus {
+
+  using treeplus = tree_plus::treeplus;
+
+  // Behaves as the out-edges of the vertex (so degree(), map_elms, etc. work
+  // as for a symmetric graph); the in-edges are used when pulling in a dense
+  // edge_map.
+  struct edge_struct : public treeplus {
+    treeplus in;
+
+    edge_struct() : treeplus(), in() {}
+    edge_struct(const treeplus& out, const treeplus& _in) : treeplus(out), in(_in) {}
+
+    size_t out_degree() const { return treeplus::degree(); }
+    size_t in_degree() const { return in.degree(); }
+  };
+
+  static const treeplus& out_edges(const edge_struct& e) { return e; }
+  static const treeplus& in_edges(const edge_struct& e) { return e.in; }
+
+  struct vertex_entry {
+    using key_t = uintV;
+    using val_t = edge_struct;
+    static bool comp(const key_t& a, const key_t& b) { return a < b; }
+    using aug_t = uintE; // num. out-edges in this subtree
+    static aug_t get_empty() { return 0; }
+    static aug_t from_entry(const key_t& k, const val_t& v) { return v.size(); }
+    static aug_t combine(const aug_t& a, const aug_t& b) { return a + b; }
+    using entry_t = std::pair<key_t, val_t>;
+
+    static treeplus copy_treeplus(const treeplus& t) {
+      auto plus = lists::copy_node(t.plus); // bumps ref-cnt
+      auto root = tree_plus::Tree_GC::inc(t.root); // bumps ref-cnt
+      return treeplus(plus, root);
+    }
+
+    static entry_t copy_entry(const entry_t& e) {
+      return make_pair(e.first, edge_struct(copy_treeplus(e.second), copy_treeplus(e.second.in)));
+    }
+
+    static void del_treeplus(treeplus& t) {
+      if (t.plus) {
+        lists::deallocate(t.plus);
+        t.plus = nullptr;
+      }
+      if (t.root) {
+        auto T = tree_plus::edge_list();
+        T.root = t.root;
+        t.root = nullptr;
+      }
+    }
+
+    static void del(entry_t& e) {
+      del_treeplus(e.second);
+      del_treeplus(e.second.in);
+    }
+  };
+  using vertices = aug_map<vertex_entry>;
+  using vertices_tree = typename vertices::Tree;
+  using vertices_GC = typename vertices::GC;
+
+  vertices V;
+
+  size_t num_vertices() const {
+    size_t n = V.size();
+    auto last_vtx = V.select(n-1);
+    if (n > 0) {
+      assert(last_vtx.valid);
+      return last_vtx.value.first + 1;
+    } else {
+      return 0;
+    }
+  }
+
+  size_t num_edges() const { return V.aug_val(); }
+
+  size_t get_ref_cnt() {
+    if (V.root) {
+      return V.root->ref_cnt;
+    }
+    return static_cast<size_t>(0);
+  }
+  void print_ref_cnt() { cout << "cnt = " << get_ref_cnt() << endl; }
+
+  bool contains_vertex(uintV v) { return V.contains(v); }
+  // returns node*
+  inline auto find_vertex(uintV v) { return V.find(v); }
+
+  using Node = typename vertices::node;
+  using Node_GC = typename vertices::GC;
+
+  Node* get_root() const {
+    return V.root;
+  }
+  void clear_root() {
+    V.root = nullptr;
+  }
+  void set_root(Node* node) {
+    assert(V.root == nullptr);
+    V.root = node;
+  }
+
+  template <class F>
+  void map_vertices(F map_f, bool run_seq=false, size_t granularity=utils::node_limit) const { V.map_elms(map_f, run_seq, granularity); }
+
+  void map_all_edges_noop() {
+    auto map_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      auto map_edges_f = [&] (const uintV& v, size_t ind) { };
+      E.second.map_elms(E.first, map_edges_f);
+    };
+    map_vertices(map_f);
+  }
+
+  // f: (u, v) for each edge u -> v
+  template <class F>
+  void map_all_edges(F& f) const {
+    auto map_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      const uintV& u = E.first;
+      auto map_edges_f = [&] (const uintV& v, size_t ind) {
+        f(u, v);
+      };
+      E.second.map_elms(u, map_edges_f);
+    };
+    map_vertices(map_f);
+  }
+
+  // The bytes referenced only by this version of the graph, i.e. what
+  // releasing it would free.
+  // The root's own count is not checked, since it counts the holders of
+  // this version rather than sharing with other versions.
+  size_t unshared_bytes() const { return unshared_bytes(V.root, true); }
+
+  static size_t unshared_bytes(Node* t, bool is_root=false) {
+    if (!t || (t->ref_cnt > 1 && !is_root)) return 0;
+    size_t l_bytes, r_bytes;
+    utils::fork_no_result(vertices_tree::size(t) >= utils::node_limit,
+      [&] () { l_bytes = unshared_bytes(t->lc); },
+      [&] () { r_bytes = unshared_bytes(t->rc); });
+    const auto& E = vertices_tree::get_entry(t).second;
+    return vertices::node_size() + E.unshared_bytes() + E.in.unshared_bytes() + l_bytes + r_bytes;
+  }
+
+  size_t size_in_bytes() {
+    size_t n = num_vertices();
+    auto size_seq = pbbs::sequence<size_t>(n, [&] (size_t i) { return static_cast<size_t>(0); });
+    auto num_el_nodes = pbbs::sequence<size_t>(n, [&] (size_t i) { return static_cast<size_t>(0); });
+    auto map_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      const uintV& v = E.first;
+      const auto& EL = E.second;
+      size_seq[v] = EL.size_in_bytes(v) + EL.in.size_in_bytes(v);
+      num_el_nodes[v] = EL.edge_tree_nodes() + EL.in.edge_tree_nodes();
+    };
+    map_vertices(map_f);
+
+    size_t edge_list_bytes = pbbs::reduce(size_seq, pbbs::addm<size_t>());
+    size_t total_el_nodes = pbbs::reduce(num_el_nodes, pbbs::addm<size_t>());
+    cout << "Total edge-list bytes = " << edge_list_bytes << endl;
+    cout << "Total edge-list nodes = " << total_el_nodes << endl;
+    cout << "Total vertices = " << V.size() << endl;
+    return edge_list_bytes + V.size()*72 + total_el_nodes*48;
+  }
+
+  // Checks that the in-edges are the transpose of the out-edges. Returns the
+  // number of edges that are missing from the other direction.
+  size_t check_edges() {
+    size_t n = num_vertices();
+    auto missing = pbbs::sequence<size_t>(n, [&] (size_t i) { return static_cast<size_t>(0); });
+    auto in_ct = pbbs::sequence<size_t>(n, [&] (size_t i) { return static_cast<size_t>(0); });
+    auto map_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      const uintV& u = E.first;
+      auto check_out = [&] (const uintV& v, size_t i) {
+        auto mv = V.find(v);
+        if (!(mv.valid && mv.value.in.contains(v, u))) pbbs::write_add(&missing[u], 1);
+      };
+      auto check_in = [&] (const uintV& v, size_t i) {
+        auto mv = V.find(v);
+        if (!(mv.valid && mv.value.contains(v, u))) pbbs::write_add(&missing[u], 1);
+      };
+      E.second.map_elms(u, check_out);
+      E.second.in.map_elms(u, check_in);
+      in_ct[u] = E.second.in_degree();
+    };
+    map_vertices(map_f);
+    size_t num_missing = pbbs::reduce(missing, pbbs::addm<size_t>());
+    size_t m_in = pbbs::reduce(in_ct, pbbs::addm<size_t>());
+    if (num_missing > 0 || m_in != num_edges()) {
+      cout << "check_edges: missing = " << num_missing << " in-edges = " << m_in
+           << " out-edges = " << num_edges() << endl;
+    }
+    return num_missing + ((m_in > num_edges()) ? (m_in - num_edges()) : (num_edges() - m_in));
+  }
+
+  void iter_edges() {
+    auto map_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      const uintV& v = E.first;
+      size_t ctr = 0;
+      auto map_edges_f = [&] (const uintV& ngh) {
+        ctr++;
+        return false;
+      };
+      E.second.iter_elms_cond(v, map_edges_f);
+      assert(ctr == E.second.degree());
+    };
+    map_vertices(map_f);
+  }
+
+  // Returns the out-edges (u, v), sorted.
+  auto retrieve_edges() {
+    size_t n = num_vertices();
+    size_t m = num_edges();
+    using et = tuple<uintV, uintV>;
+    auto offsets = pbbs::sequence<uintE>(n, [&] (size_t i) { return static_cast<uintE>(0); });
+    auto map_f = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      offsets[E.first] = E.second.degree();
+    };
+    map_vertices(map_f);
+    pbbs::scan_inplace(offsets.slice(), pbbs::addm<uintE>());
+
+    auto edges = pbbs::sequence<et>(m);
+    auto write_edges = [&] (const vertex_entry::entry_t& E, size_t ind) {
+      const uintV& v = E.first;
+      size_t off = offsets[v];
+      auto map_edges_f = [&] (const uintV& ngh, size_t i) {
+        edges[off + i] = make_tuple(v, ngh);
+      };
+      E.second.map_elms(v, map_edges_f);
+    };
+    map_vertices(write_edges);
+    return edges;
+  }
+
+  // Size of the intersection of the out-neighborhoods of a and b.
+  void test_intersect(uintV a, uintV b) {
+    auto m_v1 = find_vertex(a); treeplus v1 = m_v1.value;
+    auto m_v2 = find_vertex(b); treeplus v2 = m_v2.value;
+    size_t int_size = tree_plus::intersect(v1, a, v2, b);
+    cout << "int_size = " << int_size << endl;
+  }
+
+  // unions are only tested on symmetric graphs
+  void test_union(uintV a, uintV b) { }
+  void test_unions(size_t n_trials) { }
+
+  static void free_treeplus(const treeplus& t, bool run_seq) {
+    lists::deallocate(t.plus);
+    tree_plus::Tree_GC::decrement_recursive(t.root, run_seq);
+  }
+
+  // Applies a batch of directed edges (u, v). The batch is applied to the
+  // out-edges of u as is, and to the in-edges of v after transposing it.
+  // Every vertex touched in either direction gets exactly one new entry, so
+  // the result is a single new vertex tree. op(v, current, update) combines
+  // one of the two C-trees of v with its updates. If only_existing is set,
+  // updates to vertices that are not in the graph are dropped.
+  template <class Op>
+  auto update_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted, bool remove_dups, size_t nn, bool run_seq, bool only_existing, Op op) const {
+    using edge = tuple<uintV, uintV>;
+    auto E_orig = pbbs::make_range(edges, edges + m);
+    edge* E_alloc = nullptr;
+    auto fl = run_seq ? pbbs::fl_sequential : pbbs::no_flag;
+    if (!sorted) {
+      sym_immutable_graph_tree_plus::sort_updates(edges, m, nn);
+    }
+
+    if (remove_dups) {
+      auto bool_seq = pbbs::delayed_seq<bool>(E_orig.size(), [&] (size_t i) {
+        return (i == 0 || E_orig[i] != E_orig[i-1]);
+      });
+      auto E = pbbs::pack(E_orig, bool_seq, fl);
+      m = E.size();
+      E_alloc = E.to_array();
+    }
+
+    auto E = (E_alloc) ? pbbs::make_range(E_alloc, E_alloc + m) : E_orig;
+
+    // the transposed batch
+    auto R = pbbs::sequence<edge>(m, [&] (size_t i) { return make_tuple(get<1>(E[i]), get<0>(E[i])); });
+    sym_immutable_graph_tree_plus::sort_updates(R.begin(), m, nn);
+
+    auto out_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == 0 || (get<0>(E[i]) != get<0>(E[i-1])));
+    });
+    auto out_starts = pbbs::pack_index<size_t>(out_im, fl);
+    auto in_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == 0 || (get<0>(R[i]) != get<0>(R[i-1])));
+    });
+    auto in_starts = pbbs::pack_index<size_t>(in_im, fl);
+    size_t n_out = out_starts.size(), n_in = in_starts.size();
+
+    // the vertices updated in either direction
+    auto out_keys = pbbs::sequence<uintV>(n_out, [&] (size_t i) { return get<0>(E[out_starts[i]]); });
+    auto in_keys = pbbs::sequence<uintV>(n_in, [&] (size_t i) { return get<0>(R[in_starts[i]]); });
+    auto all_keys = pbbs::merge(out_keys, in_keys, std::less<uintV>());
+    auto key_im = pbbs::delayed_seq<bool>(all_keys.size(), [&] (size_t i) {
+      return (i == 0 || all_keys[i] != all_keys[i-1]) && (!only_existing || V.contains(all_keys[i]));
+    });
+    auto keys = pbbs::pack(all_keys, key_im, fl);
+    size_t num_starts = keys.size();
+
+    // build the updates of each vertex
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(num_starts);
+    auto build = [&] (uintV v, auto& key_seq, auto& starts, auto& U) -> treeplus {
+      size_t i = std::lower_bound(key_seq.begin(), key_seq.end(), v) - key_seq.begin();
+      if (i == key_seq.size() || key_seq[i] != v) return treeplus();
+      size_t off = starts[i];
+      size_t deg = ((i == (key_seq.size()-1)) ? m : starts[i+1]) - off;
+      auto S = pbbs::delayed_seq<uintV>(deg, [&] (size_t j) { return get<1>(U[off + j]); });
+      return treeplus(S, v, fl);
+    };
+    parallel_for(0, num_starts, [&] (size_t i) {
+      uintV v = keys[i];
+      new_verts[i] = make_pair(v, edge_struct(build(v, out_keys, out_starts, E), build(v, in_keys, in_starts, R)));
+    }, (run_seq) ? std::numeric_limits<long>::max() : 1);
+
+    auto replace = [&] (const uintV& v, const edge_struct& a, const edge_struct& b) {
+      auto ret = edge_struct(op(v, a, b), op(v, a.in, b.in));
+      free_treeplus(a, run_seq); free_treeplus(a.in, run_seq);
+      free_treeplus(b, run_seq); free_treeplus(b.in, run_seq);
+      return ret;
+    };
+
+    // Note that replace is only called if the element currently has a value.
+    auto V_next = vertices_tree::multi_insert_sorted_with_values(V.root, new_verts.begin(), num_starts, replace, true, run_seq);
+
+    if (E_alloc) pbbs::free_array(E_alloc);
+    return asym_immutable_graph_tree_plus(std::move(V_next));
+  }
+
+  // edges: directed edges (u, v) to insert.
+  auto insert_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn=std::numeric_limits<size_t>::max(), bool run_seq=false) const {
+    auto op = [run_seq] (const uintV& v, const treeplus& a, const treeplus& b) {
+      return tree_plus::uniont(a, b, v, run_seq);
+    };
+    return update_edges_batch(m, edges, sorted, remove_dups, nn, run_seq, false, op);
+  }
+
+  auto delete_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn=std::numeric_limits<size_t>::max(), bool run_seq=false) const {
+    auto op = [run_seq] (const uintV& v, const treeplus& a, const treeplus& b) {
+      return tree_plus::difference(b, a, v, run_seq);
+    };
+    return update_edges_batch(m, edges, sorted, remove_dups, nn, run_seq, true, op);
+  }
+
+  // Applies a batch of insertions and deletions of directed edges in a
+  // single pass over the vertex tree. If an edge is updated more than once,
+  // the last update in the batch wins.
+  auto apply_updates_batch(size_t m, edge_update* updates, bool sorted=false, bool run_seq=false) const {
+    auto fl = run_seq ? pbbs::fl_sequential : pbbs::no_flag;
+    auto E = sym_immutable_graph_tree_plus::resolve_updates(m, updates, sorted, run_seq);
+    m = E.size();
+
+    // the transposed batch; its edges are distinct, so any sort will do
+    auto R = pbbs::sequence<edge_update>(m, [&] (size_t i) {
+      return make_tuple(get<1>(E[i]), get<0>(E[i]), get<2>(E[i]));
+    });
+    pbbs::sample_sort_inplace(R.slice(), [&] (const edge_update& a, const edge_update& b) {
+      return (get<0>(a) < get<0>(b)) || (get<0>(a) == get<0>(b) && get<1>(a) < get<1>(b));
+    });
+
+    auto out_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == 0 || (get<0>(E[i]) != get<0>(E[i-1])));
+    });
+    auto out_starts = pbbs::pack_index<size_t>(out_im, fl);
+    auto in_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == 0 || (get<0>(R[i]) != get<0>(R[i-1])));
+    });
+    auto in_starts = pbbs::pack_index<size_t>(in_im, fl);
+    size_t n_out = out_starts.size(), n_in = in_starts.size();
+
+    auto out_keys = pbbs::sequence<uintV>(n_out, [&] (size_t i) { return get<0>(E[out_starts[i]]); });
+    auto in_keys = pbbs::sequence<uintV>(n_in, [&] (size_t i) { return get<0>(R[in_starts[i]]); });
+    auto all_keys = pbbs::merge(out_keys, in_keys, std::less<uintV>());
+    auto key_im = pbbs::delayed_seq<bool>(all_keys.size(), [&] (size_t i) {
+      return (i == 0 || all_keys[i] != all_keys[i-1]);
+    });
+    auto keys = pbbs::pack(all_keys, key_im, fl);
+    size_t num_starts = keys.size();
+
+    // The insertions of each vertex are its new value in the vertex tree, and
+    // its deletions are kept on the side, at the same index.
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(num_starts);
+    auto deletions = pbbs::sequence<edge_struct>(num_starts);
+    auto build = [&] (uintV v, auto& key_seq, auto& starts, auto& U, bool insert) -> treeplus {
+      size_t i = std::lower_bound(key_seq.begin(), key_seq.end(), v) - key_seq.begin();
+      if (i == key_seq.size() || key_seq[i] != v) return treeplus();
+      size_t off = starts[i];
+      size_t deg = ((i == (key_seq.size()-1)) ? m : starts[i+1]) - off;
+      auto F = pbbs::filter(U.slice(off, off + deg), [&] (const edge_update& u) { return get<2>(u) == insert; }, pbbs::fl_sequential);
+      if (F.size() == 0) return treeplus();
+      auto S = pbbs::delayed_seq<uintV>(F.size(), [&] (size_t j) { return get<1>(F[j]); });
+      return treeplus(S, v, fl);
+    };
+    parallel_for(0, num_starts, [&] (size_t i) {
+      uintV v = keys[i];
+      new_verts[i] = make_pair(v, edge_struct(build(v, out_keys, out_starts, E, true), build(v, in_keys, in_starts, R, true)));
+      deletions[i] = edge_struct(build(v, out_keys, out_starts, E, false), build(v, in_keys, in_starts, R, false));
+    }, (run_seq) ? std::numeric_limits<long>::max() : 1);
+
+    auto replace = [&] (const uintV& v, const edge_struct& a, const edge_struct& b) {
+      size_t i = std::lower_bound(keys.begin(), keys.end(), v) - keys.begin();
+      const edge_struct& d = deletions[i];
+      auto ret = edge_struct(sym_immutable_graph_tree_plus::update_edges(a, b, d, v, run_seq),
+                             sym_immutable_graph_tree_plus::update_edges(a.in, b.in, d.in, v, run_seq));
+      free_treeplus(a, run_seq); free_treeplus(a.in, run_seq);
+      free_treeplus(b, run_seq); free_treeplus(b.in, run_seq);
+      return ret;
+    };
+
+    // Note that replace is only called if the element currently has a value.
+    auto V_next = vertices_tree::multi_insert_sorted_with_values(V.root, new_verts.begin(), num_starts, replace, true, run_seq);
+
+    parallel_for(0, num_starts, [&] (size_t i) {
+      free_treeplus(deletions[i], run_seq); free_treeplus(deletions[i].in, run_seq);
+    }, (run_seq) ? std::numeric_limits<long>::max() : 1);
+    return asym_immutable_graph_tree_plus(std::move(V_next));
+  }
+
+  void write_snapshot(const char* fname) const {
+    cout << "Snapshots are only supported for symmetric graphs" << endl;
+    exit(0);
+  }
+
+  static void init(size_t n, size_t m) {
+    sym_immutable_graph_tree_plus::init(n, m);
+    vertices::init(); vertices::reserve(n/300);
+  }
+
+  // Builds the graph from the out-edges in CSR form; the in-edges are built
+  // by transposing. Frees offsets and edges.
+  asym_immutable_graph_tree_plus(size_t n, size_t m, uintE* offsets, uintV* edges) {
+    init(n, m);
+
+    timer build_t; build_t.start();
+    using edge = tuple<uintV, uintV>;
+    // (v, u) for each edge u -> v, sorted by v. The sort is stable, so the
+    // in-neighbors of each vertex stay sorted.
+    auto R = pbbs::sequence<edge>(m);
+    parallel_for(0, n, [&] (size_t i) {
+      size_t off = offsets[i];
+      size_t deg = ((i == (n-1)) ? m : offsets[i+1]) - off;
+      for (size_t j=0; j<deg; j++) {
+        R[off + j] = make_tuple(edges[off + j], (uintV)i);
+      }
+    }, 1);
+    pbbs::integer_sort_inplace(R.slice(), [&] (const edge& e) { return get<0>(e); }, pbbs::log2_up(n));
+    auto in_offsets = pbbs::sequence<uintE>(n+1);
+    parallel_for(0, n+1, [&] (size_t v) { in_offsets[v] = 0; });
+    parallel_for(0, m, [&] (size_t i) {
+      uintV v = get<0>(R[i]);
+      long prev = (i == 0) ? -1 : (long)get<0>(R[i-1]);
+      for (long w = prev + 1; w <= (long)v; w++) {
+        in_offsets[w] = i;
+      }
+    });
+    long last = (m == 0) ? -1 : (long)get<0>(R[m-1]);
+    parallel_for(last + 1, n+1, [&] (size_t v) { in_offsets[v] = m; });
+
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(n);
+    parallel_for(0, n, [&] (size_t i) {
+      size_t off = offsets[i];
+      size_t deg = ((i == (n-1)) ? m : offsets[i+1]) - off;
+      auto S = pbbs::delayed_seq<uintV>(deg, [&] (size_t j) { return edges[off + j]; });
+      size_t in_off = in_offsets[i];
+      size_t in_deg = in_offsets[i+1] - in_off;
+      auto S_in = pbbs::delayed_seq<uintV>(in_deg, [&] (size_t j) { return get<1>(R[in_off + j]); });
+      auto out = (deg > 0) ? treeplus(S, i) : treeplus();
+      auto in = (in_deg > 0) ? treeplus(S_in, i) : treeplus();
+      new_verts[i] = make_pair(i, edge_struct(out, in));
+    }, 1);
+
+    auto replace = [] (const edge_struct& a, const edge_struct& b) {return b;};
+    V = vertices_tree::multi_insert_sorted(nullptr, new_verts.begin(), new_verts.size(), replace, true);
+
+    pbbs::free_array(offsets); pbbs::free_array(edges);
+    build_t.next("Build time");
+  }
+
+  asym_immutable_graph_tree_plus() {
+    V.root = nullptr;
+  }
+
+  asym_immutable_graph_tree_plus(vertices _V) : V(std::move(_V)) {}
+
+  static void print_stats() {
+    cout << "Vertices" << endl;
+    vertices::print_stats();
+    vertices::print_used();
+    cout << "Tree list nodes" << endl;
+    tree_plus::edge_list::print_stats();
+    tree_plus::edge_list::print_used();
+
+    lists::print_stats();
+  }
+
+  void print_compression_stats() {
+    size_t edge_list_bytes = tree_plus::edge_list::get_used_bytes();
+    size_t lists_bytes = lists::get_used_bytes();
+    size_t vertex_bytes = vertices::get_used_bytes();
+    size_t total_bytes = vertex_bytes + edge_list_bytes + lists_bytes;
+    cout << endl << "== Aspen Directed Stats (out- and in-edges) ==" << endl;
+    cout << "vertex tree: used nodes = " << vertices::used_node() << " size/node = " << vertices::node_size() << " memory used = " << format_gb(vertex_bytes) << " GB" << endl;
+    cout << "edge bytes: used nodes = " << tree_plus::edge_list::used_node() << " size/node = " << tree_plus::edge_list::node_size() << " memory used = " << format_gb(edge_list_bytes) << " GB" << endl;
+    cout << "compressed-lists memory used = " << format_gb(lists_bytes) << " GB" << endl;
+    cout << "Total: " << format_gb(total_bytes) << " GB" << endl;
+  }
+
+  void del() {
+    V.~vertices();
+    V.root = nullptr;
+  }
+
+};
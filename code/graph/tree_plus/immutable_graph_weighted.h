@@ -0,0 +1,303 @@
+#pragma once
+
+#include "../../common/types.h"
+#include "../../common/IO.h"
+#include "../../pbbslib/seq.h"
+#include "../../pbbslib/merge_sort.h"
+#include "../../trees/pam.h"
+#include "weighted_tree_plus.h"
+
+#include <limits>
+
+// A symmetric graph whose edges carry a payload of type W (e.g. float or
+// uint32_t). Edges are stored in weighted C-trees (weighted_tree_plus), and the
+// graph can be used as the snapshot_graph of a versioned_graph.
+template <class W>
+struct sym_immutable_graph_weighted {
+
+  using weight_t = W;
+  using edge_struct = weighted_tree_plus::treeplus<W>;
+  using weighted_edge = tuple<uintV, uintV, W>;
+  using edge = tuple<uintV, uintV>;
+
+  struct vertex_entry {
+    using key_t = uintV;
+    using val_t = edge_struct;
+    static bool comp(const key_t& a, const key_t& b) { return a < b; }
+    using aug_t = uintE;
+    static aug_t get_empty() { return 0; }
+    static aug_t from_entry(const key_t& k, const val_t& v) { return v.size(); }
+    static aug_t combine(const aug_t& a, const aug_t& b) { return a + b; }
+    using entry_t = std::pair<key_t, val_t>;
+
+    static entry_t copy_entry(const entry_t& e) {
+      auto plus = compressed_lists::copy_node(e.second.plus); // bumps ref-cnt
+      auto root = weighted_tree_plus::Tree_GC::inc(e.second.root); // bumps ref-cnt
+      return make_pair(e.first, edge_struct(plus, root));
+    }
+
+    static void del(entry_t& e) {
+      if (e.second.plus) {
+        compressed_lists::deallocate(e.second.plus);
+        e.second.plus = nullptr;
+      }
+      if (e.second.root) {
+        auto T = weighted_tree_plus::edge_list();
+        T.root = e.second.root;
+        e.second.root = nullptr;
+      }
+    }
+  };
+  using vertices = aug_map<vertex_entry>;
+  using vertices_tree = typename vertices::Tree;
+  using Node = typename vertices::node;
+  using Node_GC = typename vertices::GC;
+
+  vertices V;
+
+  size_t num_vertices() const {
+    size_t n = V.size();
+    if (n > 0) {
+      auto last_vtx = V.select(n-1);
+      assert(last_vtx.valid);
+      return last_vtx.value.first + 1;
+    }
+    return 0;
+  }
+
+  size_t num_edges() const { return V.aug_val(); }
+
+  inline auto find_vertex(uintV v) const { return V.find(v); }
+
+  Node* get_root() const { return V.root; }
+  void clear_root() { V.root = nullptr; }
+  void set_root(Node* node) {
+    assert(V.root == nullptr);
+    V.root = node;
+  }
+
+  template <class F>
+  void map_vertices(F map_f, bool run_seq=false, size_t granularity=utils::node_limit) const { V.map_elms(map_f, run_seq, granularity); }
+
+  // f : (u, v, weight) -> void
+  template <class F>
+  void map_all_edges(F& f) const {
+    auto map_f = [&] (const typename vertex_entry::entry_t& E, size_t ind) {
+      const uintV& u = E.first;
+      auto map_edges_f = [&] (const uintV& v, const W& w, size_t ind) {
+        f(u, v, w);
+      };
+      E.second.map_elms(u, map_edges_f);
+    };
+    map_vertices(map_f);
+  }
+
+  static void init(size_t n, size_t m) {
+    using edge_list = weighted_tree_plus::edge_list;
+    edge_list::init(); edge_list::reserve(n/16);
+
+    compressed_lists::init(n);
+
+    vertices::init(); vertices::reserve(n/300);
+  }
+
+  static void print_stats() {
+    cout << "Vertices" << endl;
+    vertices::print_stats();
+    vertices::print_used();
+    cout << "Tree list nodes" << endl;
+    weighted_tree_plus::edge_list::print_stats();
+    weighted_tree_plus::edge_list::print_used();
+
+    compressed_lists::print_stats();
+  }
+
+  // Sorts a batch of weighted edges by (u, v) and merges duplicates, combining
+  // their weights in batch order. Returns the deduplicated batch.
+  template <class C>
+  static pbbs::sequence<weighted_edge> sort_and_combine(size_t m, weighted_edge* edges, C const& combine, bool sorted) {
+    auto E = pbbs::make_range(edges, edges + m);
+    if (!sorted) {
+      // stable, so that duplicates are combined in the order they were given
+      pbbs::merge_sort_inplace(E, [] (const weighted_edge& a, const weighted_edge& b) {
+        return std::make_pair(get<0>(a), get<1>(a)) < std::make_pair(get<0>(b), get<1>(b));
+      });
+    }
+    auto same = [&] (size_t i, size_t j) {
+      return get<0>(E[i]) == get<0>(E[j]) && get<1>(E[i]) == get<1>(E[j]);
+    };
+    auto start_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) { return (i == 0) || !same(i, i-1); });
+    auto starts = pbbs::pack_index<size_t>(start_im);
+    size_t k = starts.size();
+    return pbbs::sequence<weighted_edge>(k, [&] (size_t i) {
+      size_t start = starts[i];
+      size_t end = (i == (k-1)) ? m : starts[i+1];
+      W w = get<2>(E[start]);
+      for (size_t j=start+1; j<end; j++) {
+        w = combine(w, get<2>(E[j]));
+      }
+      return make_tuple(get<0>(E[start]), get<1>(E[start]), w);
+    });
+  }
+
+  // Inserts a batch of weighted edges. Duplicate edges in the batch, and
+  // edges that are already present, have their weights merged with
+  // combine(old, new). As with the unweighted graph, both directions of an
+  // undirected edge should be supplied.
+  template <class C>
+  sym_immutable_graph_weighted insert_edges_batch(size_t m, weighted_edge* edges, C const& combine, bool sorted=false) const {
+    auto E = sort_and_combine(m, edges, combine, sorted);
+    m = E.size();
+
+    auto start_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == 0 || (get<0>(E[i]) != get<0>(E[i-1])));
+    });
+    auto starts = pbbs::pack_index<size_t>(start_im);
+    size_t num_starts = starts.size();
+    auto vertex_range = [&] (size_t i) {
+      size_t end = (i == (num_starts-1)) ? m : starts[i+1];
+      return make_pair(starts[i], end);
+    };
+
+    // Only vertices that are not yet in the graph need their edges encoded up
+    // front; the others are merged into their existing trees by replace.
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(num_starts);
+    parallel_for(0, num_starts, [&] (size_t i) {
+      size_t start, end; std::tie(start, end) = vertex_range(i);
+      uintV v = get<0>(E[start]);
+      if (V.contains(v)) {
+        new_verts[i] = make_pair(v, edge_struct());
+      } else {
+        auto S = pbbs::delayed_seq<pair<uintV, W>>(end - start, [&] (size_t j) {
+          return make_pair(get<1>(E[start + j]), get<2>(E[start + j])); });
+        new_verts[i] = make_pair(v, edge_struct(S, v));
+      }
+    }, 1);
+
+    auto find_start = [&] (uintV v) {
+      size_t lo = 0, hi = num_starts;
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (get<0>(E[starts[mid]]) < v) lo = mid + 1;
+        else hi = mid;
+      }
+      return lo;
+    };
+
+    auto replace = [&] (const uintV& v, const edge_struct& a, const edge_struct& b) {
+      size_t start, end; std::tie(start, end) = vertex_range(find_start(v));
+      auto S = pbbs::delayed_seq<pair<uintV, W>>(end - start, [&] (size_t j) {
+        return make_pair(get<1>(E[start + j]), get<2>(E[start + j])); });
+      auto ret = weighted_tree_plus::insert(a, v, S, combine);
+
+      compressed_lists::deallocate(a.plus);
+      weighted_tree_plus::Tree_GC::decrement_recursive(a.root);
+      return ret;
+    };
+
+    auto V_next = vertices_tree::multi_insert_sorted_with_values(V.root, new_verts.begin(), num_starts, replace, true);
+    return sym_immutable_graph_weighted(std::move(V_next));
+  }
+
+  // Inserts a batch of weighted edges; the weight of an existing edge is
+  // replaced by the new weight.
+  sym_immutable_graph_weighted insert_edges_batch(size_t m, weighted_edge* edges, bool sorted=false) const {
+    auto replace = [] (const W& a, const W& b) { return b; };
+    return insert_edges_batch(m, edges, replace, sorted);
+  }
+
+  sym_immutable_graph_weighted delete_edges_batch(size_t m, edge* edges, bool sorted=false) const {
+    auto E_orig = pbbs::make_range(edges, edges + m);
+    if (!sorted) {
+      pbbs::sample_sort_inplace(E_orig, std::less<edge>());
+    }
+    auto keep = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == 0 || E_orig[i] != E_orig[i-1]) && V.contains(get<0>(E_orig[i]));
+    });
+    auto E = pbbs::pack(E_orig, keep);
+    m = E.size();
+
+    auto start_im = pbbs::delayed_seq<bool>(m, [&] (size_t i) {
+      return (i == 0 || (get<0>(E[i]) != get<0>(E[i-1])));
+    });
+    auto starts = pbbs::pack_index<size_t>(start_im);
+    size_t num_starts = starts.size();
+    auto vertex_range = [&] (size_t i) {
+      size_t end = (i == (num_starts-1)) ? m : starts[i+1];
+      return make_pair(starts[i], end);
+    };
+    auto find_start = [&] (uintV v) {
+      size_t lo = 0, hi = num_starts;
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (get<0>(E[starts[mid]]) < v) lo = mid + 1;
+        else hi = mid;
+      }
+      return lo;
+    };
+
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(num_starts, [&] (size_t i) {
+      return make_pair(get<0>(E[starts[i]]), edge_struct());
+    });
+
+    auto replace = [&] (const uintV& v, const edge_struct& a, const edge_struct& b) {
+      size_t start, end; std::tie(start, end) = vertex_range(find_start(v));
+      auto S = pbbs::delayed_seq<uintV>(end - start, [&] (size_t j) { return get<1>(E[start + j]); });
+      auto ret = weighted_tree_plus::remove(a, v, S);
+
+      compressed_lists::deallocate(a.plus);
+      weighted_tree_plus::Tree_GC::decrement_recursive(a.root);
+      return ret;
+    };
+
+    auto V_next = vertices_tree::multi_insert_sorted_with_values(V.root, new_verts.begin(), num_starts, replace, true);
+    return sym_immutable_graph_weighted(std::move(V_next));
+  }
+
+  // Builds a graph from a weighted CSR. Takes ownership of the arrays.
+  sym_immutable_graph_weighted(size_t n, size_t m, uintE* offsets, uintV* edges, W* weights) {
+    init(n, m);
+
+    timer build_t; build_t.start();
+    using KV = pair<uintV, edge_struct>;
+    auto new_verts = pbbs::sequence<KV>(n);
+    parallel_for(0, n, [&] (size_t i) {
+      size_t off = offsets[i];
+      size_t deg = ((i == (n-1)) ? m : offsets[i+1]) - off;
+      auto S = pbbs::delayed_seq<pair<uintV, W>>(deg, [&] (size_t j) {
+        return make_pair(edges[off + j], weights[off + j]); });
+      new_verts[i] = make_pair(i, edge_struct(S, i));
+    }, 1);
+
+    auto replace = [] (const edge_struct& a, const edge_struct& b) {return b;};
+    V = vertices_tree::multi_insert_sorted(nullptr, new_verts.begin(), new_verts.size(), replace, true);
+
+    pbbs::free_array(offsets); pbbs::free_array(edges); pbbs::free_array(weights);
+    build_t.next("Build time");
+  }
+
+  sym_immutable_graph_weighted() {
+    V.root = nullptr;
+  }
+
+  sym_immutable_graph_weighted(vertices _V) : V(std::move(_V)) {}
+
+  size_t size_in_bytes() const {
+    size_t n = num_vertices();
+    auto size_seq = pbbs::sequence<size_t>(n, [&] (size_t i) { return static_cast<size_t>(0); });
+    auto map_f = [&] (const typename vertex_entry::entry_t& E, size_t ind) {
+      size_seq[E.first] = E.second.size_in_bytes();
+    };
+    map_vertices(map_f);
+    size_t edge_list_bytes = pbbs::reduce(size_seq, pbbs::addm<size_t>());
+    return edge_list_bytes + V.size()*vertices::node_size() +
+      weighted_tree_plus::edge_list::used_node()*weighted_tree_plus::edge_list::node_size();
+  }
+
+  void del() {
+    V.~vertices();
+    V.root = nullptr;
+  }
+};
@@ -5,6 +5,8 @@
 
 #include "../../pbbslib/sequence.h"
 
+#include <vector>
+
 #define lists compressed_lists
 //#define lists uncompressed_lists
 //#define CHECK_CORRECTNESS 1
@@ -111,6 +113,35 @@ namespace tree_plus {
       T.root = nullptr;
     }
 
+    // As map_elms, but only over the plus array (if lo == 0) and the tree
+    // nodes whose first edge has an offset in [lo, hi). Each tree node decodes
+    // independently, so the ranges [0, k), [k, 2k), ... split the edges of a
+    // vertex into pieces of about k edges that can be mapped in parallel.
+    // Sequential within the range.
+    template <class F>
+    void map_elms_range(uintV src, size_t lo, size_t hi, F f) const {
+      size_t plus_size = 0;
+      if (plus) {
+        if (lo == 0) lists::map_array(plus, src, 0, f);
+        plus_size = lists::node_size(plus);
+      }
+      map_range_rec(root, plus_size, lo, hi, src, f);
+    }
+
+    template <class F>
+    static void map_range_rec(Node* a, size_t start, size_t lo, size_t hi, uintV src, const F& f) {
+      // start is the offset of the first edge in a's subtree
+      if (!a || start >= hi || start + Tree::aug_val(a) <= lo) return;
+      size_t s = start + Tree::aug_val(a->lc);
+      const Entry& entry = Tree::get_entry(a);
+      map_range_rec(a->lc, start, lo, hi, src, f);
+      if (lo <= s && s < hi) {
+        f(entry.first, s);
+        lists::map_array(entry.second, src, s + 1, f);
+      }
+      map_range_rec(a->rc, s + 1 + lists::node_size(entry.second), lo, hi, src, f);
+    }
+
     template <class F>
     bool iter_elms_cond(uintV src, F f) const {
       bool res = false;
@@ -280,6 +311,26 @@ namespace tree_plus {
       return n_bytes;
     }
 
+    // The bytes referenced only by this edge list, i.e. what deleting it would
+    // free. Stops at nodes that are shared with other versions.
+    size_t unshared_bytes() const {
+      size_t n_bytes = 0;
+      if (plus && lists::get_ref_ct(plus) == 1) {
+        n_bytes += lists::underlying_array_size(plus);
+      }
+      return n_bytes + unshared_tree_bytes(root);
+    }
+
+    static size_t unshared_tree_bytes(Node* t) {
+      if (!t || t->ref_cnt > 1) return 0;
+      size_t n_bytes = edge_list::node_size();
+      const Entry& entry = Tree::get_entry(t);
+      if (entry.second && lists::get_ref_ct(entry.second) == 1) {
+        n_bytes += lists::underlying_array_size(entry.second);
+      }
+      return n_bytes + unshared_tree_bytes(t->lc) + unshared_tree_bytes(t->rc);
+    }
+
     struct num_nodes_struct {
       using t = size_t;
       num_nodes_struct() {}
@@ -439,6 +490,37 @@ namespace tree_plus {
       if (S.size() > start_array_size) { pbbs::free_array(starts); }
       if (head_indices.size() > kv_arr_size) { pbbs::free_array(kvs); }
     }
+
+    // Builds a treeplus from neighbors that are produced in sorted order, and
+    // without duplicates, by stream(emit), which calls emit(ngh) once per
+    // neighbor. Each chunk is encoded as soon as the next head arrives, so only
+    // the chunk being filled is buffered and the neighbors are never
+    // materialized as a whole. Runs sequentially.
+    template <class Stream>
+    static treeplus from_stream(uintV src, const Stream& stream) {
+      using KV = pair<uintV, AT*>;
+      std::vector<uintV> chunk;
+      std::vector<KV> kvs;
+      AT* plus = nullptr;
+      auto finish_chunk = [&] () {
+        if (kvs.size() == 0) {
+          plus = lists::generate_plus(chunk, chunk.size(), src);
+        } else {
+          kvs.back().second = lists::generate_tree_node(kvs.back().first, src, chunk, 0, chunk.size());
+        }
+        chunk.clear();
+      };
+      stream([&] (uintV ngh) {
+        if (lists::is_head(ngh)) {
+          finish_chunk();
+          kvs.push_back(make_pair(ngh, (AT*)nullptr));
+        } else {
+          chunk.push_back(ngh);
+        }
+      });
+      finish_chunk();
+      return treeplus(plus, Tree::from_array(kvs.data(), kvs.size()));
+    }
   };
 
   // Identical to a tree_plus; separating as this version of the object and
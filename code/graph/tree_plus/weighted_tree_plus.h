@@ -0,0 +1,340 @@
+#pragma once
+
+#include "compressed_iter_weighted.h"
+
+#include "../../pbbslib/sequence.h"
+
+#include <vector>
+
+// A C-tree over (neighbor, weight) pairs. The structure mirrors tree_plus: a
+// prefix (plus) of the non-head neighbors, followed by a tree keyed by the
+// head neighbors. Unlike tree_plus, the chunk stored with a head also holds
+// the head itself (as its first element), so that the head's weight lives in
+// the same packed weight array as the rest of its chunk.
+namespace weighted_tree_plus {
+
+  using AT = compressed_lists::array_type;
+  namespace wlists = compressed_weighted_lists;
+
+  struct edge_entry {
+    using key_t = uintV; // the 'head' edge of this node.
+    using val_t = AT*; // the head and the edges following it.
+    static bool comp(const key_t& a, const key_t& b) { return a < b; }
+    using aug_t = uintV; // num. edges in this subtree
+    static aug_t get_empty() { return 0; }
+    static aug_t from_entry(const key_t& k, const val_t& v) { return wlists::node_size(v); }
+    static aug_t combine(const aug_t& a, const aug_t& b) { return a + b; }
+    using entry_t = std::pair<key_t,val_t>;
+    static entry_t copy_entry(const entry_t& e) {
+      return make_pair(e.first, wlists::copy_node(e.second));
+    }
+    static void del(entry_t& e) {
+      if (e.second) {
+        wlists::deallocate(e.second);
+      }
+    }
+  };
+  using edge_list = aug_map<edge_entry>;
+
+  using Tree = edge_list::Tree;
+  using Node = edge_list::node;
+  using Entry = typename edge_entry::entry_t; // pair<uintV, node>
+  using Tree_GC = Tree::GC;
+
+  template <class W>
+  struct treeplus {
+    using Tree = typename edge_list::Tree;
+    using Node = typename edge_list::node;
+    using Entry = typename edge_entry::entry_t;
+    using Tree_GC = Tree::GC;
+    using weight_t = W;
+
+    AT* plus;
+    Node* root;
+
+    size_t degree() const {
+      size_t deg = 0;
+      if (plus) {
+        deg += wlists::node_size(plus);
+      }
+      if (root) {
+        deg += Tree::aug_val(root);
+      }
+      return deg;
+    }
+    size_t size() const { return degree(); }
+
+    bool empty() const { return root == nullptr && plus == nullptr; }
+
+    // look up the weight of an edge
+    bool find(uintV src, uintV ngh, W& w) const {
+      if (root) {
+        auto mp = Tree::previous_or_eq(root, ngh);
+        if (mp) {
+          return wlists::find<W>(Tree::get_entry(mp).second, src, ngh, w);
+        }
+      }
+      return wlists::find<W>(plus, src, ngh, w);
+    }
+
+    bool contains(uintV src, uintV ngh) const {
+      W w;
+      return find(src, ngh, w);
+    }
+
+    // f: (ngh, weight, offset) -> void
+    template <class F>
+    void map_elms(uintV src, F f) const {
+      size_t plus_size = 0;
+      if (plus) {
+        wlists::map_array<W>(plus, src, 0, f);
+        plus_size = wlists::node_size(plus);
+      }
+      auto get_aug_size = [&] (Node* a) -> uintV {
+        return Tree::aug_val(a);
+      };
+      auto get_size = [&] (Node* a) -> uintV {
+        return wlists::node_size(Tree::get_entry(a).second);
+      };
+      auto map_f = [&] (const Entry& entry, size_t start_offset) {
+        wlists::map_array<W>(entry.second, src, plus_size + start_offset, f);
+      };
+      auto T = edge_list(); T.root = root;
+      T.map_elms_entry(map_f, get_aug_size, get_size);
+      T.root = nullptr;
+    }
+
+    // f: (ngh, weight) -> bool (true to stop)
+    template <class F>
+    bool iter_elms_cond(uintV src, F f) const {
+      bool res = false;
+      if (plus) {
+        res = wlists::iter_elms_cond<W>(plus, src, f);
+      }
+      if (!res && root) {
+        auto iter_f = [&] (const Entry& entry) {
+          return wlists::iter_elms_cond<W>(entry.second, src, f);
+        };
+        auto T = edge_list(); T.root = root;
+        res = T.iter_elms_cond(iter_f);
+        T.root = nullptr;
+      }
+      return res;
+    }
+
+    // f: (ngh, weight) -> void
+    template <class F>
+    void iter_elms(uintV src, F f) const {
+      if (plus) {
+        wlists::iter_elms<W>(plus, src, f);
+      }
+      if (root) {
+        auto iter_f = [&] (const Entry& entry) {
+          wlists::iter_elms<W>(entry.second, src, f);
+        };
+        auto T = edge_list(); T.root = root;
+        T.iter_elms(iter_f);
+        T.root = nullptr;
+      }
+    }
+
+    size_t size_in_bytes() const {
+      size_t n_bytes = compressed_lists::underlying_array_size(plus);
+      auto iter_f = [&] (const Entry& entry) {
+        n_bytes += compressed_lists::underlying_array_size(entry.second);
+      };
+      auto T = edge_list(); T.root = root;
+      T.iter_elms(iter_f);
+      T.root = nullptr;
+      return n_bytes;
+    }
+
+    void del() {
+      wlists::deallocate(plus);
+      auto T = edge_list(); T.root = root;
+    }
+
+    treeplus(AT* _plus, Node* _root) : plus(_plus), root(_root) {}
+    treeplus() : plus(nullptr), root(nullptr) {}
+
+    // Builds a treeplus from S, a sorted sequence of (ngh, weight) pairs with
+    // distinct neighbors.
+    template <class SQ>
+    treeplus(SQ const &S, uintV src, pbbs::flags fl = pbbs::no_flag) {
+      plus = nullptr; root = nullptr;
+      size_t n = S.size();
+      if (n == 0) return;
+      bool run_seq = fl & pbbs::fl_sequential;
+
+      auto is_head_seq = pbbs::delayed_seq<bool>(n, [&] (size_t i) { return wlists::is_head(std::get<0>(S[i])); });
+      auto head_indices = pbbs::pack_index<size_t>(is_head_seq, fl);
+      size_t k = head_indices.size();
+      size_t first_head = (k > 0) ? head_indices[0] : n;
+
+      plus = wlists::generate_node<W>(src, S, 0, first_head);
+      if (k > 0) {
+        auto kvs = pbbs::sequence<Entry>(k);
+        parallel_for(0, k, [&] (size_t i) {
+          size_t start = head_indices[i];
+          size_t end = (i == (k-1)) ? n : head_indices[i+1];
+          kvs[i] = make_pair(std::get<0>(S[start]), wlists::generate_node<W>(src, S, start, end));
+        }, run_seq ? std::numeric_limits<long>::max() : 5);
+        root = Tree::from_array(kvs.begin(), k);
+      }
+    }
+  };
+
+  // Rebuilds the chunks of T affected by a sorted batch of updates.
+  //
+  // The chunks of T partition its neighbors into key ranges: the plus covers
+  // [0, first head), and each head's chunk covers [head, next head). Chunks
+  // whose range contains no update are shared with T (their ref-ct is bumped).
+  // The remaining chunks are decoded, merged with their updates by
+  // merge_range(elms, start, end) (which returns the new sorted elements of
+  // the range), and re-chunked at the heads. If a head is deleted, the rest of
+  // its chunk is appended to the preceding chunk. The work is
+  // O(#chunks + #affected chunks * b) per vertex, where b is the expected
+  // chunk size; T itself is not modified.
+  template <class W, class K, class M>
+  treeplus<W> rebuild(treeplus<W> const& T, uintV src, size_t num_updates, K const& update_key, M const& merge_range) {
+    using EW = std::pair<uintV, W>;
+    std::vector<Entry> segments;
+    if (T.root) {
+      auto E = edge_list(); E.root = T.root;
+      E.iter_elms([&] (const Entry& entry) { segments.push_back(entry); });
+      E.root = nullptr;
+    }
+
+    AT* out_plus = nullptr;
+    std::vector<Entry> out_tree;
+
+    bool has_pending = false;
+    bool pending_is_plus = false;
+    uintV pending_key = 0;
+    std::vector<EW> pending;
+
+    auto decode = [&] (AT* node, std::vector<EW>& out) {
+      wlists::iter_elms<W>(node, src, [&] (const uintV& ngh, const W& w) {
+        out.push_back(std::make_pair(ngh, w));
+      });
+    };
+    auto flush = [&] () {
+      AT* node = wlists::generate_node<W>(src, pending, 0, pending.size());
+      if (pending_is_plus) {
+        out_plus = node;
+      } else {
+        assert(node);
+        out_tree.push_back(make_pair(pending_key, node));
+      }
+      pending.clear();
+      has_pending = false;
+    };
+    // re-opens the last emitted chunk so that elements can be appended to it
+    auto reopen_last = [&] () {
+      if (out_tree.size() > 0) {
+        auto last = out_tree.back(); out_tree.pop_back();
+        pending_is_plus = false;
+        pending_key = last.first;
+        decode(last.second, pending);
+        wlists::deallocate(last.second);
+      } else {
+        pending_is_plus = true;
+        decode(out_plus, pending);
+        wlists::deallocate(out_plus);
+        out_plus = nullptr;
+      }
+      has_pending = true;
+    };
+
+    std::vector<EW> elms;
+    size_t j = 0;
+    for (size_t s = 0; s <= segments.size(); s++) {
+      bool is_plus = (s == 0);
+      AT* node = is_plus ? T.plus : segments[s-1].second;
+      bool last_seg = (s == segments.size());
+      size_t j_end = j;
+      while (j_end < num_updates && (last_seg || update_key(j_end) < segments[s].first)) {
+        j_end++;
+      }
+
+      if (j == j_end) { // untouched: share the chunk
+        if (has_pending) flush();
+        if (is_plus) {
+          out_plus = wlists::copy_node(node);
+        } else {
+          out_tree.push_back(make_pair(segments[s-1].first, wlists::copy_node(node)));
+        }
+        continue;
+      }
+
+      elms.clear();
+      decode(node, elms);
+      auto merged = merge_range(elms, j, j_end);
+      for (const auto& e : merged) {
+        if (wlists::is_head(e.first)) {
+          if (has_pending) flush();
+          has_pending = true; pending_is_plus = false; pending_key = e.first;
+        } else if (!has_pending) {
+          reopen_last();
+        }
+        pending.push_back(e);
+      }
+      j = j_end;
+    }
+    if (has_pending) flush();
+
+    Node* root = nullptr;
+    if (out_tree.size() > 0) {
+      root = Tree::from_array(out_tree.data(), out_tree.size());
+    }
+    return treeplus<W>(out_plus, root);
+  }
+
+  // Returns T with the edges in S inserted, where S is a sorted sequence of
+  // (ngh, weight) pairs with distinct neighbors. The weight of an edge that is
+  // already present becomes combine(old weight, new weight).
+  template <class W, class SQ, class C>
+  treeplus<W> insert(treeplus<W> const& T, uintV src, SQ const& S, C const& combine) {
+    using EW = std::pair<uintV, W>;
+    auto update_key = [&] (size_t i) { return std::get<0>(S[i]); };
+    auto merge_range = [&] (std::vector<EW> const& elms, size_t start, size_t end) {
+      std::vector<EW> out;
+      out.reserve(elms.size() + end - start);
+      size_t i = 0, j = start;
+      while (i < elms.size() && j < end) {
+        uintV a = elms[i].first, b = std::get<0>(S[j]);
+        if (a < b) {
+          out.push_back(elms[i++]);
+        } else if (a > b) {
+          out.push_back(std::make_pair(b, std::get<1>(S[j++])));
+        } else {
+          out.push_back(std::make_pair(a, combine(elms[i++].second, std::get<1>(S[j++]))));
+        }
+      }
+      for (; i < elms.size(); i++) out.push_back(elms[i]);
+      for (; j < end; j++) out.push_back(std::make_pair(std::get<0>(S[j]), std::get<1>(S[j])));
+      return out;
+    };
+    return rebuild(T, src, S.size(), update_key, merge_range);
+  }
+
+  // Returns T with the neighbors in S (sorted, distinct) removed.
+  template <class W, class SQ>
+  treeplus<W> remove(treeplus<W> const& T, uintV src, SQ const& S) {
+    using EW = std::pair<uintV, W>;
+    auto update_key = [&] (size_t i) { return S[i]; };
+    auto merge_range = [&] (std::vector<EW> const& elms, size_t start, size_t end) {
+      std::vector<EW> out;
+      out.reserve(elms.size());
+      size_t j = start;
+      for (const auto& e : elms) {
+        while (j < end && S[j] < e.first) j++;
+        if (j < end && S[j] == e.first) continue;
+        out.push_back(e);
+      }
+      return out;
+    };
+    return rebuild(T, src, S.size(), update_key, merge_range);
+  }
+
+} // namespace weighted_tree_plus
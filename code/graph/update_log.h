@@ -0,0 +1,346 @@
+#pragma once
+
+// An append-only, group-committed write-ahead log of edge updates applied
+// through versioned_graph, and a replay routine that re-applies a log on top
+// of a graph (e.g. one loaded from a snapshot).
+//
+// Each record holds one batch passed to insert_edges_batch or
+// delete_edges_batch:
+//   log_record_header | tuple<uintV, uintV>[num_edges]
+// The writer appends a record before the new version is made visible.
+// Records are buffered and handed to a flusher thread as a group once the
+// buffer holds group_bytes, or once group_usec have elapsed since the oldest
+// buffered record. The flusher writes and fdatasyncs the group while the
+// writer keeps filling the other buffer, so the writer only blocks on I/O when
+// both buffers are full. A crash can lose at most the groups that have not
+// been synced yet; sync() waits until everything appended so far is durable.
+// Setting group_usec = 0 syncs every record before append returns.
+#include "../common/types.h"
+#include "../common/IO.h"
+#include "../pbbslib/seq.h"
+#include "../pbbslib/sample_sort.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct update_log {
+  static constexpr const uint32_t record_magic = 0x474f4c41; // "ALOG"
+  enum op_t : uint32_t { insert_op = 0, delete_op = 1 };
+  using edge = tuple<uintV, uintV>;
+  using clock = std::chrono::steady_clock;
+
+  struct log_record_header {
+    uint32_t magic;
+    uint32_t op;
+    uint32_t timestamp; // timestamp of the version this batch creates
+    uint32_t vtx_bytes;
+    uint64_t num_edges;
+    uint64_t checksum; // over the edges of this record
+  };
+
+  int fd;
+  size_t group_bytes;
+  size_t group_usec;
+
+  // buf is filled by the writer; flush_buf is owned by the flusher while
+  // flushing is set.
+  char* buf;
+  size_t buf_used;
+  clock::time_point oldest_unsynced;
+  char* flush_buf;
+  size_t flush_used;
+  bool flushing;
+  bool stopping;
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::thread flusher;
+
+  // statistics
+  size_t num_records;
+  size_t num_groups;
+  size_t bytes_written;
+
+  static uint64_t checksum(size_t m, const edge* edges) {
+    auto hashes = pbbs::delayed_seq<uint64_t>(m, [&] (size_t i) {
+      uint64_t e = (static_cast<uint64_t>(get<0>(edges[i])) << 32UL) | static_cast<uint64_t>(get<1>(edges[i]));
+      return pbbs::hash64(e + i);
+    });
+    return pbbs::reduce(hashes, pbbs::addm<uint64_t>());
+  }
+
+  // Returns the number of leading bytes of s that form complete, valid records.
+  // A torn record at the tail (e.g. from a crash mid-write) is not counted.
+  static size_t valid_prefix(char* s, size_t s_size) {
+    size_t off = 0;
+    while (off + sizeof(log_record_header) <= s_size) {
+      auto H = (log_record_header*)(s + off);
+      size_t rec_bytes = sizeof(log_record_header) + H->num_edges*sizeof(edge);
+      if (H->magic != record_magic || H->vtx_bytes != sizeof(uintV) ||
+          off + rec_bytes > s_size) {
+        break;
+      }
+      auto E = (edge*)(s + off + sizeof(log_record_header));
+      if (checksum(H->num_edges, E) != H->checksum) break;
+      off += rec_bytes;
+    }
+    return off;
+  }
+
+  static size_t file_size(const char* fname) {
+    struct stat sb;
+    if (stat(fname, &sb) == -1) return 0;
+    return sb.st_size;
+  }
+
+  // Opens fname for appending. Any torn record at the end of an existing log
+  // is truncated away so that new records follow the last valid one.
+  update_log(const char* fname, size_t _group_bytes=(1 << 20), size_t _group_usec=1000) :
+      group_bytes(_group_bytes), group_usec(_group_usec), buf_used(0),
+      flush_used(0), flushing(false), stopping(false),
+      num_records(0), num_groups(0), bytes_written(0) {
+    size_t valid_bytes = 0;
+    size_t sz = file_size(fname);
+    if (sz > 0) {
+      auto SS = mmapStringFromFile(fname);
+      valid_bytes = valid_prefix(SS.first, SS.second);
+      munmap(SS.first, SS.second);
+      if (valid_bytes < sz) {
+        cout << "update_log: truncating " << (sz - valid_bytes) << " bytes of torn records from " << fname << endl;
+      }
+    }
+    fd = open(fname, O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) {
+      perror("open");
+      exit(-1);
+    }
+    if (ftruncate(fd, valid_bytes) == -1 || lseek(fd, valid_bytes, SEEK_SET) == -1) {
+      perror("ftruncate");
+      exit(-1);
+    }
+    buf = (char*)malloc(group_bytes);
+    flush_buf = (char*)malloc(group_bytes);
+    flusher = std::thread([&] () { flush_loop(); });
+  }
+
+  ~update_log() {
+    sync();
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      stopping = true;
+    }
+    cv.notify_all();
+    flusher.join();
+    close(fd);
+    free(buf);
+    free(flush_buf);
+  }
+
+  void write_all(const char* data, size_t len) {
+    while (len > 0) {
+      ssize_t w = write(fd, data, len);
+      if (w == -1) {
+        if (errno == EINTR) continue;
+        perror("write");
+        exit(-1);
+      }
+      data += w; len -= w;
+      bytes_written += w;
+    }
+  }
+
+  void write_and_sync(const char* data, size_t len) {
+    write_all(data, len);
+    if (fdatasync(fd) == -1) {
+      perror("fdatasync");
+      exit(-1);
+    }
+  }
+
+  void flush_loop() {
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+      cv.wait(lk, [&] { return flushing || stopping; });
+      if (flushing) {
+        lk.unlock();
+        write_and_sync(flush_buf, flush_used);
+        lk.lock();
+        flush_used = 0;
+        flushing = false;
+        cv.notify_all();
+      } else if (stopping) {
+        return;
+      }
+    }
+  }
+
+  void wait_for_flusher() {
+    std::unique_lock<std::mutex> lk(mtx);
+    cv.wait(lk, [&] { return !flushing; });
+  }
+
+  // Hands the buffered records to the flusher, waiting for it to finish the
+  // previous group if needed.
+  void start_group() {
+    if (buf_used == 0) return;
+    std::unique_lock<std::mutex> lk(mtx);
+    cv.wait(lk, [&] { return !flushing; });
+    std::swap(buf, flush_buf);
+    flush_used = buf_used;
+    buf_used = 0;
+    flushing = true;
+    num_groups++;
+    cv.notify_all();
+  }
+
+  // Returns once all records appended so far are written and synced.
+  void sync() {
+    start_group();
+    wait_for_flusher();
+  }
+
+  // Called by the (single) writer before the version created by this batch
+  // is made visible.
+  void append(op_t op, uint32_t timestamp, size_t m, const edge* edges) {
+    log_record_header H;
+    H.magic = record_magic;
+    H.op = op;
+    H.timestamp = timestamp;
+    H.vtx_bytes = sizeof(uintV);
+    H.num_edges = m;
+    H.checksum = checksum(m, edges);
+    size_t edge_bytes = m*sizeof(edge);
+    size_t rec_bytes = sizeof(log_record_header) + edge_bytes;
+
+    if (buf_used + rec_bytes > group_bytes) {
+      start_group();
+    }
+    num_records++;
+    if (rec_bytes > group_bytes) { // too large to buffer; write directly
+      wait_for_flusher();
+      write_all((char*)&H, sizeof(log_record_header));
+      write_and_sync((char*)edges, edge_bytes);
+      num_groups++;
+      return;
+    }
+    if (buf_used == 0) {
+      oldest_unsynced = clock::now();
+    }
+    std::memcpy(buf + buf_used, &H, sizeof(log_record_header));
+    std::memcpy(buf + buf_used + sizeof(log_record_header), edges, edge_bytes);
+    buf_used += rec_bytes;
+
+    if (group_usec == 0) {
+      sync();
+    } else if (std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - oldest_unsynced).count() >= (long)group_usec) {
+      // don't wait for an in-progress group; keep filling buf meanwhile
+      bool idle;
+      {
+        std::lock_guard<std::mutex> lk(mtx);
+        idle = !flushing;
+      }
+      if (idle) start_group();
+    }
+  }
+
+  // Appends a batch of tagged updates that touch distinct edges, as one
+  // deletion record followed by one insertion record.
+  void append(uint32_t timestamp, size_t m, const edge_update* updates) {
+    auto all_edges = pbbs::delayed_seq<edge>(m, [&] (size_t i) { return make_tuple(get<0>(updates[i]), get<1>(updates[i])); });
+    auto del_flags = pbbs::delayed_seq<bool>(m, [&] (size_t i) { return !get<2>(updates[i]); });
+    auto ins_flags = pbbs::delayed_seq<bool>(m, [&] (size_t i) { return get<2>(updates[i]); });
+    auto deletes = pbbs::pack(all_edges, del_flags);
+    auto inserts = pbbs::pack(all_edges, ins_flags);
+    if (deletes.size() > 0) append(delete_op, timestamp, deletes.size(), deletes.begin());
+    if (inserts.size() > 0) append(insert_op, timestamp, inserts.size(), inserts.begin());
+  }
+
+  void print_stats() {
+    cout << "update_log: records = " << num_records << " groups = " << num_groups
+         << " bytes written = " << bytes_written << endl;
+    if (num_groups > 0) {
+      cout << "update_log: avg records per group = " << ((1.0*num_records) / num_groups) << endl;
+    }
+  }
+
+  // Replays the records in fname with timestamp >= from_ts on top of VG.
+  //
+  // Consecutive records are coalesced into windows of about batch_size edges.
+  // Within a window only the last update to each edge matters, so the window
+  // is sorted by (edge, position), reduced to the last update per edge, and
+  // applied as one mixed batch. Since updates have set semantics, replaying a
+  // prefix of the log that is already reflected in VG is harmless. Replay
+  // before attaching a log to VG, otherwise the replayed batches are logged
+  // again.
+  template <class VG>
+  static size_t replay(VG& vg, const char* fname, uint32_t from_ts=0, size_t batch_size=(1 << 24)) {
+    size_t sz = file_size(fname);
+    if (sz == 0) return 0;
+    timer replay_t; replay_t.start();
+    auto SS = mmapStringFromFile(fname);
+    char* s = SS.first;
+    size_t s_size = valid_prefix(s, SS.second);
+
+    struct logged_update {
+      edge e;
+      size_t pos;
+      bool insert;
+    };
+
+    size_t num_replayed = 0;
+    size_t num_batches = 0;
+    size_t off = 0;
+    while (off < s_size) {
+      // 1. collect a window of records
+      size_t window_end = off;
+      size_t window_edges = 0;
+      while (window_end < s_size && window_edges < batch_size) {
+        auto H = (log_record_header*)(s + window_end);
+        if (H->timestamp >= from_ts) window_edges += H->num_edges;
+        window_end += sizeof(log_record_header) + H->num_edges*sizeof(edge);
+      }
+      auto U = pbbs::sequence<logged_update>(window_edges);
+      size_t k = 0;
+      for (size_t rec = off; rec < window_end; ) {
+        auto H = (log_record_header*)(s + rec);
+        auto E = (edge*)(s + rec + sizeof(log_record_header));
+        if (H->timestamp >= from_ts) {
+          bool ins = (H->op == insert_op);
+          parallel_for(0, H->num_edges, [&] (size_t i) {
+            U[k + i] = {E[i], k + i, ins};
+          });
+          k += H->num_edges;
+        }
+        rec += sizeof(log_record_header) + H->num_edges*sizeof(edge);
+      }
+      off = window_end;
+      if (window_edges == 0) continue;
+
+      // 2. keep the last update to each edge
+      pbbs::sample_sort_inplace(U.slice(), [&] (const logged_update& a, const logged_update& b) {
+        return (a.e < b.e) || (a.e == b.e && a.pos < b.pos);
+      });
+      auto last_flags = pbbs::delayed_seq<bool>(window_edges, [&] (size_t i) {
+        return (i == window_edges-1) || (U[i].e != U[i+1].e);
+      });
+      auto all_updates = pbbs::delayed_seq<edge_update>(window_edges, [&] (size_t i) {
+        return make_tuple(get<0>(U[i].e), get<1>(U[i].e), U[i].insert);
+      });
+      auto updates = pbbs::pack(all_updates, last_flags);
+
+      // 3. apply
+      vg.apply_updates_batch(updates.size(), updates.begin(), /*sorted=*/true);
+      num_replayed += window_edges;
+      num_batches++;
+    }
+
+    munmap(s, SS.second);
+    cout << "update_log: replayed " << num_replayed << " updates in " << num_batches << " batches" << endl;
+    replay_t.next("Log replay time");
+    return num_replayed;
+  }
+};
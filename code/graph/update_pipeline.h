@@ -0,0 +1,200 @@
+#pragma once
+
+// A pipeline that ingests edge updates from many producer threads and applies
+// them to a versioned_graph in batches.
+//
+// Producers append updates to a staging buffer. A sorting thread cuts the
+// staging buffer into a batch once it holds max_batch updates, or once its
+// oldest update is publish_usec old, and prepares the batch: it is sorted by
+// edge and reduced to the last update to each edge. The writer (the thread that calls run()) applies
+// each prepared batch to the graph as a single version, so batch k+1 is sorted while batch k is
+// merged into the trees, and the staging buffer keeps filling meanwhile. When
+// the writer falls behind, batches grow, which amortizes the per-batch cost of
+// the merge.
+//
+// Updates from one producer are applied in the order they were submitted.
+// Only the writer uses the parallel scheduler; the producers and the sorting
+// thread must not, since they are not scheduler workers.
+#include "../common/types.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+template <class VG>
+struct update_pipeline {
+  using edge = tuple<uintV, uintV>;
+  using clock = std::chrono::steady_clock;
+
+  struct staged_update {
+    edge e;
+    bool insert;
+  };
+
+  struct prepared_batch {
+    std::vector<edge_update> updates; // sorted by edge
+    size_t num_updates; // before combining updates to the same edge
+  };
+
+  VG& vg;
+  size_t max_batch;
+  size_t publish_usec;
+  size_t max_prepared; // prepared batches waiting for the writer
+
+  std::mutex mtx;
+  std::condition_variable staged_cv;   // signals the sorting thread
+  std::condition_variable prepared_cv; // signals the writer
+  std::condition_variable done_cv;     // signals flush()
+
+  std::vector<staged_update> staging;
+  clock::time_point oldest_staged;
+  std::deque<prepared_batch> prepared;
+  bool closed;
+  bool sorter_done;
+  size_t num_submitted;
+  size_t num_published;
+  std::thread sorter;
+
+  // statistics
+  size_t num_batches;
+  double sort_time;
+  double merge_time;
+
+  update_pipeline(VG& _vg, size_t _max_batch=(1 << 16), size_t _publish_usec=1000,
+                  size_t _max_prepared=1) :
+      vg(_vg), max_batch(_max_batch), publish_usec(_publish_usec),
+      max_prepared(_max_prepared), closed(false), sorter_done(false),
+      num_submitted(0), num_published(0), num_batches(0),
+      sort_time(0.0), merge_time(0.0) {
+    sorter = std::thread([&] () { sort_loop(); });
+  }
+
+  ~update_pipeline() {
+    close();
+    if (sorter.joinable()) sorter.join();
+  }
+
+  void submit(size_t m, const edge* E, bool insert) {
+    if (m == 0) return;
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      if (staging.size() == 0) oldest_staged = clock::now();
+      for (size_t i=0; i<m; i++) {
+        staging.push_back({E[i], insert});
+      }
+      num_submitted += m;
+    }
+    staged_cv.notify_one();
+  }
+
+  // Thread-safe; can be called by any number of producers.
+  void insert_edges(size_t m, const edge* E) { submit(m, E, true); }
+  void delete_edges(size_t m, const edge* E) { submit(m, E, false); }
+
+  // No more updates will be submitted. run() returns once all staged updates
+  // are published.
+  void close() {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      closed = true;
+    }
+    staged_cv.notify_all();
+  }
+
+  // Waits until every update submitted so far is visible in the graph.
+  void flush() {
+    std::unique_lock<std::mutex> lk(mtx);
+    size_t target = num_submitted;
+    staged_cv.notify_all();
+    done_cv.wait(lk, [&] { return num_published >= target; });
+  }
+
+  // Sorts S by edge (stably, so that arrival order is kept for each edge) and
+  // keeps the last update to each edge.
+  static prepared_batch prepare(std::vector<staged_update>& S) {
+    std::stable_sort(S.begin(), S.end(), [&] (const staged_update& a, const staged_update& b) {
+      return a.e < b.e;
+    });
+    prepared_batch B;
+    B.num_updates = S.size();
+    for (size_t i=0; i<S.size(); i++) {
+      if (i + 1 < S.size() && S[i].e == S[i+1].e) continue;
+      B.updates.push_back(make_tuple(get<0>(S[i].e), get<1>(S[i].e), S[i].insert));
+    }
+    return B;
+  }
+
+  void sort_loop() {
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+      // wait for a full batch, an old enough update, or close()
+      while (true) {
+        bool room = prepared.size() < max_prepared;
+        if (staging.size() > 0 && room) {
+          if (closed || staging.size() >= max_batch) break;
+          auto deadline = oldest_staged + std::chrono::microseconds(publish_usec);
+          if (clock::now() >= deadline) break;
+          staged_cv.wait_until(lk, deadline);
+        } else if (staging.size() == 0 && closed) {
+          sorter_done = true;
+          prepared_cv.notify_all();
+          return;
+        } else {
+          staged_cv.wait(lk);
+        }
+      }
+      std::vector<staged_update> S;
+      S.swap(staging);
+      lk.unlock();
+
+      timer t; t.start();
+      auto B = prepare(S);
+      double tm = t.stop();
+
+      lk.lock();
+      sort_time += tm;
+      prepared.push_back(std::move(B));
+      prepared_cv.notify_one();
+    }
+  }
+
+  // The writer loop. Applies prepared batches until close() has been called
+  // and every update has been published. Must be called from a scheduler
+  // worker (e.g. the main thread).
+  void run() {
+    while (true) {
+      prepared_batch B;
+      {
+        std::unique_lock<std::mutex> lk(mtx);
+        prepared_cv.wait(lk, [&] { return prepared.size() > 0 || sorter_done; });
+        if (prepared.size() == 0) return;
+        B = std::move(prepared.front());
+        prepared.pop_front();
+      }
+      staged_cv.notify_one(); // room for the next prepared batch
+
+      timer t; t.start();
+      vg.apply_updates_batch(B.updates.size(), B.updates.data(), /*sorted=*/true);
+      merge_time += t.stop();
+
+      {
+        std::lock_guard<std::mutex> lk(mtx);
+        num_published += B.num_updates;
+        num_batches++;
+      }
+      done_cv.notify_all();
+    }
+  }
+
+  void print_stats() {
+    cout << "update_pipeline: updates = " << num_published << " batches = " << num_batches << endl;
+    if (num_batches > 0) {
+      cout << "update_pipeline: avg batch size = " << ((1.0*num_published) / num_batches)
+           << " sort time = " << sort_time << " merge time = " << merge_time << endl;
+    }
+  }
+};
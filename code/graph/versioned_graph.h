@@ -4,9 +4,17 @@
 // graph and commit new versions, making them readable.
 #include "tree_plus/immutable_graph_tree_plus.h"
 #include "traversible_graph.h"
+#include "incremental_connectivity.h"
+#include "update_log.h"
+
+#include "versioning_utils.h"
 
 #include "../lib_extensions/sequentialHT.h"
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace refct_utils {
   static uint64_t make_refct(uint32_t current_ts, uint32_t ref_ct) {
@@ -38,6 +46,36 @@ struct versioned_graph {
   using table = sequentialHT<K, V>;
   table live_versions;
 
+  // Optional write-ahead log. Update batches are appended to it before the
+  // version they create is made visible.
+  update_log* log = nullptr;
+
+  // Versions kept alive for acquire_version_at. Each holds one reference to
+  // its table entry, and the latest version is always present. Guarded by
+  // retained_mtx; acquire_version does not touch it.
+  struct retained_version {
+    T* table_entry;
+    double published;
+    bool pinned;
+  };
+  std::map<ts, retained_version> retained;
+  retention_policy policy;
+  std::mutex retained_mtx;
+  timer retention_timer;
+
+  // Frees dead versions in the background if set; see reclaim_in_background.
+  std::unique_ptr<version_reclaimer<Node, Node_GC>> reclaimer;
+
+  // Flat snapshots of the live versions, shared by their readers.
+  flat_snapshot_cache<snapshot_graph> flat_cache;
+
+  // Connected components maintained across update batches if set; see
+  // track_connectivity.
+  std::unique_ptr<incremental_connectivity<snapshot_graph>> connectivity;
+
+  // Leaves room in live_versions for versions held by readers.
+  static constexpr size_t live_versions_size = 4096;
+  static constexpr size_t max_retained = live_versions_size / 2;
 
   struct version {
     ts timestamp;
@@ -76,38 +114,44 @@ struct versioned_graph {
   versioned_graph() {
     snapshot_graph::init(100000, 1000000);
     current_timestamp=0;
-    size_t initial_ht_size = 512;
+    size_t initial_ht_size = live_versions_size;
     typename table::T empty = make_tuple(max_ts, make_tuple(0, nullptr));
     live_versions = table(initial_ht_size, empty, tombstone);
 
     auto initial_graph = nullptr;
     ts timestamp = current_timestamp++;
-    live_versions.insert(make_tuple(timestamp, make_tuple(refct_utils::make_refct(timestamp, 1), std::move(initial_graph))));
+    T* entry = live_versions.insert(make_tuple(timestamp, make_tuple(refct_utils::make_refct(timestamp, 1), std::move(initial_graph))));
+    retain(timestamp, entry);
   }
 
-  versioned_graph(snapshot_graph&& G) {
-    size_t initial_ht_size = 512;
+  versioned_graph(snapshot_graph&& G) : current_timestamp(0) {
+    size_t initial_ht_size = live_versions_size;
     typename table::T empty = make_tuple(max_ts, make_tuple(0, nullptr));
     live_versions = table(initial_ht_size, empty, tombstone);
 
     ts timestamp = current_timestamp++;
-    live_versions.insert(make_tuple(timestamp, make_tuple(refct_utils::make_refct(timestamp, 1), G.get_root())));
+    T* entry = live_versions.insert(make_tuple(timestamp, make_tuple(refct_utils::make_refct(timestamp, 1), G.get_root())));
     G.clear_root();
+    retain(timestamp, entry);
   }
 
   versioned_graph(size_t n, size_t m, uintE* offsets, uintV* edges) : current_timestamp(0) {
-    size_t initial_ht_size = 512;
+    size_t initial_ht_size = live_versions_size;
     typename table::T empty = make_tuple(max_ts, make_tuple(0, nullptr));
     live_versions = table(initial_ht_size, empty, tombstone);
 
     auto G = snapshot_graph(n, m, offsets, edges);
     ts timestamp = current_timestamp++;
-    live_versions.insert(make_tuple(timestamp, make_tuple(refct_utils::make_refct(timestamp, 1), G.get_root())));
+    T* entry = live_versions.insert(make_tuple(timestamp, make_tuple(refct_utils::make_refct(timestamp, 1), G.get_root())));
     G.clear_root();
+    retain(timestamp, entry);
   }
 
+  void attach_log(update_log* _log) { log = _log; }
+
+  // An atomic load, so that acquire_version's retry loop sees new versions.
   ts latest_timestamp() {
-    return current_timestamp-1;
+    return __atomic_load_n(&current_timestamp, __ATOMIC_ACQUIRE) - 1;
   }
 
   // Lock-free, but not wait-free
@@ -126,7 +170,7 @@ struct versioned_graph {
           size_t ts = get<0>(table_ref);
           if (ref_ct_before > 0) {
             if (pbbs::atomic_compare_and_swap(&get<0>(get<1>(table_ref)), refct_and_ts, next_value)) {
-              return version(ts, &table_ref, std::move(snapshot_graph(get<1>(get<1>(table_ref)))));
+              return share_flat(version(ts, &table_ref, std::move(snapshot_graph(get<1>(get<1>(table_ref))))));
             }
           } else { // refct == 0
             break;
@@ -159,8 +203,7 @@ struct versioned_graph {
               assert(root->ref_cnt == 1);
               exit(0);
             }
-            bool ret = Node_GC::decrement_recursive(root); // finish it off
-            assert(ret);
+            free_version(root); // finish it off
           }
 
           typename table::T first_empty = make_tuple(timestamp, make_tuple(0, nullptr));
@@ -173,38 +216,262 @@ struct versioned_graph {
   }
 
 
+  // ======================= Reclamation =======================
+
+  // Hands the freeing of dead versions to num_threads background threads (see
+  // version_reclaimer), each freeing at most nodes_per_second vertex nodes per
+  // second if it is positive. Must be called before the graph is shared.
+  void reclaim_in_background(size_t num_threads=1, size_t nodes_per_second=0) {
+    reclaimer = std::make_unique<version_reclaimer<Node, Node_GC>>(num_threads, nodes_per_second);
+  }
+
+  // Waits until the dead versions released so far are freed.
+  void wait_for_reclamation() {
+    if (reclaimer) reclaimer->wait_idle();
+  }
+
+  // Readers of the same version share flat snapshots through flat_cache.
+  version share_flat(version&& S) {
+    S.graph.flat_cache = &flat_cache;
+    return std::move(S);
+  }
+
+  // Frees the tree of a version that can no longer be acquired.
+  void free_version(Node* root) {
+    if (root) flat_cache.erase(root);
+    if (reclaimer) reclaimer->push(root);
+    else Node_GC::decrement_recursive(root);
+  }
+
+  // ======================= Connectivity =======================
+
+  // Maintains the connected components of the graph from the latest version
+  // on, so that readers can query them with same_component. Versions
+  // published by update_with are not tracked. Must be called before the graph
+  // is shared.
+  void track_connectivity() {
+    auto S = acquire_version();
+    connectivity = std::make_unique<incremental_connectivity<snapshot_graph>>(S.graph, S.timestamp);
+    release_version(std::move(S));
+  }
+
+  // Whether u and v are connected in S, which must not predate
+  // track_connectivity.
+  bool same_component(const version& S, uintV u, uintV v) {
+    return connectivity->same_component(u, v, S.timestamp);
+  }
+
+  // A vertex identifying v's component in S.
+  uintV component_of(const version& S, uintV v) {
+    return connectivity->find(v, S.timestamp);
+  }
+
+  // No reader holds, or can acquire, a version older than this. Writer only.
+  ts oldest_live_timestamp() {
+    ts oldest = latest_timestamp();
+    for (size_t i = 0; i < live_versions.m; i++) {
+      ts t = get<0>(live_versions.table[i]);
+      if (t != max_ts && t != tombstone && t < oldest) oldest = t;
+    }
+    return oldest;
+  }
+
+  // ======================= Retention and time-travel reads =======================
+
+  // Drops the retained versions that the policy no longer keeps, and returns
+  // them. Called with retained_mtx held.
+  std::vector<version> trim() {
+    std::vector<version> dropped;
+    trim_retained(retained, policy, retention_timer.get_time(), max_retained,
+                  [&] (ts t, const retained_version& r) {
+      Node* root = get<1>(get<1>(*r.table_entry));
+      dropped.push_back(version(t, r.table_entry, snapshot_graph(root)));
+    });
+    return dropped;
+  }
+
+  // Releases versions dropped by trim; the caller must not hold
+  // retained_mtx, and must be a scheduler worker since this may free them,
+  // unless they are reclaimed in the background.
+  void release_dropped(std::vector<version>& dropped) {
+    for (auto& S : dropped) {
+      release_version(std::move(S));
+    }
+  }
+
+  // Retains the newly published version t. Writer only.
+  void retain(ts t, T* entry) {
+    pbbs::fetch_and_add(&get<0>(get<1>(*entry)), 1);
+    std::vector<version> dropped;
+    {
+      std::lock_guard<std::mutex> lk(retained_mtx);
+      retained[t] = retained_version{entry, retention_timer.get_time(), false};
+      dropped = trim();
+    }
+    release_dropped(dropped);
+  }
+
+  // Sets which old versions are kept; versions the new policy does not keep
+  // are released immediately. At most max_retained unpinned versions are kept
+  // regardless of the policy.
+  void set_retention(retention_policy _policy) {
+    std::vector<version> dropped;
+    {
+      std::lock_guard<std::mutex> lk(retained_mtx);
+      policy = _policy;
+      dropped = trim();
+    }
+    release_dropped(dropped);
+  }
+
+  // Pins the newest retained version at or before t, keeping it until it is
+  // unpinned. Returns the pinned timestamp, or max_ts if no such version is
+  // retained.
+  ts pin_version(ts t) {
+    std::lock_guard<std::mutex> lk(retained_mtx);
+    auto it = retained.upper_bound(t);
+    if (it == retained.begin()) return max_ts;
+    it--;
+    it->second.pinned = true;
+    return it->first;
+  }
+
+  void unpin_version(ts t) {
+    std::vector<version> dropped;
+    {
+      std::lock_guard<std::mutex> lk(retained_mtx);
+      auto it = retained.find(t);
+      if (it == retained.end()) return;
+      it->second.pinned = false;
+      dropped = trim();
+    }
+    release_dropped(dropped);
+  }
+
+  // Acquires the newest retained version at or before t. If every retained
+  // version is newer than t, the oldest one is returned, so callers should
+  // check the timestamp of the result. Released with release_version.
+  version acquire_version_at(ts t) {
+    std::lock_guard<std::mutex> lk(retained_mtx);
+    auto it = retained.upper_bound(t);
+    if (it != retained.begin()) it--;
+    T* entry = it->second.table_entry;
+    // cannot be freed while retained, so no CAS loop is needed
+    pbbs::fetch_and_add(&get<0>(get<1>(*entry)), 1);
+    return share_flat(version(it->first, entry, snapshot_graph(get<1>(get<1>(*entry)))));
+  }
+
+  std::vector<ts> retained_timestamps() {
+    std::lock_guard<std::mutex> lk(retained_mtx);
+    std::vector<ts> res;
+    for (const auto& r : retained) res.push_back(r.first);
+    return res;
+  }
+
+  // (timestamp, bytes) for each retained version, oldest first, where bytes
+  // are the memory referenced by no other live version, i.e. what dropping it
+  // would free. Structure shared by several old versions but not by the
+  // latest one is not counted in any of them.
+  std::vector<pair<ts, size_t>> retained_bytes() {
+    std::vector<pair<ts, size_t>> res;
+    for (ts t : retained_timestamps()) {
+      auto S = acquire_version_at(t);
+      res.push_back(make_pair(S.timestamp, S.graph.unshared_bytes()));
+      release_version(std::move(S));
+    }
+    return res;
+  }
+
+  // The edges inserted and deleted from version a to version b. Takes time
+  // proportional to the size of the change, not of the graph.
+  graph_diff diff(const version& a, const version& b) {
+    return snapshot_graph::diff(a.graph, b.graph);
+  }
+
+  // single-entry. Publishes f(latest version) as a new version; used for
+  // updates that have their own signature, e.g. weighted edge batches. These
+  // updates are not written to the update log.
+  template <class F>
+  void update_with(F f) {
+    auto S = acquire_version();
+    const auto& G = S.graph;
+
+    snapshot_graph G_next = f(G);
+    T* entry = live_versions.insert(make_tuple(current_timestamp,
+                                    make_tuple(refct_utils::make_refct(current_timestamp, 1),
+                                               G_next.get_root())));
+    G_next.clear_root();
+    pbbs::fetch_and_add(&current_timestamp, 1);
+    retain(current_timestamp-1, entry);
+
+    release_version(std::move(S));
+  }
+
   // single-entry
   void insert_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn = std::numeric_limits<size_t>::max(), bool run_seq=false) {
+    if (log) log->append(update_log::insert_op, current_timestamp, m, edges);
     auto S = acquire_version();
     const auto& G = S.graph;
 
     // 1. Insert the new graph (not yet visible) into the live versions set
     snapshot_graph G_next = G.insert_edges_batch(m, edges, sorted, remove_dups, nn, run_seq);
     assert(G_next.get_root());
-    live_versions.insert(make_tuple(current_timestamp,
+    if (connectivity) connectivity->insert_edges(m, edges, current_timestamp, oldest_live_timestamp());
+    T* entry = live_versions.insert(make_tuple(current_timestamp,
+                                    make_tuple(refct_utils::make_refct(current_timestamp, 1),
+                                               G_next.get_root())));
+    G_next.clear_root();
+    // 2. Make the new version visible
+    pbbs::fetch_and_add(&current_timestamp, 1);
+    retain(current_timestamp-1, entry);
+
+    release_version(std::move(S));
+  }
+
+  // single-entry. Applies a mixed batch of insertions and deletions as a
+  // single new version; the last update to an edge wins.
+  void apply_updates_batch(size_t m, edge_update* updates, bool sorted=false, bool run_seq=false) {
+    pbbs::sequence<edge_update> resolved;
+    if (log || connectivity) {
+      resolved = sym_immutable_graph_tree_plus::resolve_updates(m, updates, sorted, run_seq);
+      if (log) log->append(current_timestamp, resolved.size(), resolved.begin());
+      m = resolved.size(); updates = resolved.begin(); sorted = true;
+    }
+    auto S = acquire_version();
+    const auto& G = S.graph;
+
+    // 1. Insert the new graph (not yet visible) into the live versions set
+    snapshot_graph G_next = G.apply_updates_batch(m, updates, sorted, run_seq);
+    if (connectivity) connectivity->apply_updates(G_next, m, updates, current_timestamp, oldest_live_timestamp());
+    T* entry = live_versions.insert(make_tuple(current_timestamp,
                                     make_tuple(refct_utils::make_refct(current_timestamp, 1),
                                                G_next.get_root())));
     G_next.clear_root();
+
     // 2. Make the new version visible
     pbbs::fetch_and_add(&current_timestamp, 1);
+    retain(current_timestamp-1, entry);
 
     release_version(std::move(S));
   }
 
   // single-entry
   void delete_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn = std::numeric_limits<size_t>::max(), bool run_seq=false) {
+    if (log) log->append(update_log::delete_op, current_timestamp, m, edges);
     auto S = acquire_version();
     const auto& G = S.graph;
 
     // 1. Insert the new graph (not yet visible) into the live versions set
     snapshot_graph G_next = G.delete_edges_batch(m, edges, sorted, remove_dups, nn, run_seq);
-    live_versions.insert(make_tuple(current_timestamp,
+    if (connectivity) connectivity->delete_edges(G_next, m, edges, current_timestamp, oldest_live_timestamp());
+    T* entry = live_versions.insert(make_tuple(current_timestamp,
                                     make_tuple(refct_utils::make_refct(current_timestamp, 1),
                                                G_next.get_root())));
     G_next.clear_root();
 
     // 2. Make the new version visible
     pbbs::fetch_and_add(&current_timestamp, 1);
+    retain(current_timestamp-1, entry);
 
     release_version(std::move(S));
   }
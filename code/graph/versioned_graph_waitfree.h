@@ -1,11 +1,32 @@
 #pragma once
 
+// A wait-free versioning backend, selected by building with -DWAITFREE. It has
+// the same interface as versioned_graph.h, but acquire_version finishes in a
+// bounded number of steps regardless of what the writer does: a reader that
+// keeps missing the current version is helped by the writer, which installs a
+// version into the reader's announcement when it publishes.
+//
+// Each thread that acquires versions owns an announcement slot. Slots are
+// claimed on a thread's first acquire (or by register_thread()) and returned
+// by unregister_thread(). Each live version sits in one of
+// max_threads+1 version slots, which is enough since every thread pins at
+// most one version besides the current one. As with the lock-free backend,
+// threads that release versions must be scheduler workers, since releasing
+// the last reference to a version frees it, unless reclaim_in_background is
+// used.
 #include "tree_plus/immutable_graph_tree_plus.h"
 #include "traversible_graph.h"
+#include "incremental_connectivity.h"
+#include "update_log.h"
 
 #include "versioning_utils.h"
 
 #include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 
 #define MFENCE __sync_synchronize
@@ -17,84 +38,170 @@ struct versioned_graph {
   using Node = typename snapshot_graph::Node;
   using Node_GC = typename snapshot_graph::Node_GC;
 
+  // Optional write-ahead log. Update batches are appended to it before the
+  // version they create is made visible.
+  update_log* log = nullptr;
+
   struct version {
+    uint64_t timestamp;
     snapshot_graph graph;
-    version(snapshot_graph _graph) : graph(_graph) {}
+    bool retained; // from acquire_version_at; holds a reference to the root
+    version(uint64_t _timestamp, snapshot_graph&& _graph, bool _retained=false) :
+      timestamp(_timestamp), retained(_retained) {
+      graph.set_root(_graph.get_root());
+      _graph.clear_root();
+    }
+  };
+
+  // Versions kept alive for acquire_version_at. Each holds one reference to
+  // its root, so it outlives the collection of its version slot, and the
+  // latest version is always present. Guarded by retained_mtx.
+  struct retained_version {
+    Node* root;
+    double published;
+    bool pinned;
   };
+  std::map<uint64_t, retained_version> retained;
+  retention_policy policy;
+  std::mutex retained_mtx;
+  timer retention_timer;
+
+  // Frees dead versions in the background if set; see reclaim_in_background.
+  std::unique_ptr<version_reclaimer<Node, Node_GC>> reclaimer;
+
+  // Flat snapshots of the live versions, shared by their readers.
+  flat_snapshot_cache<snapshot_graph> flat_cache;
+
+  // Connected components maintained across update batches if set; see
+  // track_connectivity.
+  std::unique_ptr<incremental_connectivity<snapshot_graph>> connectivity;
+  static constexpr size_t max_retained = 2048;
 
   // ================================== Start Wait-Free Code ==================================
   using status = uint64_t;
   using announcement = uint64_t;
 
-  // Data for wait-free maintenance
-  static constexpr size_t padding = 4; // 128 uint64_t's/ptrs
-  size_t num_threads;
-  volatile status current_version = ops::EMPTY;
-
+  static constexpr size_t padding = 4; // 4 uint64_t's per slot
 
   struct alignas(16) thread_data {
     announcement announce;
+    bool claimed;
+  };
+
+  struct alignas(16) version_data {
     status stat;
     Node* version;
+    bool used;
   };
 
+  size_t num_threads;  // announcement slots
+  size_t num_versions; // version slots
   thread_data* tdata;
+  version_data* vdata;
+  volatile status current_version = ops::EMPTY;
+  uint64_t next_timestamp = 0;
+  uint64_t instance_id;
+
+  static uint64_t new_instance_id() {
+    static uint64_t next_id = 0;
+    return pbbs::fetch_and_add(&next_id, 1);
+  }
+
+  // (instance_id, slot) for every graph this thread is registered with.
+  static std::vector<std::pair<uint64_t, size_t>>& registrations() {
+    static thread_local std::vector<std::pair<uint64_t, size_t>> regs;
+    return regs;
+  }
+
+  // Returns this thread's announcement slot, claiming a free one on first use.
+  // Claiming takes at most num_threads CASes.
+  size_t thread_slot() {
+    auto& regs = registrations();
+    for (auto& r : regs) {
+      if (r.first == instance_id) return r.second;
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+      if (!tdata[i*padding].claimed &&
+          pbbs::atomic_compare_and_swap(&(tdata[i*padding].claimed), false, true)) {
+        tdata[i*padding].announce = ops::EMPTY;
+        regs.push_back(make_pair(instance_id, i));
+        return i;
+      }
+    }
+    cout << "versioned_graph: more than " << num_threads << " threads registered" << endl;
+    exit(0);
+  }
+
+  void register_thread() { thread_slot(); }
+
+  // Returns this thread's slot; the thread must not hold a version.
+  void unregister_thread() {
+    auto& regs = registrations();
+    for (size_t i = 0; i < regs.size(); i++) {
+      if (regs[i].first == instance_id) {
+        size_t offset = regs[i].second*padding;
+        assert(tdata[offset].announce == ops::EMPTY);
+        tdata[offset].claimed = false;
+        regs.erase(regs.begin() + i);
+        return;
+      }
+    }
+  }
 
-  void collect(size_t id, Node* old_nd) {
-    size_t offset = id*padding;
-    Node* nd = tdata[offset].version; //ptr
-    assert(nd == old_nd); // should be the same pointer.
-    if (!nd) return;
-    if (__sync_bool_compare_and_swap(&(tdata[offset].version), old_nd, nullptr)) {
+  void collect(size_t idx) {
+    size_t offset = idx*padding;
+    Node* nd = vdata[offset].version;
+    if (pbbs::atomic_compare_and_swap(&(vdata[offset].used), true, false)) {
       // we got the handle to this version; GC it.
-      bool res = Node_GC::decrement_recursive(old_nd);
-      debug(assert(res));
+      if (nd) free_version(nd);
     }
   }
 
+  // Publishes t as the current version. Writer only.
   void set(Node* t) {
     debug(cout << "setting new version to: " << ((size_t)t) << endl;);
-    assert(t->ref_cnt == 1);
+    assert(!t || t->ref_cnt == 1);
 
     status new_ver = ops::EMPTY;
     bool set_val = false;
     // Searches for an empty slot.
-    for (size_t i = 0; i < num_threads; i++) {
+    for (size_t i = 0; i < num_versions; i++) {
       size_t offset = i*padding;
-      if (tdata[offset].version == nullptr) {
-        new_ver = ops::combine(i, ops::get_timestamp(current_version)+1, 0);
-        tdata[offset].stat = ops::combine(new_ver, 0);
-        tdata[offset].version = t; // put your new data in slot
-        debug(cout << "set version at offset = " << offset << endl;);
+      if (!vdata[offset].used) {
+        new_ver = ops::combine(i, next_timestamp, 0);
+        vdata[offset].stat = ops::combine(new_ver, 0);
+        vdata[offset].version = t; // put your new data in slot
+        vdata[offset].used = true;
         set_val = true;
         break;
       }
     }
     if (!set_val) {
-      cout << "Could not set val!!!!" << endl;
+      cout << "versioned_graph: no free version slot" << endl;
       assert(false);
       exit(0);
     }
+    MFENCE();
     current_version = new_ver;
+    next_timestamp++;
     debug(cout << "new_timestamp = " << ops::get_timestamp(current_version) << endl;);
 
-    // Help
-    for(size_t i = 0; i < num_threads; i++) {
+    // Help readers that are still trying to acquire.
+    for (size_t i = 0; i < num_threads; i++) {
       size_t offset = i*padding;
-      for(size_t j = 0; j < 3; j++) {
+      for (size_t j = 0; j < 3; j++) {
         announcement ann = tdata[offset].announce;
         if (ops::get_flag(ann)) {
           pbbs::atomic_compare_and_swap(&(tdata[offset].announce), ann, ops::combine(new_ver, 0));
         }
       }
     }
+    retain(next_timestamp-1, t);
   }
 
-  // Acquires a new version for this thread.
+  // Acquires the current version for this thread and returns its slot.
   size_t acquire() {
-
-    int id = worker_id();
-    size_t offset = id*padding;
+    size_t offset = thread_slot()*padding;
 
     announcement old = ops::combine(ops::EMPTY, 1);
     tdata[offset].announce = old;
@@ -103,7 +210,7 @@ struct versioned_graph {
     status cur = current_version;
     for (int i = 0; i < 2; i++) {
       if (!pbbs::atomic_compare_and_swap(&((tdata[offset].announce)), old, ops::combine(cur, 1))) {
-        return ops::get_idx(tdata[offset].announce);
+        return ops::get_idx(tdata[offset].announce); // helped by the writer
       }
       old = ops::combine(cur, 1);
       // read again
@@ -119,168 +226,351 @@ struct versioned_graph {
     return ops::get_idx(tdata[offset].announce);
   }
 
-
-  // Acquires a new version for the updater.
+  // Acquires the current version for the writer.
   size_t acquire_update() {
-    int id = worker_id();
-    tdata[padding*id].announce = ops::combine(current_version, 0);
+    size_t offset = thread_slot()*padding;
+    tdata[offset].announce = ops::combine(current_version, 0);
+    MFENCE();
     return ops::get_idx(current_version);
   }
 
-
   // Releases this thread's version.
   void release() {
-    int id = worker_id();
-    size_t offset = id*padding;
+    size_t offset = thread_slot()*padding;
     status v = ops::get_version(tdata[offset].announce);
     tdata[offset].announce = ops::EMPTY;
     MFENCE();
     if (v == current_version) {
       return; // someone else will handle it
     }
-    status s = tdata[padding*ops::get_idx(v)].stat;
+    size_t v_offset = padding*ops::get_idx(v);
+    status s = vdata[v_offset].stat;
 
     if (v != ops::get_version(s)){
       return;
     }
 
     if (ops::get_flag(s) == 0) {
-      if (!pbbs::atomic_compare_and_swap(&(tdata[padding*ops::get_idx(v)].stat), s, ops::combine(ops::get_version(s), 1))) {
+      if (!pbbs::atomic_compare_and_swap(&(vdata[v_offset].stat), s, ops::combine(ops::get_version(s), 1))) {
         return;
       }
-      for (int i = 0; i < num_threads; i++) {
+      for (size_t i = 0; i < num_threads; i++) {
         size_t offset = i*padding;
         if (tdata[offset].announce == ops::combine(v,1)) {
-            pbbs::atomic_compare_and_swap(&tdata[offset].announce, ops::combine(v,1), ops::combine(v,0));
+          pbbs::atomic_compare_and_swap(&tdata[offset].announce, ops::combine(v,1), ops::combine(v,0));
         }
       }
       s = ops::combine(ops::get_version(s), 2);
-      tdata[padding*ops::get_idx(v)].stat = s;
+      vdata[v_offset].stat = s;
       MFENCE();
     }
     if (ops::get_flag(s) == 2) {
-      for (int i = 0; i < num_threads; i++) {
+      for (size_t i = 0; i < num_threads; i++) {
         size_t offset = i*padding;
         if (tdata[offset].announce == ops::combine(v,0)) {
           return;
         }
       }
-      if (pbbs::atomic_compare_and_swap(&(tdata[padding*ops::get_idx(v)].stat), s, ops::EMPTY)) {
-        collect(ops::get_idx(v), tdata[padding*ops::get_idx(v)].version);
+      if (pbbs::atomic_compare_and_swap(&(vdata[v_offset].stat), s, ops::EMPTY)) {
+        collect(ops::get_idx(v));
       }
     }
   }
   // ================================== End Wait-Free Code =====================================
 
-
-  void init_data() {
-    num_threads = std::thread::hardware_concurrency();
+  // max_threads bounds the number of threads registered at once.
+  void init_data(size_t max_threads) {
+    if (max_threads == 0) {
+      max_threads = std::max((size_t)num_workers(), (size_t)std::thread::hardware_concurrency()) + 8;
+    }
+    num_threads = std::min(max_threads, (size_t)ops::MAX_SLOTS - 1);
+    num_versions = num_threads + 1;
+    instance_id = new_instance_id();
     tdata = pbbs::new_array<thread_data>(num_threads*padding);
+    vdata = pbbs::new_array<version_data>(num_versions*padding);
     for (size_t i=0; i<num_threads; i++) {
-      tdata[i*padding].version = nullptr;
-      tdata[i*padding].stat = ops::EMPTY;
       tdata[i*padding].announce = ops::EMPTY;
+      tdata[i*padding].claimed = false;
+    }
+    for (size_t i=0; i<num_versions; i++) {
+      vdata[i*padding].stat = ops::EMPTY;
+      vdata[i*padding].version = nullptr;
+      vdata[i*padding].used = false;
     }
   }
 
-  versioned_graph(size_t n, size_t m, uintE* offsets, uintV* edges) {
-    init_data();
-
-    auto G = snapshot_graph(n, m, offsets, edges);
-    assert(G.get_root()->ref_cnt == 1);
+  versioned_graph(size_t max_threads=0) {
+    snapshot_graph::init(100000, 1000000);
+    init_data(max_threads);
+    set(nullptr);
+  }
 
+  versioned_graph(snapshot_graph&& G, size_t max_threads=0) {
+    init_data(max_threads);
     set(G.get_root());
     G.clear_root();
-    debug(cout << "Finished build" << endl;);
+    debug(cout << "Finished build (move)" << endl;);
   }
 
-  versioned_graph(snapshot_graph&& G) {
-    init_data();
-
+  versioned_graph(size_t n, size_t m, uintE* offsets, uintV* edges, size_t max_threads=0) {
+    init_data(max_threads);
+    auto G = snapshot_graph(n, m, offsets, edges);
     set(G.get_root());
-    assert(G.get_root()->ref_cnt == 1);
     G.clear_root();
-    debug(cout << "Finished build (move)" << endl;);
+    debug(cout << "Finished build" << endl;);
   }
 
-  versioned_graph() {
-    init_data();
+  void attach_log(update_log* _log) { log = _log; }
+
+  uint64_t latest_timestamp() {
+    return ops::get_timestamp(current_version);
   }
 
+  // Wait-free
   version acquire_version() {
-    debug(cout << "== Acquire version" << endl;);
     size_t idx = acquire();
-    debug(cout << "  idx = " << idx << endl;);
-    auto root = tdata[idx*padding].version;
-    debug(cout << "  root = " << ((size_t)root) << endl;);
-    debug(cout << "  root->ref_cnt = " << root->ref_cnt << endl;);
-    return version(snapshot_graph(root));
+    uint64_t timestamp = ops::get_timestamp(tdata[thread_slot()*padding].announce);
+    auto root = vdata[idx*padding].version;
+    return share_flat(version(timestamp, snapshot_graph(root)));
   }
 
   void release_version(version&& S) {
     auto root = S.graph.get_root();
-    debug(cout << "== Releasing root = " << ((size_t)root) << " " << root->ref_cnt << endl;);
+    S.graph.clear_root(); // relinquish ownership
+    if (S.retained) {
+      free_version(root);
+    } else {
+      release();
+    }
+  }
 
-    assert(root->ref_cnt > 0);
-    S.graph.clear_root(); //relinquish ownership
+  // ======================= Reclamation =======================
 
-    release();
+  // Hands the freeing of dead versions to num_threads background threads (see
+  // version_reclaimer), each freeing at most nodes_per_second vertex nodes per
+  // second if it is positive. Must be called before the graph is shared.
+  void reclaim_in_background(size_t num_threads=1, size_t nodes_per_second=0) {
+    reclaimer = std::make_unique<version_reclaimer<Node, Node_GC>>(num_threads, nodes_per_second);
   }
 
+  // Waits until the dead versions released so far are freed.
+  void wait_for_reclamation() {
+    if (reclaimer) reclaimer->wait_idle();
+  }
 
-  // single-entry
-  void insert_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn = std::numeric_limits<size_t>::max(), bool run_seq=false) {
-    debug(cout << "Insert_edges_batch" << endl;);
-    size_t idx = acquire_update();
-    auto root = tdata[padding*idx].version; // no ref-bump here, just a raw pointer to a tree root
+  // Readers of the same version share flat snapshots through flat_cache.
+  version share_flat(version&& S) {
+    S.graph.flat_cache = &flat_cache;
+    return std::move(S);
+  }
 
-    snapshot_graph G(root);
+  // Frees the tree of a version that can no longer be acquired.
+  void free_version(Node* root) {
+    if (root) flat_cache.erase(root);
+    if (reclaimer) reclaimer->push(root);
+    else Node_GC::decrement_recursive(root);
+  }
 
-    debug(cout << "G.n = " << G.num_vertices() << endl;);
-    // 1. Insert the new graph (not yet visible) into the live versions set
-    snapshot_graph G_next = G.insert_edges_batch(m, edges, sorted, remove_dups, nn, run_seq);
+  // ======================= Connectivity =======================
 
-    debug(cout << "G_next.n = " << G_next.num_vertices() << endl;);
-    assert(G_next.get_root());
-    auto new_root = G_next.get_root();
-    debug(cout << "new_root ref_cnt = " << new_root->ref_cnt << endl;);
+  // Maintains the connected components of the graph from the latest version
+  // on, so that readers can query them with same_component. Versions
+  // published by update_with are not tracked. Must be called before the graph
+  // is shared.
+  void track_connectivity() {
+    auto S = acquire_version();
+    connectivity = std::make_unique<incremental_connectivity<snapshot_graph>>(S.graph, S.timestamp);
+    release_version(std::move(S));
+  }
 
-    set(G_next.get_root());
-    debug(cout << "Finished insert edges" << endl << endl;
-    cout << "n = " << G.num_vertices() << endl;
-    cout << "n' = " << G_next.num_vertices() << endl;);
+  // Whether u and v are connected in S, which must not predate
+  // track_connectivity.
+  bool same_component(const version& S, uintV u, uintV v) {
+    return connectivity->same_component(u, v, S.timestamp);
+  }
 
-    G_next.clear_root();
-    G.clear_root();
+  // A vertex identifying v's component in S.
+  uintV component_of(const version& S, uintV v) {
+    return connectivity->find(v, S.timestamp);
+  }
 
-    release(); // it is the current version; call it a day
+  // No reader holds, or can acquire, a version older than this: versions are
+  // either retained or in a version slot. Writer only.
+  uint64_t oldest_live_timestamp() {
+    uint64_t oldest = latest_timestamp();
+    {
+      std::lock_guard<std::mutex> lk(retained_mtx);
+      if (!retained.empty()) oldest = std::min(oldest, retained.begin()->first);
+    }
+    for (size_t i = 0; i < num_versions; i++) {
+      size_t offset = i*padding;
+      status s = vdata[offset].stat;
+      if (vdata[offset].used && s != ops::EMPTY) {
+        oldest = std::min(oldest, ops::get_timestamp(s));
+      }
+    }
+    return oldest;
   }
 
+  // ======================= Retention and time-travel reads =======================
+
+  // Drops the retained versions that the policy no longer keeps, and returns
+  // their roots. Called with retained_mtx held.
+  std::vector<Node*> trim() {
+    std::vector<Node*> dropped;
+    trim_retained(retained, policy, retention_timer.get_time(), max_retained,
+                  [&] (uint64_t t, const retained_version& r) {
+      dropped.push_back(r.root);
+    });
+    return dropped;
+  }
 
-  // single-entry
-  void delete_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn = std::numeric_limits<size_t>::max(), bool run_seq=false) {
-    debug(cout << "Delete_edges_batch" << endl;);
-    size_t idx = acquire_update();
-    debug(cout << "idx = " << idx << endl;);
-    auto root = tdata[padding*idx].version;
-    debug(cout << "root = " << ((size_t) root) << " " << root->ref_cnt << endl;);
+  // Frees roots dropped by trim if they are not otherwise referenced; the
+  // caller must not hold retained_mtx, and must be a scheduler worker
+  // unless versions are reclaimed in the background.
+  void release_dropped(std::vector<Node*>& dropped) {
+    for (Node* root : dropped) {
+      free_version(root);
+    }
+  }
 
-    snapshot_graph G(root);
-    debug(cout << "G.n = " << G.num_vertices() << endl;);
+  // Retains the newly published version t. Writer only.
+  void retain(uint64_t t, Node* root) {
+    Node_GC::increment(root);
+    std::vector<Node*> dropped;
+    {
+      std::lock_guard<std::mutex> lk(retained_mtx);
+      retained[t] = retained_version{root, retention_timer.get_time(), false};
+      dropped = trim();
+    }
+    release_dropped(dropped);
+  }
 
-    // 1. Insert the new graph (not yet visible) into the live versions set
-    snapshot_graph G_next = G.delete_edges_batch(m, edges, sorted, remove_dups, nn, run_seq);
-    assert(G_next.get_root());
-    auto new_root = G_next.get_root();
-    debug(cout << "new_root ref_cnt = " << new_root->ref_cnt << endl;);
+  // Sets which old versions are kept; versions the new policy does not keep
+  // are released immediately. At most max_retained unpinned versions are kept
+  // regardless of the policy.
+  void set_retention(retention_policy _policy) {
+    std::vector<Node*> dropped;
+    {
+      std::lock_guard<std::mutex> lk(retained_mtx);
+      policy = _policy;
+      dropped = trim();
+    }
+    release_dropped(dropped);
+  }
 
-    set(G_next.get_root());
-    debug(cout << "Finished delete edges" << endl << endl;);
+  // Pins the newest retained version at or before t, keeping it until it is
+  // unpinned. Returns the pinned timestamp, or the largest uint64_t if no
+  // such version is retained.
+  uint64_t pin_version(uint64_t t) {
+    std::lock_guard<std::mutex> lk(retained_mtx);
+    auto it = retained.upper_bound(t);
+    if (it == retained.begin()) return std::numeric_limits<uint64_t>::max();
+    it--;
+    it->second.pinned = true;
+    return it->first;
+  }
 
+  void unpin_version(uint64_t t) {
+    std::vector<Node*> dropped;
+    {
+      std::lock_guard<std::mutex> lk(retained_mtx);
+      auto it = retained.find(t);
+      if (it == retained.end()) return;
+      it->second.pinned = false;
+      dropped = trim();
+    }
+    release_dropped(dropped);
+  }
+
+  // Acquires the newest retained version at or before t. If every retained
+  // version is newer than t, the oldest one is returned, so callers should
+  // check the timestamp of the result. Released with release_version.
+  version acquire_version_at(uint64_t t) {
+    std::lock_guard<std::mutex> lk(retained_mtx);
+    auto it = retained.upper_bound(t);
+    if (it != retained.begin()) it--;
+    Node* root = it->second.root;
+    Node_GC::increment(root);
+    return share_flat(version(it->first, snapshot_graph(root), true));
+  }
+
+  std::vector<uint64_t> retained_timestamps() {
+    std::lock_guard<std::mutex> lk(retained_mtx);
+    std::vector<uint64_t> res;
+    for (const auto& r : retained) res.push_back(r.first);
+    return res;
+  }
+
+  // (timestamp, bytes) for each retained version, oldest first, where bytes
+  // are the memory referenced by no other live version, i.e. what dropping it
+  // would free. Structure shared by several old versions but not by the
+  // latest one is not counted in any of them.
+  std::vector<pair<uint64_t, size_t>> retained_bytes() {
+    std::vector<pair<uint64_t, size_t>> res;
+    for (uint64_t t : retained_timestamps()) {
+      auto S = acquire_version_at(t);
+      res.push_back(make_pair(S.timestamp, S.graph.unshared_bytes()));
+      release_version(std::move(S));
+    }
+    return res;
+  }
+
+  // The edges inserted and deleted from version a to version b. Takes time
+  // proportional to the size of the change, not of the graph.
+  graph_diff diff(const version& a, const version& b) {
+    return snapshot_graph::diff(a.graph, b.graph);
+  }
+
+  // single-entry. Publishes f(latest version) as a new version; these
+  // updates are not written to the update log.
+  template <class F>
+  void update_with(F f) {
+    size_t idx = acquire_update();
+    snapshot_graph G(vdata[padding*idx].version); // no ref-bump, just a raw pointer
+
+    snapshot_graph G_next = f(G);
+    set(G_next.get_root());
     G_next.clear_root();
     G.clear_root();
 
     release();
   }
 
+  // single-entry
+  void insert_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn = std::numeric_limits<size_t>::max(), bool run_seq=false) {
+    if (log) log->append(update_log::insert_op, next_timestamp, m, edges);
+    update_with([&] (const snapshot_graph& G) {
+      auto G_next = G.insert_edges_batch(m, edges, sorted, remove_dups, nn, run_seq);
+      if (connectivity) connectivity->insert_edges(m, edges, next_timestamp, oldest_live_timestamp());
+      return G_next;
+    });
+  }
+
+  // single-entry. Applies a mixed batch of insertions and deletions as a
+  // single new version; the last update to an edge wins.
+  void apply_updates_batch(size_t m, edge_update* updates, bool sorted=false, bool run_seq=false) {
+    pbbs::sequence<edge_update> resolved;
+    if (log || connectivity) {
+      resolved = sym_immutable_graph_tree_plus::resolve_updates(m, updates, sorted, run_seq);
+      if (log) log->append(next_timestamp, resolved.size(), resolved.begin());
+      m = resolved.size(); updates = resolved.begin(); sorted = true;
+    }
+    update_with([&] (const snapshot_graph& G) {
+      auto G_next = G.apply_updates_batch(m, updates, sorted, run_seq);
+      if (connectivity) connectivity->apply_updates(G_next, m, updates, next_timestamp, oldest_live_timestamp());
+      return G_next;
+    });
+  }
+
+  // single-entry
+  void delete_edges_batch(size_t m, tuple<uintV, uintV>* edges, bool sorted=false, bool remove_dups=false, size_t nn = std::numeric_limits<size_t>::max(), bool run_seq=false) {
+    if (log) log->append(update_log::delete_op, next_timestamp, m, edges);
+    update_with([&] (const snapshot_graph& G) {
+      auto G_next = G.delete_edges_batch(m, edges, sorted, remove_dups, nn, run_seq);
+      if (connectivity) connectivity->delete_edges(G_next, m, edges, next_timestamp, oldest_live_timestamp());
+      return G_next;
+    });
+  }
+
 };
@@ -1,17 +1,32 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
 #include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace ops {
 
-  static constexpr uint64_t MAX_THREADS = 144;
+  // A version is a (timestamp, slot index) pair packed with a 2-bit flag:
+  // | timestamp (52 bits) | index (10 bits) | flag (2 bits) |
   static constexpr uint64_t ZERO = 0;
   static constexpr uint64_t ONE = 1;
+  static constexpr uint64_t INDEX_BITS = 10;
   static constexpr uint64_t MASK_FLAG = (ONE << 2)-ONE;
-  static constexpr uint64_t MASK_INDEX = ((ONE << 10)-ONE) << 2;
+  static constexpr uint64_t MASK_INDEX = ((ONE << INDEX_BITS)-ONE) << 2;
   static constexpr uint64_t MASK_TIMESTAMP = (~ZERO) - MASK_INDEX - MASK_FLAG;
   static constexpr uint64_t MASK_VERSION = (~ZERO) - MASK_FLAG;
-  static constexpr uint64_t EMPTY = ((uint64_t(MAX_THREADS)+10) << 2);
+
+  // The largest index is reserved for EMPTY, so at most MAX_SLOTS version
+  // slots can be addressed.
+  static constexpr uint64_t MAX_SLOTS = (ONE << INDEX_BITS) - ONE;
+  static constexpr uint64_t EMPTY = (MAX_SLOTS << 2);
 
   inline uint64_t get_idx(uint64_t x)
   {
@@ -20,7 +35,7 @@ namespace ops {
 
   inline uint64_t get_timestamp(uint64_t x)
   {
-      return (x&MASK_TIMESTAMP) >> 12;
+      return (x&MASK_TIMESTAMP) >> (INDEX_BITS + 2);
   }
 
   inline uint64_t get_version(uint64_t x)
@@ -33,12 +48,9 @@ namespace ops {
       return (x&MASK_FLAG);
   }
 
-  // timestamp is a 52 bit int
-  // timestamp index is a 10 bit int?
-  // flag is a bit (use 2 bits for some reason)
   inline uint64_t combine(uint64_t index, uint64_t timestamp, uint64_t flag)
   {
-      return (timestamp << 12) + (index << 2) + flag;
+      return (timestamp << (INDEX_BITS + 2)) + (index << 2) + flag;
   }
 
   inline uint64_t combine(uint64_t version, uint64_t flag)
@@ -47,4 +59,161 @@ namespace ops {
   }
 };
 
+// Which old versions a versioned_graph keeps alive for acquire_version_at. The
+// latest version is always kept. An older version is kept while it is one of
+// the keep_last newest versions, while it is at most keep_seconds old, or
+// while it is pinned.
+struct retention_policy {
+  size_t keep_last = 1;
+  double keep_seconds = 0.0;
+  retention_policy() {}
+  retention_policy(size_t _keep_last, double _keep_seconds=0.0) :
+    keep_last(_keep_last), keep_seconds(_keep_seconds) {}
+};
+
+// Erases the entries of retained, a map from timestamps to entries with
+// published and pinned fields, that policy no longer keeps, passing each to
+// drop before erasing it. The newest entry is always kept, and at most
+// max_kept entries are kept besides pinned ones.
+template <class Map, class F>
+void trim_retained(Map& retained, const retention_policy& policy, double now,
+                   size_t max_kept, F drop) {
+  size_t n_kept = 0; // counts from the newest entry
+  for (auto it = retained.rbegin(); it != retained.rend(); ) {
+    const auto& r = it->second;
+    bool keep = (n_kept == 0) || r.pinned ||
+      ((n_kept < policy.keep_last || now - r.published <= policy.keep_seconds) &&
+       n_kept < max_kept);
+    if (keep) {
+      if (!r.pinned) n_kept++;
+      it++;
+    } else {
+      drop(it->first, r);
+      it = decltype(it)(retained.erase(std::next(it).base()));
+    }
+  }
+}
+
+// Frees the trees of dead versions off the threads that release them, so that
+// a reader releasing the last reference to an old version, or the writer
+// committing a new one, does not pay for freeing its path-copied nodes. Roots
+// are queued by push and freed by num_threads helper threads (see
+// pbbslib/parallel.h), each freeing one tree at a time sequentially, which
+// bounds the parallelism of reclamation. With nodes_per_second > 0 each
+// thread frees at most about that many vertex nodes (with their edge trees)
+// per second. If helper threads are not supported, push frees inline.
+template <class Node, class Node_GC>
+struct version_reclaimer {
+  std::mutex mtx;
+  std::condition_variable cv, idle_cv;
+  std::deque<Node*> queue;
+  size_t busy = 0;
+  bool done = false;
+  bool inline_only = false;
+  size_t nodes_per_second;
+  std::vector<std::thread> threads;
+
+  std::atomic<size_t> roots_freed, nodes_freed;
+  size_t max_queued = 0;
+
+  version_reclaimer(size_t num_threads=1, size_t _nodes_per_second=0) :
+    nodes_per_second(_nodes_per_second), roots_freed(0), nodes_freed(0) {
+    num_threads = std::max((size_t)1, std::min(num_threads, (size_t)max_helper_threads));
+    std::atomic<size_t> started(0), helpers(0);
+    for (size_t i = 0; i < num_threads; i++) {
+      threads.emplace_back([this, i, &started, &helpers] () {
+        bool ok = become_helper_thread(i);
+        if (ok) helpers++;
+        started++;
+        if (ok) run();
+      });
+    }
+    while (started < num_threads) std::this_thread::yield();
+    inline_only = (helpers == 0);
+  }
+
+  ~version_reclaimer() {
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      done = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) t.join();
+  }
+
+  // Takes the only reference to the tree rooted at root.
+  void push(Node* root) {
+    if (!root) return;
+    if (inline_only) {
+      Node_GC::decrement_recursive(root);
+      roots_freed++;
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lk(mtx);
+      queue.push_back(root);
+      max_queued = std::max(max_queued, queue.size());
+    }
+    cv.notify_one();
+  }
+
+  // Waits until every tree pushed so far is freed.
+  void wait_idle() {
+    std::unique_lock<std::mutex> lk(mtx);
+    idle_cv.wait(lk, [&] { return queue.empty() && busy == 0; });
+  }
 
+  size_t pending() {
+    std::lock_guard<std::mutex> lk(mtx);
+    return queue.size() + busy;
+  }
+
+  void print_stats() {
+    std::cout << "reclaimer: freed " << roots_freed << " versions, " << nodes_freed
+              << " vertex nodes, at most " << max_queued << " queued, "
+              << pending() << " pending" << std::endl;
+  }
+
+private:
+  // Queued trees are freed before the threads exit.
+  void run() {
+    std::unique_lock<std::mutex> lk(mtx);
+    while (true) {
+      cv.wait(lk, [&] { return done || !queue.empty(); });
+      if (queue.empty()) return;
+      Node* root = queue.front();
+      queue.pop_front();
+      busy++;
+      lk.unlock();
+      free_tree(root);
+      roots_freed++;
+      lk.lock();
+      busy--;
+      if (queue.empty() && busy == 0) idle_cv.notify_all();
+    }
+  }
+
+  // Node_GC::decrement_recursive with an explicit stack, so that it can be
+  // paused for the rate limit.
+  void free_tree(Node* root) {
+    using clock = std::chrono::steady_clock;
+    auto start = clock::now();
+    size_t freed = 0;
+    std::vector<Node*> stack = {root};
+    while (!stack.empty()) {
+      Node* t = stack.back();
+      stack.pop_back();
+      if (!t) continue;
+      Node* l = t->lc;
+      Node* r = t->rc;
+      if (!Node_GC::decrement(t)) continue;
+      stack.push_back(l);
+      stack.push_back(r);
+      if ((++freed % 1024) == 0 && nodes_per_second > 0) {
+        auto due = start + std::chrono::microseconds((freed * 1000000) / nodes_per_second);
+        std::this_thread::sleep_until(due);
+      }
+    }
+    nodes_freed += freed;
+  }
+};
@@ -2,13 +2,89 @@
 
 #include <functional>
 #include <limits>
+#include <mutex>
+#include <vector>
 
 using namespace std;
 
+// Dense vertex subsets are bitsets, 64 vertices per word, with the bits past
+// n cleared. Traversals allocate and free a dense subset of the same size
+// every round, so a few freed bitsets are kept for reuse.
+namespace dense_buffers {
+
+  constexpr size_t max_kept = 4;
+
+  struct pool {
+    std::mutex mtx;
+    std::vector<pair<size_t, uint64_t*>> kept; // (words, bitset)
+  };
+
+  inline pool& get_pool() {
+    static pool p;
+    return p;
+  }
+
+  inline size_t num_words(size_t n) { return (n + 63) / 64; }
+
+  // An uninitialized bitset of words words.
+  inline uint64_t* alloc(size_t words) {
+    auto& p = get_pool();
+    {
+      std::lock_guard<std::mutex> lock(p.mtx);
+      for (size_t i = 0; i < p.kept.size(); i++) {
+        if (p.kept[i].first == words) {
+          uint64_t* d = p.kept[i].second;
+          p.kept[i] = p.kept.back();
+          p.kept.pop_back();
+          return d;
+        }
+      }
+    }
+    return pbbs::new_array_no_init<uint64_t>(words);
+  }
+
+  inline void release(uint64_t* d, size_t words) {
+    auto& p = get_pool();
+    {
+      std::lock_guard<std::mutex> lock(p.mtx);
+      if (p.kept.size() < max_kept) {
+        p.kept.push_back(make_pair(words, d));
+        return;
+      }
+    }
+    pbbs::free_array(d);
+  }
+
+  inline uint64_t bit(size_t v) { return ((uint64_t)1) << (v & 63); }
+
+  inline bool is_set(const uint64_t* d, size_t v) { return (d[v >> 6] >> (v & 63)) & 1; }
+
+  inline void set_atomic(uint64_t* d, size_t v) {
+    __atomic_fetch_or(&d[v >> 6], bit(v), __ATOMIC_RELAXED);
+  }
+
+  // Calls f(v) on every v in word w of the bitset.
+  template <class F>
+  inline void iter_word(uint64_t bits, size_t w, F f) {
+    while (bits) {
+      f(w*64 + __builtin_ctzll(bits));
+      bits &= bits - 1;
+    }
+  }
+
+  inline size_t count(const uint64_t* d, size_t n) {
+    auto counts = pbbs::delayed_seq<size_t>(num_words(n), [&] (size_t w) {
+      return (size_t)__builtin_popcountll(d[w]);
+    });
+    return pbbs::reduce(counts, pbbs::addm<size_t>());
+  }
+
+} // namespace dense_buffers
+
 // no data for now, make this more full-featured later.
 struct vertex_subset {
   using S = uintV;
-  using D = bool;
+  using D = uint64_t;
   using VS = vertex_subset;
 
   // An empty vertex set.
@@ -24,20 +100,35 @@ struct vertex_subset {
   vertex_subset(size_t _n, size_t _m, uintV* _s) : n(_n), m(_m), s(_s),
       d(nullptr), is_dense(0) {}
 
-  // A dense vertex set
-  vertex_subset(size_t _n, size_t _m, bool* _d) : n(_n), m(_m), s(nullptr),
+  // A dense vertex set, taking a bitset from dense_buffers::alloc
+  vertex_subset(size_t _n, size_t _m, D* _d) : n(_n), m(_m), s(nullptr),
       d(_d), is_dense(1) {}
 
-  // A dense vertex set
-  vertex_subset(size_t _n, bool* _d) : n(_n), m(0), s(nullptr),
+  // A dense vertex set, taking a bitset from dense_buffers::alloc
+  vertex_subset(size_t _n, D* _d) : n(_n), m(0), s(nullptr),
       d(_d), is_dense(1) {
-    auto d_map = pbbs::delayed_seq<size_t>(n, [&] (size_t i) { return _d[i]; });
-    m = pbbs::reduce(d_map, pbbs::addm<size_t>());
+    m = dense_buffers::count(d, n);
+  }
+
+  // A dense vertex set from an array of n flags, which is freed
+  vertex_subset(size_t _n, bool* _d) : n(_n), m(0), s(nullptr),
+      d(nullptr), is_dense(1) {
+    d = dense_buffers::alloc(dense_buffers::num_words(n));
+    parallel_for(0, dense_buffers::num_words(n), [&] (size_t w) {
+      D bits = 0;
+      size_t end = std::min(n, (w+1)*64);
+      for (size_t i = w*64; i < end; i++) {
+        if (_d[i]) bits |= dense_buffers::bit(i);
+      }
+      d[w] = bits;
+    });
+    pbbs::free_array(_d);
+    m = dense_buffers::count(d, n);
   }
 
   void del() {
     if (s) { pbbs::free_array(s); s = nullptr; }
-    if (d) { pbbs::free_array(d); d = nullptr; }
+    if (d) { dense_buffers::release(d, dense_buffers::num_words(n)); d = nullptr; }
   }
 
   bool is_empty() {
@@ -49,19 +140,19 @@ struct vertex_subset {
   }
 
   bool is_in(uintV v) {
-    return d[v];
+    return dense_buffers::is_set(d, v);
   }
 
   void to_dense() {
     if (!is_dense) {
       assert(d == nullptr);
-      d = pbbs::new_array_no_init<bool>(n);
-      parallel_for(0, n, [&] (size_t i) {
-        d[i] = 0;
+      size_t words = dense_buffers::num_words(n);
+      d = dense_buffers::alloc(words);
+      parallel_for(0, words, [&] (size_t w) {
+        d[w] = 0;
       });
       parallel_for(0, m, [&] (size_t i) {
-        uintV ngh = s[i];
-        d[ngh] = 1;
+        dense_buffers::set_atomic(d, s[i]);
       });
       is_dense = true;
     }
@@ -69,16 +160,16 @@ struct vertex_subset {
 
   void to_sparse() {
     if (s == nullptr && m > 0) {
-      auto f_in = pbbs::delayed_seq<bool>(n, [&](size_t i) { return d[i]; });
-      auto out = pbbs::pack_index<uintV>(f_in);
-      s = out.to_array();
-//      auto out = seq::packIndex<uintV>(d, n);
-//      auto f = pbbs::sequence<bool>(d, n);
-//      auto out = pbbs::pack_index<uintV>(f, n);
-//      pack_t.next("pack time");
-//      cout << "n = " << n << " output size = " << out.n << endl;
-//      out.allocated = false;
-//      s = out.A;
+      size_t words = dense_buffers::num_words(n);
+      auto offs = pbbs::sequence<size_t>(words, [&] (size_t w) {
+        return (size_t)__builtin_popcountll(d[w]);
+      });
+      pbbs::scan_inplace(offs.slice(), pbbs::addm<size_t>());
+      s = pbbs::new_array_no_init<uintV>(m);
+      parallel_for(0, words, [&] (size_t w) {
+        size_t k = offs[w];
+        dense_buffers::iter_word(d[w], w, [&] (size_t v) { s[k++] = v; });
+      }, 64);
     }
   }
 
@@ -90,8 +181,12 @@ struct vertex_subset {
       auto S = pbbs::sequence<E>(m, get_val);
       return pbbs::reduce(S, red_m);
     }
-    auto get_val = [&] (size_t i) { return (d[i]) ? map_f(i) : zero; };
-    auto D = pbbs::sequence<E>(n, get_val);
+    auto get_val = [&] (size_t w) {
+      E acc = zero;
+      dense_buffers::iter_word(d[w], w, [&] (size_t v) { acc = red_f(acc, map_f(v)); });
+      return acc;
+    };
+    auto D = pbbs::sequence<E>(dense_buffers::num_words(n), get_val);
     return pbbs::reduce(D, red_m);
   };
 
@@ -106,11 +201,8 @@ void vertex_map(vertex_subset& vs, F f) {
   size_t m = vs.size();
   if (m > 0) {
     if (vs.is_dense) {
-      size_t n = vs.n;
-      parallel_for(0, n, [&] (size_t i) {
-        if (vs.d[i]) {
-          f(i);
-        }
+      parallel_for(0, dense_buffers::num_words(vs.n), [&] (size_t w) {
+        dense_buffers::iter_word(vs.d[w], w, [&] (size_t v) { f(v); });
       });
     } else {
       parallel_for(0, m, [&] (size_t i) {
@@ -127,7 +219,7 @@ void add_to_vsubset(vertex_subset& vs, uintV *new_verts,
     uintV num_new_verts) {
   if (vs.is_dense) {
     parallel_for (0, num_new_verts, [&] (size_t i) {
-      vs.d[new_verts[i]] = true;
+      dense_buffers::set_atomic(vs.d, new_verts[i]);
     });
     vs.m += num_new_verts;
   } else {
@@ -147,4 +239,3 @@ void add_to_vsubset(vertex_subset& vs, uintV *new_verts,
     vs.m = new_size;
   }
 }
-
@@ -17,7 +17,7 @@ class sequentialHT {
   T* table;
 
   inline size_t toRange(size_t h) {return h & mask;}
-  inline size_t firstIndex(K v) {return toRange(pbbs::hash32(v >> 32UL));}
+  inline size_t firstIndex(K v) {return toRange(pbbs::hash64(v));}
   inline size_t incrementIndex(size_t h) {return toRange(h+1);}
 
   // m must be a power of two. assumes the table is already cleared.
@@ -70,9 +70,11 @@ class sequentialHT {
     }
   }
 
+  // Gives up after probing every cell, since once all cells have held a key
+  // (e.g. are tombstones) there may be no empty cell to stop at.
   inline tuple<T&,bool> find(K key) {
     size_t h = firstIndex(key);
-    while (1) {
+    for (size_t i=0; i<m; i++) {
       auto& table_ref = table[h];
       if (get<0>(table_ref) == max_key) {
         return std::forward_as_tuple(table_ref, false);
@@ -81,6 +83,7 @@ class sequentialHT {
       }
       h = incrementIndex(h);
     }
+    return std::forward_as_tuple(table[h], false);
   }
 
   template <class Eq>
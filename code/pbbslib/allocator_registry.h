@@ -0,0 +1,81 @@
+#pragma once
+
+// The list_allocators register themselves here when initialized, so that
+// their memory can be reported and trimmed together, either explicitly with
+// trim_all or by a background thread once enough memory is free.
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace allocator_registry {
+
+  struct entry {
+    size_t (*block_size)();
+    size_t (*allocated_bytes)();
+    size_t (*used_bytes)();
+    size_t (*free_bytes)();     // on free lists, which trim can return
+    size_t (*returned_bytes)(); // returned to the OS
+    size_t (*trim)(bool run_seq);
+  };
+
+  inline std::mutex& get_mutex() { static std::mutex m; return m; }
+  inline std::vector<entry>& get_entries() { static std::vector<entry> e; return e; }
+
+  inline void add(const entry& e) {
+    std::lock_guard<std::mutex> lock(get_mutex());
+    get_entries().push_back(e);
+  }
+
+  inline std::vector<entry> entries() {
+    std::lock_guard<std::mutex> lock(get_mutex());
+    return get_entries();
+  }
+
+  // Returns the free memory of every allocator that it can to the OS, and
+  // the number of bytes returned. run_seq must be set when not called from
+  // a worker of the scheduler.
+  inline size_t trim_all(bool run_seq=false) {
+    size_t bytes = 0;
+    for (auto& e : entries()) bytes += e.trim(run_seq);
+    return bytes;
+  }
+
+  inline size_t free_bytes() {
+    size_t bytes = 0;
+    for (auto& e : entries()) bytes += e.free_bytes();
+    return bytes;
+  }
+
+  inline void print_stats() {
+    size_t allocated = 0, used = 0, returned = 0;
+    for (auto& e : entries()) {
+      std::cout << "node size " << e.block_size() << ": allocated " << e.allocated_bytes()
+                << ", live " << e.used_bytes() << ", returned " << e.returned_bytes()
+                << " bytes" << std::endl;
+      allocated += e.allocated_bytes(); used += e.used_bytes(); returned += e.returned_bytes();
+    }
+    std::cout << "all allocators: allocated " << allocated << ", live " << used
+              << ", returned " << returned << " bytes" << std::endl;
+  }
+
+  // Checks every period_ms whether more than threshold bytes are free, and if
+  // so trims every allocator.
+  struct background_trimmer {
+    std::atomic<bool> done;
+    std::thread t;
+    background_trimmer(size_t threshold, size_t period_ms) : done(false) {
+      t = std::thread([this, threshold, period_ms] () {
+        while (!done) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+          if (!done && free_bytes() > threshold) trim_all(/* run_seq */ true);
+        }
+      });
+    }
+    ~background_trimmer() { done = true; t.join(); }
+  };
+
+} // namespace allocator_registry
@@ -36,6 +36,7 @@
 #include "concurrent_stack.h"
 #include "utilities.h"
 #include "memory_size.h"
+#include "huge_pages.h"
 
 struct block_allocator {
  private:
@@ -91,7 +92,7 @@ struct block_allocator {
   block_allocator() {};
 };
 
-int block_allocator::thread_count = num_workers();
+int block_allocator::thread_count = max_worker_ids();
 
 // Allocate a new list of list_length elements
 
@@ -120,8 +121,8 @@ size_t block_allocator::num_used_blocks() {
 }
 
 auto block_allocator::allocate_blocks(size_t num_blocks) -> char* {
-  char* start = (char*) aligned_alloc(pad_size,
-				      num_blocks * block_size_+ pad_size);
+  char* start = (char*) huge_pages::alloc(num_blocks * block_size_ + pad_size,
+					  pad_size);
   if (start == NULL) {
     fprintf(stderr, "Cannot allocate space in block_allocator");
     exit(1); }
@@ -174,7 +175,7 @@ block_allocator::~block_allocator() {
     delete[] local_lists;
 
     maybe<char*> x;
-    while ((x = pool_roots.pop())) std::free(*x);
+    while ((x = pool_roots.pop())) huge_pages::free(*x);
     pool_roots.clear();
     global_stack.clear();
 
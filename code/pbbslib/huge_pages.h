@@ -0,0 +1,160 @@
+#pragma once
+
+// Arenas for the node allocators (list_allocator.h, block_allocator.h),
+// optionally backed by huge pages to reduce TLB misses when traversing trees.
+//
+// Without HUGEPAGES, arenas come from aligned_alloc. With HUGEPAGES=k for
+// k = 21 (2MB) or 30 (1GB), arenas of at least 2^k bytes are mapped from the
+// hugetlbfs pool (MAP_HUGETLB), which must have been reserved, e.g. through
+// /proc/sys/vm/nr_hugepages. Arenas that are smaller, or that the pool cannot
+// hold, fall back to anonymous memory aligned to 2MB and advised for
+// transparent huge pages (MADV_HUGEPAGE), as do all arenas with HUGEPAGES=0.
+// Whether the kernel actually backs advised memory with huge pages is only
+// known after the fact, so print_stats reports the process's AnonHugePages.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(HUGEPAGES) && !defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_SHIFT 26
+#endif
+
+namespace huge_pages {
+
+  constexpr size_t thp_size = ((size_t)1) << 21;
+
+  enum arena_kind { hugetlb, advised, regular };
+
+  // Bytes of live arenas of each kind, and the arenas themselves.
+  struct arena_stats {
+    std::atomic<size_t> bytes[3];
+    std::mutex mtx;
+    std::map<void*, std::pair<size_t, arena_kind>> arenas;
+    arena_stats() { for (auto& b : bytes) b = 0; }
+  };
+
+  inline arena_stats& get_stats() {
+    static arena_stats s;
+    return s;
+  }
+
+  inline size_t round_up(size_t n, size_t k) { return ((n + k - 1) / k) * k; }
+
+  inline void add_arena(void* p, size_t len, arena_kind kind) {
+    auto& s = get_stats();
+    s.bytes[kind] += len;
+    std::lock_guard<std::mutex> lock(s.mtx);
+    s.arenas[p] = std::make_pair(len, kind);
+  }
+
+#ifdef HUGEPAGES
+  inline void* map_arena(size_t bytes) {
+#if HUGEPAGES > 0
+    size_t page = ((size_t)1) << HUGEPAGES;
+    if (bytes >= page) {
+      size_t len = round_up(bytes, page);
+      void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (HUGEPAGES << MAP_HUGE_SHIFT), -1, 0);
+      if (p != MAP_FAILED) {
+        add_arena(p, len, hugetlb);
+        return p;
+      }
+    }
+#endif
+    // Over-map by a huge page and trim, so the arena is 2MB aligned.
+    size_t len = round_up(bytes, thp_size);
+    size_t over = len + thp_size;
+    char* q = (char*)mmap(nullptr, over, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (q == (char*)MAP_FAILED) return nullptr;
+    char* start = (char*)round_up((size_t)q, thp_size);
+    if (start > q) munmap(q, start - q);
+    if (start + len < q + over) munmap(start + len, (q + over) - (start + len));
+    bool ok = madvise(start, len, MADV_HUGEPAGE) == 0;
+    add_arena(start, len, ok ? advised : regular);
+    return start;
+  }
+#endif
+
+  // Returns an arena of at least bytes bytes, aligned to at least align
+  // (at most 4096) bytes, or nullptr.
+  inline void* alloc(size_t bytes, size_t align) {
+#ifdef HUGEPAGES
+    return map_arena(bytes);
+#else
+    size_t len = round_up(bytes, align);
+    void* p = aligned_alloc(align, len);
+    if (p) add_arena(p, len, regular);
+    return p;
+#endif
+  }
+
+  // Frees an arena returned by alloc.
+  inline void free(void* p) {
+    auto& s = get_stats();
+    size_t len;
+    {
+      std::lock_guard<std::mutex> lock(s.mtx);
+      auto it = s.arenas.find(p);
+      if (it == s.arenas.end()) return;
+      len = it->second.first;
+      s.bytes[it->second.second] -= len;
+      s.arenas.erase(it);
+    }
+#ifdef HUGEPAGES
+    munmap(p, len);
+#else
+    std::free(p);
+#endif
+  }
+
+  // The granularity at which memory of the arena can be returned to the OS.
+  inline size_t page_size(void* arena) {
+#if defined(HUGEPAGES) && HUGEPAGES > 0
+    auto& s = get_stats();
+    std::lock_guard<std::mutex> lock(s.mtx);
+    auto it = s.arenas.find(arena);
+    if (it != s.arenas.end() && it->second.second == hugetlb) return ((size_t)1) << HUGEPAGES;
+#endif
+    return sysconf(_SC_PAGESIZE);
+  }
+
+  // Returns the pages [p, p+len) of an arena to the OS. They read as zero
+  // when next touched. Returns false if the OS refused, e.g. for hugetlbfs
+  // pages on older kernels.
+  inline bool release(void* p, size_t len) {
+    return madvise(p, len, MADV_DONTNEED) == 0;
+  }
+
+  // Bytes of anonymous memory of the process backed by transparent huge pages.
+  inline size_t anon_huge_bytes() {
+    FILE* f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return 0;
+    char line[256];
+    size_t kb = 0;
+    while (fgets(line, sizeof(line), f)) {
+      if (strncmp(line, "AnonHugePages:", 14) == 0) {
+        kb = strtoull(line + 14, nullptr, 10);
+        break;
+      }
+    }
+    fclose(f);
+    return kb * 1024;
+  }
+
+  inline void print_stats() {
+    auto& s = get_stats();
+    std::cout << "Arena bytes: hugetlbfs: " << s.bytes[hugetlb]
+              << ", advised for huge pages: " << s.bytes[advised]
+              << ", regular: " << s.bytes[regular]
+              << ", process AnonHugePages: " << anon_huge_bytes() << std::endl;
+  }
+
+} // namespace huge_pages
@@ -26,6 +26,19 @@
 // Returns list_size elements to the global pool when local pool=2*list_size
 // Keeps track of number of allocated elements.
 // Probably more efficient than a general purpose allocator
+//
+// With NUMA_AWARE the global pool is split into one pool per NUMA node.
+// Workers are pinned (see scheduler.h), lists are initialized, and so first
+// touched, by a worker on the node whose pool they go to, and workers refill
+// from their own node's pool before taking lists from other nodes. Freed
+// blocks go to the pool of the freeing worker's node.
+//
+// trim() returns free memory to the OS. It takes the lists of the global
+// pools, releases (madvise DONTNEED) every page all of whose blocks are on
+// them, and relinks the other blocks into lists. Blocks on the local lists
+// of workers are left alone, so trim can run while other threads allocate
+// and free. Blocks of released pages are handed out again, before any new
+// memory is allocated, once a worker needs a new list.
 
 #pragma once
 
@@ -33,10 +46,18 @@
 #include <stdlib.h>
 #include <math.h>
 #include <atomic>
+#include <algorithm>
+#include <mutex>
+#include <vector>
 #include "concurrent_stack.h"
 #include "utilities.h"
 #include "random_shuffle.h"
 #include "memory_size.h"
+#include "huge_pages.h"
+#include "allocator_registry.h"
+#ifdef NUMA_AWARE
+#include "numa.h"
+#endif
 
 constexpr const size_t default_alloc_size = 1000000;
 constexpr const size_t list_size = 1 << 16;
@@ -56,14 +77,25 @@ class list_allocator {
     size_t sz;
     block* head;
     block* mid;
+    int node; // NUMA node of the worker, or -1 if not yet known
     char cache_line[pad_size];
-  thread_list() : sz(0), head(NULL) {};
+  thread_list() : sz(0), head(NULL), node(-1) {};
   };
 
   using block_p = block*;
 
+  // A region of memory holding blocks, split into lists of list_length
+  struct arena {
+    block_p start;
+    size_t num_blocks;
+    std::vector<unsigned char> list_node; // NUMA node of each list
+  };
+
   static block_p initialize_list(block_p);
-  static block_p get_list();
+  static block_p get_list(int node);
+  static block_p reuse_returned();
+  static int local_node(int id);
+  static int current_node();
 
  public:
   static bool initialized;
@@ -78,12 +110,20 @@ class list_allocator {
   static size_t num_allocated_blocks() {return blocks_allocated;}
   static size_t num_used_blocks();
   static size_t num_used_bytes();
+  static size_t allocated_bytes() {return blocks_allocated*_block_size;}
+  static size_t free_bytes();
+  static size_t returned_bytes() {return blocks_returned*_block_size;}
+  static size_t trim(bool run_seq = false);
   static void print_stats();
 
  private:
   static void rand_shuffle();
-  static concurrent_stack<block_p> pool_roots;
-  static concurrent_stack<block_p> global_stack;
+  static std::mutex arena_mtx; // protects the fields below up to spare_head
+  static std::vector<arena> arenas;
+  static std::vector<std::pair<block_p, size_t>> returned_runs; // of released pages
+  static block_p spare_head; // a free list shorter than list_length, left by trim
+  static concurrent_stack<block_p>* global_stacks; // one per NUMA node
+  static int num_nodes;
   static thread_list* local_lists;
 
   static int thread_count;
@@ -91,14 +131,28 @@ class list_allocator {
   static size_t max_blocks;
   static size_t _block_size;
   static std::atomic<size_t> blocks_allocated;
+  static std::atomic<size_t> blocks_returned;
+  static std::atomic<size_t> spare_count;
   static block_p allocate_blocks(size_t num_blocks);
 };
 
-template<typename T> concurrent_stack<typename list_allocator<T>::block_p>
-list_allocator<T>::pool_roots;
+template<typename T> std::mutex
+list_allocator<T>::arena_mtx;
+
+template<typename T> std::vector<typename list_allocator<T>::arena>
+list_allocator<T>::arenas;
+
+template<typename T> std::vector<std::pair<typename list_allocator<T>::block_p, size_t>>
+list_allocator<T>::returned_runs;
 
-template<typename T> concurrent_stack<typename list_allocator<T>::block_p>
-list_allocator<T>::global_stack;
+template<typename T> typename list_allocator<T>::block_p
+list_allocator<T>::spare_head = NULL;
+
+template<typename T> concurrent_stack<typename list_allocator<T>::block_p>*
+list_allocator<T>::global_stacks;
+
+template<typename T> int
+list_allocator<T>::num_nodes = 1;
 
 template<typename T> bool
 list_allocator<T>::initialized = false;
@@ -121,6 +175,12 @@ list_allocator<T>::_block_size;
 template<typename T> std::atomic<size_t>
 list_allocator<T>::blocks_allocated;
 
+template<typename T> std::atomic<size_t>
+list_allocator<T>::blocks_returned;
+
+template<typename T> std::atomic<size_t>
+list_allocator<T>::spare_count;
+
 // Allocate a new list of list_length elements
 template<typename T>
 auto list_allocator<T>::initialize_list(block_p start) -> block_p {
@@ -137,10 +197,20 @@ auto list_allocator<T>::initialize_list(block_p start) -> block_p {
 
 template<typename T>
 size_t list_allocator<T>::num_used_blocks() {
-  size_t free_blocks = global_stack.size()*list_length;
+  size_t free_blocks = 0;
+  for (int i = 0; i < num_nodes; ++i)
+    free_blocks += global_stacks[i].size()*list_length;
   for (int i = 0; i < thread_count; ++i)
     free_blocks += local_lists[i].sz;
-  return blocks_allocated - free_blocks;
+  return blocks_allocated - free_blocks - spare_count - blocks_returned;
+}
+
+template<typename T>
+size_t list_allocator<T>::free_bytes() {
+  size_t free_blocks = spare_count;
+  for (int i = 0; i < num_nodes; ++i)
+    free_blocks += global_stacks[i].size()*list_length;
+  return free_blocks*_block_size;
 }
 
 template<typename T>
@@ -150,7 +220,16 @@ void list_allocator<T>::print_stats() {
   size_t size = block_size();
   std::cout << "Used: " << used << ", allocated: " << allocated
 		<< ", node size: " << size
-		<< ", bytes: " << size*allocated << std::endl;
+		<< ", bytes: " << size*allocated;
+  if (blocks_returned > 0)
+    std::cout << ", returned bytes: " << returned_bytes();
+  std::cout << std::endl;
+  if (num_nodes > 1) {
+    std::cout << "Free lists per node:";
+    for (int i = 0; i < num_nodes; ++i)
+      std::cout << " " << global_stacks[i].size();
+    std::cout << std::endl;
+  }
 }
 
 template<typename T>
@@ -160,8 +239,8 @@ size_t list_allocator<T>::num_used_bytes() {
 
 template<typename T>
 auto list_allocator<T>::allocate_blocks(size_t num_blocks) -> block_p {
-  block_p start = (block_p) aligned_alloc(pad_size,
-					  num_blocks * _block_size+ pad_size);
+  block_p start = (block_p) huge_pages::alloc(num_blocks * _block_size + pad_size,
+					      pad_size);
   if (start == NULL) {
     fprintf(stderr, "Cannot allocate space in list_allocator");
     exit(1); }
@@ -171,20 +250,200 @@ auto list_allocator<T>::allocate_blocks(size_t num_blocks) -> block_p {
     fprintf(stderr, "Too many blocks in list_allocator, change max_blocks");
     exit(1);  }
 
-  pool_roots.push(start); // keep track so can free later
+  // keep track so can free and trim later; the caller holds arena_mtx
+  arenas.push_back(arena{start, num_blocks,
+	std::vector<unsigned char>(num_blocks / list_length, 0)});
   return start;
 }
 
-// Either grab a list from the global pool, or if there is none
-// then allocate a new list
+// The NUMA node of the calling thread
+template<typename T>
+int list_allocator<T>::current_node() {
+#ifdef NUMA_AWARE
+  return numa::current_node();
+#else
+  return 0;
+#endif
+}
+
+// The NUMA node of worker id, which is pinned so it is looked up once
+template<typename T>
+int list_allocator<T>::local_node(int id) {
+#ifdef NUMA_AWARE
+  if (local_lists[id].node < 0) local_lists[id].node = current_node();
+  return local_lists[id].node;
+#else
+  return 0;
+#endif
+}
+
+// Either grab a list from the global pool of the node, then from the
+// pools of other nodes, or if there is none then allocate a new list,
+// which the caller first touches. Blocks of pages released by trim are
+// used before allocating
 template<typename T>
-auto list_allocator<T>::get_list() -> block_p {
-    maybe<block_p> rem = global_stack.pop();
-    if (rem) return *rem;
+auto list_allocator<T>::get_list(int node) -> block_p {
+    for (int i = 0; i < num_nodes; ++i) {
+      maybe<block_p> rem = global_stacks[(node + i) % num_nodes].pop();
+      if (rem) return *rem;
+    }
+    std::lock_guard<std::mutex> lock(arena_mtx);
+    if (blocks_returned >= list_length) return reuse_returned();
     block_p start = allocate_blocks(list_length);
+    arenas.back().list_node[0] = node;
     return initialize_list(start);
 }
 
+// Links list_length blocks of released pages into a list; the caller
+// holds arena_mtx
+template<typename T>
+auto list_allocator<T>::reuse_returned() -> block_p {
+    block_p head = NULL, tail = NULL;
+    size_t need = list_length;
+    while (need > 0) {
+      auto& run = returned_runs.back();
+      size_t take = std::min(need, run.second);
+      for (size_t i = 0; i < take; i++) {
+	block_p p = run.first + i;
+	if (tail) tail->next = p; else head = p;
+	tail = p;
+      }
+      run.first += take;
+      run.second -= take;
+      if (run.second == 0) returned_runs.pop_back();
+      need -= take;
+    }
+    tail->next = NULL;
+    blocks_returned -= list_length;
+    return head;
+}
+
+// Returns the pages all of whose blocks are on the global pools to the
+// OS, and the number of bytes returned. Runs sequentially if run_seq,
+// which is needed when not called from a worker.
+template<typename T>
+size_t list_allocator<T>::trim(bool run_seq) {
+  if (!initialized) return 0;
+  auto par_for = [&] (size_t s, size_t e, size_t gran, auto f) {
+    if (run_seq) { for (size_t i = s; i < e; i++) f(i); }
+    else parallel_for(s, e, f, gran);
+  };
+  std::lock_guard<std::mutex> lock(arena_mtx);
+
+  // 1. Take the lists of the global pools, and the spare list.
+  std::vector<block_p> lists;
+  for (int i = 0; i < num_nodes; ++i) {
+    maybe<block_p> x;
+    while ((x = global_stacks[i].pop())) lists.push_back(*x);
+  }
+  if (spare_head) lists.push_back(spare_head);
+  spare_head = NULL;
+
+  // 2. Mark their blocks in a bitmap, indexed by arenas in address order.
+  size_t num_arenas = arenas.size();
+  std::vector<size_t> order(num_arenas);
+  for (size_t a = 0; a < num_arenas; a++) order[a] = a;
+  std::sort(order.begin(), order.end(), [&] (size_t x, size_t y) {
+    return arenas[x].start < arenas[y].start; });
+  std::vector<block_p> starts(num_arenas);
+  std::vector<size_t> base(num_arenas + 1, 0);
+  for (size_t a = 0; a < num_arenas; a++) {
+    starts[a] = arenas[order[a]].start;
+    base[a+1] = base[a] + arenas[order[a]].num_blocks;
+  }
+  size_t total = base[num_arenas];
+  size_t num_words = (total + 63) / 64;
+  std::vector<uint64_t> marked(num_words, 0);
+  auto index_of = [&] (block_p p) {
+    size_t a = std::upper_bound(starts.begin(), starts.end(), p) - starts.begin() - 1;
+    return base[a] + (p - starts[a]);
+  };
+  auto block_at = [&] (size_t i) {
+    size_t a = std::upper_bound(base.begin(), base.end(), i) - base.begin() - 1;
+    return starts[a] + (i - base[a]);
+  };
+  auto is_marked = [&] (size_t i) { return (marked[i/64] >> (i%64)) & 1; };
+  par_for(0, lists.size(), 1, [&] (size_t l) {
+    for (block_p p = lists[l]; p; p = p->next) {
+      size_t i = index_of(p);
+      __atomic_fetch_or(&marked[i/64], ((uint64_t)1) << (i%64), __ATOMIC_RELAXED);
+    }
+  });
+
+  // 3. Release runs of pages all of whose blocks are marked, and unmark the
+  // blocks that start in them.
+  size_t returned = 0;
+  for (size_t a = 0; a < num_arenas; a++) {
+    char* lo = (char*) starts[a];
+    char* hi = lo + (base[a+1] - base[a]) * _block_size;
+    size_t P = huge_pages::page_size(starts[a]);
+    char* first = (char*) huge_pages::round_up((size_t) lo, P);
+    size_t num_pages = (hi > first) ? (hi - first) / P : 0;
+    std::vector<char> page_free(num_pages);
+    par_for(0, num_pages, 64, [&] (size_t j) {
+      size_t b0 = (first + j*P - lo) / _block_size;
+      size_t b1 = (first + (j+1)*P - 1 - lo) / _block_size;
+      bool all = true;
+      for (size_t b = b0; all && b <= b1; b++) all = is_marked(base[a] + b);
+      page_free[j] = all;
+    });
+    for (size_t j = 0; j < num_pages; ) {
+      if (!page_free[j]) { j++; continue; }
+      size_t k = j;
+      while (k < num_pages && page_free[k]) k++;
+      char* pa = first + j*P; char* pb = first + k*P;
+      size_t b_start = (pa - lo + _block_size - 1) / _block_size;
+      size_t b_end = (pb - lo + _block_size - 1) / _block_size;
+      if (b_end > b_start && huge_pages::release(pa, pb - pa)) {
+	par_for(b_start, b_end, 1024, [&] (size_t b) {
+	  size_t i = base[a] + b;
+	  __atomic_fetch_and(&marked[i/64], ~(((uint64_t)1) << (i%64)), __ATOMIC_RELAXED);
+	});
+	returned_runs.push_back(std::make_pair(starts[a] + b_start, b_end - b_start));
+	returned += b_end - b_start;
+      }
+      j = k;
+    }
+  }
+
+  // 4. Relink the blocks that are still marked, in address order, into
+  // lists of list_length and one spare list.
+  std::vector<size_t> rank(num_words + 1, 0);
+  std::vector<size_t> next_first(num_words, total); // first marked block after word w
+  for (size_t w = 0; w < num_words; w++) rank[w+1] = rank[w] + __builtin_popcountll(marked[w]);
+  for (size_t w = num_words; w-- > 1; ) {
+    next_first[w-1] = marked[w] ? w*64 + __builtin_ctzll(marked[w]) : next_first[w];
+  }
+  size_t kept = rank[num_words];
+  size_t num_full = kept / list_length;
+  std::vector<block_p> heads(num_full + 1, NULL);
+  par_for(0, num_words, 64, [&] (size_t w) {
+    uint64_t bits = marked[w];
+    size_t r = rank[w];
+    while (bits) {
+      size_t i = w*64 + __builtin_ctzll(bits);
+      bits &= bits - 1;
+      block_p p = block_at(i);
+      if (r % list_length == 0) heads[r / list_length] = p;
+      if (r % list_length == list_length - 1 || r == kept - 1) p->next = NULL;
+      else p->next = block_at(bits ? w*64 + __builtin_ctzll(bits) : next_first[w]);
+      r++;
+    }
+  });
+  for (size_t l = 0; l < num_full; l++) {
+    // return the list to the node that first touched its head
+    size_t i = index_of(heads[l]);
+    size_t a = std::upper_bound(base.begin(), base.end(), i) - base.begin() - 1;
+    auto& nodes = arenas[order[a]].list_node;
+    size_t li = (i - base[a]) / list_length;
+    global_stacks[(li < nodes.size()) ? nodes[li] : 0].push(heads[l]);
+  }
+  spare_head = heads[num_full];
+  spare_count = kept % list_length;
+  blocks_returned += returned;
+  return returned * _block_size;
+}
+
 // Randomly orders the free blocks.  Only used for testing.
 // Not safe if run concurrently with alloc and free
 template<typename T>
@@ -216,10 +475,17 @@ void list_allocator<T>::reserve(size_t n,
   if (!initialized) init();
   max_blocks = _max_blocks;
   size_t num_lists = thread_count + ceil(n / (double)list_length);
-  block_p start = allocate_blocks(list_length*num_lists);
-  parallel_for(0, num_lists, [&] (size_t i) {
-    global_stack.push(initialize_list(start + i*list_length));
-    }, 1);
+  {
+    std::lock_guard<std::mutex> lock(arena_mtx);
+    block_p start = allocate_blocks(list_length*num_lists);
+    auto& nodes = arenas.back().list_node;
+    parallel_for(0, num_lists, [&] (size_t i) {
+      block_p list = initialize_list(start + i*list_length);
+      int node = current_node();
+      nodes[i] = node;
+      global_stacks[node].push(list);
+      }, 1);
+  }
   if (randomize) rand_shuffle();
 }
 
@@ -230,11 +496,11 @@ void list_allocator<T>::init(size_t _alloc_size, size_t _list_size) {
     blocks_allocated = 0;
 
     list_length = _list_size;
-#if defined(CUSTOMPOOL)
-    thread_count = std::thread::hardware_concurrency(); //num_workers();
-#else
-    thread_count = num_workers();
+#ifdef NUMA_AWARE
+    num_nodes = numa::num_nodes();
 #endif
+    global_stacks = new concurrent_stack<block_p>[num_nodes];
+    thread_count = max_worker_ids(); // workers and helper threads
 
     // Hack to account for possible allignment expansion
     // i.e. sizeof(T) might not work -- better way?
@@ -246,6 +512,13 @@ void list_allocator<T>::init(size_t _alloc_size, size_t _list_size) {
 
     // all local lists start out empty
     local_lists = new thread_list[thread_count];
+
+    static bool registered = false;
+    if (!registered) {
+      registered = true;
+      allocator_registry::add({&block_size, &allocated_bytes, &num_used_bytes,
+	    &free_bytes, &returned_bytes, &trim});
+    }
 }
 
 template<typename T>
@@ -254,10 +527,14 @@ void list_allocator<T>::finish() {
 
     delete[] local_lists;
 
-    maybe<block_p> x;
-    while ((x = pool_roots.pop())) std::free(*x);
-    pool_roots.clear();
-    global_stack.clear();
+    for (auto& a : arenas) huge_pages::free(a.start);
+    arenas.clear();
+    returned_runs.clear();
+    spare_head = NULL;
+    spare_count = 0;
+    blocks_returned = 0;
+    for (int i = 0; i < num_nodes; ++i) global_stacks[i].clear();
+    delete[] global_stacks;
 
     blocks_allocated = 0;
     initialized = false;
@@ -271,7 +548,7 @@ void list_allocator<T>::free(T* node) {
     if (local_lists[id].sz == list_length+1) {
       local_lists[id].mid = local_lists[id].head;
     } else if (local_lists[id].sz == 2*list_length) {
-        global_stack.push(local_lists[id].mid->next);
+        global_stacks[local_node(id)].push(local_lists[id].mid->next);
         local_lists[id].mid->next = NULL;
         local_lists[id].sz = list_length;
     }
@@ -285,7 +562,7 @@ inline T* list_allocator<T>::alloc() {
     int id = worker_id();
 
     if (!local_lists[id].sz)  {
-      local_lists[id].head = get_list();
+      local_lists[id].head = get_list(local_node(id));
       local_lists[id].sz = list_length;
     }
 
@@ -0,0 +1,78 @@
+#pragma once
+
+// NUMA topology from /sys/devices/system/node, without libnuma. On systems
+// without that directory everything is on node 0. Nodes are assumed to be
+// numbered contiguously from 0.
+
+#include <sched.h>
+#include <pthread.h>
+#include <cstdio>
+#include <vector>
+
+namespace numa {
+
+  struct topology {
+    int nodes = 1;
+    std::vector<int> cpu_node; // node of each cpu
+    std::vector<int> allowed;  // cpus the process may run on, at startup
+
+    topology() {
+      int found = 0;
+      for (int node = 0; ; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* f = fopen(path, "r");
+        if (!f) break;
+        found = node + 1;
+        // cpulist is a comma separated list of ranges, e.g. 0-23,48-71
+        int lo, hi; char sep;
+        while (fscanf(f, "%d", &lo) == 1) {
+          hi = lo;
+          if (fscanf(f, "%c", &sep) == 1 && sep == '-') {
+            if (fscanf(f, "%d", &hi) != 1) break;
+            if (fscanf(f, "%c", &sep) != 1) sep = '\n';
+          }
+          if ((int)cpu_node.size() <= hi) cpu_node.resize(hi+1, 0);
+          for (int c = lo; c <= hi; c++) cpu_node[c] = node;
+          if (sep != ',') break;
+        }
+        fclose(f);
+      }
+      if (found > 0) nodes = found;
+      cpu_set_t mask;
+      if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+          if (CPU_ISSET(c, &mask)) allowed.push_back(c);
+        }
+      }
+    }
+  };
+
+  inline const topology& get_topology() {
+    static topology t;
+    return t;
+  }
+
+  inline int num_nodes() { return get_topology().nodes; }
+
+  inline int node_of_cpu(int cpu) {
+    const auto& t = get_topology();
+    return (cpu >= 0 && cpu < (int)t.cpu_node.size()) ? t.cpu_node[cpu] : 0;
+  }
+
+  // The node of the cpu the calling thread is running on.
+  inline int current_node() { return node_of_cpu(sched_getcpu()); }
+
+  // Pins the calling thread to the i-th cpu (mod the number of cpus) that the
+  // process could run on when the topology was first read, so restrictions
+  // such as taskset are respected.
+  inline void pin_thread(int i) {
+    const auto& allowed = get_topology().allowed;
+    if (allowed.empty()) return;
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(allowed[i % allowed.size()], &one);
+    pthread_setaffinity_np(pthread_self(), sizeof(one), &one);
+  }
+
+} // namespace numa
@@ -33,6 +33,22 @@ static void parallel_for(long start, long end, F f,
 template <typename Lf, typename Rf>
 static void par_do(Lf left, Rf right, bool conservative=false);
 
+// Helper threads are threads outside the scheduler, such as the background
+// reclaimer in graph/versioning_utils.h, that run library code. Helper i
+// takes a worker id of its own past those of the workers, so that per-worker
+// state sized by max_worker_ids() (e.g. the allocators' local lists) is not
+// shared, and runs par_do and parallel_for sequentially, so it never touches
+// the scheduler. Returns false if the scheduler does not support helpers
+// (only HOMEGROWN does), in which case the thread must not run such code.
+static constexpr int max_helper_threads = 8;
+static bool become_helper_thread(int i);
+
+// Bound on worker_id(), counting helper threads.
+static int max_worker_ids();
+
+inline int& helper_index() { static thread_local int i = -1; return i; }
+inline bool is_helper_thread() { return helper_index() >= 0; }
+
 //***************************************
 
 // cilkplus
@@ -45,6 +61,8 @@ static void par_do(Lf left, Rf right, bool conservative=false);
 
 inline int num_workers() {return __cilkrts_get_nworkers();}
 inline int worker_id() {return __cilkrts_get_worker_number();}
+inline int max_worker_ids() { return num_workers(); }
+inline bool become_helper_thread(int i) { return false; }
 inline void set_num_workers(int n) {
   __cilkrts_end_cilk();
   std::stringstream ss; ss << n;
@@ -85,6 +103,8 @@ inline void par_do(Lf left, Rf right, bool conservative) {
 
 inline int num_workers() { return omp_get_max_threads(); }
 inline int worker_id() { return omp_get_thread_num(); }
+inline int max_worker_ids() { return num_workers(); }
+inline bool become_helper_thread(int i) { return false; }
 inline void set_num_workers(int n) { omp_set_num_threads(n); }
 
 template <class F>
@@ -133,15 +153,28 @@ inline void destroy_fj() {
 }
 
 inline int num_workers() {
+  if (is_helper_thread()) return 1;
   fork_join_scheduler* fj = (fork_join_scheduler*)fork_join_sched_ptr;
   return fj->num_workers();
 }
 
+// Global ids of the pools are below the hardware concurrency.
+inline int max_worker_ids() {
+  return std::thread::hardware_concurrency() + max_helper_threads;
+}
+
 inline int worker_id() {
+  if (is_helper_thread()) return std::thread::hardware_concurrency() + helper_index();
   fork_join_scheduler* fj = (fork_join_scheduler*)fork_join_sched_ptr;
   return fj->global_worker_id();
 }
 
+inline bool become_helper_thread(int i) {
+  if (i < 0 || i >= max_helper_threads) return false;
+  helper_index() = i;
+  return true;
+}
+
 inline void set_num_workers(int n) {
 }
 
@@ -149,6 +182,10 @@ template <class F>
 inline void parallel_for(long start, long end, F f,
 			 long granularity,
 			 bool conservative) {
+  if (is_helper_thread()) {
+    for (long i=start; i<end; i++) f(i);
+    return;
+  }
   fork_join_scheduler* fj = (fork_join_scheduler*)fork_join_sched_ptr;
   return fj->parfor(start, end, f, granularity, conservative);
 //  fj.parfor(start, end, f, granularity, conservative);
@@ -156,6 +193,7 @@ inline void parallel_for(long start, long end, F f,
 
 template <typename Lf, typename Rf>
 inline void par_do(Lf left, Rf right, bool conservative) {
+  if (is_helper_thread()) { left(); right(); return; }
   fork_join_scheduler* fj = (fork_join_scheduler*)fork_join_sched_ptr;
   return fj->pardo(left, right, conservative);
 //  return fj.pardo(left, right, conservative);
@@ -189,9 +227,20 @@ inline int num_workers() {
 }
 
 inline int worker_id() {
+  if (is_helper_thread()) return fj.num_workers() + helper_index();
   return fj.worker_id();
 }
 
+inline int max_worker_ids() {
+  return fj.num_workers() + max_helper_threads;
+}
+
+inline bool become_helper_thread(int i) {
+  if (i < 0 || i >= max_helper_threads) return false;
+  helper_index() = i;
+  return true;
+}
+
 inline void set_num_workers(int n) {
   fj.set_num_workers(n);
 }
@@ -200,11 +249,16 @@ template <class F>
 inline void parallel_for(long start, long end, F f,
 			 long granularity,
 			 bool conservative) {
+  if (is_helper_thread()) {
+    for (long i=start; i<end; i++) f(i);
+    return;
+  }
   fj.parfor(start, end, f, granularity, conservative);
 }
 
 template <typename Lf, typename Rf>
 inline void par_do(Lf left, Rf right, bool conservative) {
+  if (is_helper_thread()) { left(); right(); return; }
   return fj.pardo(left, right, conservative);
 }
 
@@ -220,6 +274,8 @@ inline void parallel_run(Job job, int num_threads=0) {
 
 inline int num_workers() { return 1;}
 inline int worker_id() { return 0;}
+inline int max_worker_ids() { return num_workers(); }
+inline bool become_helper_thread(int i) { return false; }
 inline void set_num_workers(int n) { ; }
 #define PAR_GRANULARITY 1000
 
@@ -6,6 +6,10 @@
 #include <iostream>
 #include <functional>
 
+#ifdef NUMA_AWARE
+#include "numa.h"
+#endif
+
 // EXAMPLE USE 1:
 //
 // fork_join_scheduler fj;
@@ -160,12 +164,22 @@ public:
     spawned_threads = new std::thread[num_threads-1];
     std::function<bool()> finished = [&] () {  return finished_flag == 1; };
     thread_id = 0; // thread-local write
+#ifdef NUMA_AWARE
+    // Workers are pinned so that memory they first touch stays on their node.
+    numa::get_topology();
+#endif
     for (int i=1; i<num_threads; i++) {
       spawned_threads[i-1] = std::thread([&, i, finished] () {
         thread_id = i; // thread-local write
+#ifdef NUMA_AWARE
+        numa::pin_thread(i);
+#endif
         start(finished);
       });
     }
+#ifdef NUMA_AWARE
+    numa::pin_thread(0);
+#endif
   }
 
   ~scheduler() {
@@ -10,11 +10,11 @@ mkdir -p data/parallel_times/
 make run_static_algorithm
 
 for graph in "${c_graphs[@]}"; do
-  numactl -i all ./run_static_algorithm -all -src 100000 -nsrc 120 -c -nparts 16 -s -m -f inputs/${graph} > data/parallel_times/${graph}-par.dat
+  numactl -i all ./run_static_algorithm -all -src 100000 -nsrc 120 -c -s -m -f inputs/${graph} > data/parallel_times/${graph}-par.dat
 
   # run sequentially
   export NUM_THREADS=1
-  numactl -i all ./run_static_algorithm -all -src 100000 -nsrc 120 -c -nparts 16 -s -m -f inputs/${graph} > data/parallel_times/${graph}-seq.dat
+  numactl -i all ./run_static_algorithm -all -src 100000 -nsrc 120 -c -s -m -f inputs/${graph} > data/parallel_times/${graph}-seq.dat
   unset NUM_THREADS
 done
 
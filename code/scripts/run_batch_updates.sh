@@ -23,12 +23,12 @@ make run_batch_updates
 
 echo "Running batch updates on clueweb_sym. Data written to data/batch_updates/clueweb_sym.dat"
 touch data/batch_updates/clueweb_sym.dat
-numactl -i all ./run_batch_updates -s -m -c -nparts 10 -f inputs/clueweb_sym.bytepda >> data/batch_updates/clueweb_sym.dat
+numactl -i all ./run_batch_updates -s -m -c -f inputs/clueweb_sym.bytepda >> data/batch_updates/clueweb_sym.dat
 #
 #echo "Running batch updates on hyperlink2014_sym. Data written to data/batch_updates/hyperlink2014_sym.dat"
 #touch data/batch_updates/hyperlink2014_sym.dat
-#numactl -i all ./run_batch_updates -s -m -c -nparts 12 -f inputs/hyperlink2014_sym.bytepda >> data/batch_updates/hyperlink2014_sym.dat
+#numactl -i all ./run_batch_updates -s -m -c -f inputs/hyperlink2014_sym.bytepda >> data/batch_updates/hyperlink2014_sym.dat
 
 #echo "Running batch updates on hyperlink2012_sym. Data written to data/batch_updates/hyperlink2012_sym.dat"
 #touch data/batch_updates/hyperlink2012_sym.dat
-#numactl -i all ./run_batch_updates -s -m -c -nparts 16 -f inputs/hyperlink2012_sym.bytepda >> data/batch_updates/hyperlink2012_sym.dat
+#numactl -i all ./run_batch_updates -s -m -c -f inputs/hyperlink2012_sym.bytepda >> data/batch_updates/hyperlink2012_sym.dat
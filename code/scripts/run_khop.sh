@@ -23,12 +23,12 @@ numactl -i all ./run_static_algorithm -BS 144 -t KHOP -nsrc 200 -s -m -f inputs/
 #
 #echo "Running kHop queries on clueweb_sym. Data written to data/static_algorithms/khop/clueweb_sym.dat"
 #touch data/static_algorithms/khop/clueweb_sym.dat
-#numactl -i all ./run_static_algorithm -BS 40 -t KHOP -nsrc 120 -s -m -c -nparts 8 -f inputs/clueweb_sym.bytepda >> data/static_algorithms/khop/clueweb_sym.dat
+#numactl -i all ./run_static_algorithm -BS 40 -t KHOP -nsrc 120 -s -m -c -f inputs/clueweb_sym.bytepda >> data/static_algorithms/khop/clueweb_sym.dat
 #
 #echo "Running kHop queries on hyperlink2014_sym. Data written to data/static_algorithms/khop/hyperlink2014_sym.dat"
 #touch data/static_algorithms/khop/hyperlink2014_sym.dat
-#numactl -i all ./run_static_algorithm -BS 40 -t KHOP -nsrc 120 -s -m -c nparts 10 -f inputs/hyperlink2014_sym.bytepda >> data/static_algorithms/khop/hyperlink2014_sym.dat
+#numactl -i all ./run_static_algorithm -BS 40 -t KHOP -nsrc 120 -s -m -c -f inputs/hyperlink2014_sym.bytepda >> data/static_algorithms/khop/hyperlink2014_sym.dat
 #
 #echo "Running kHop queries on hyperlink2012_sym. Data written to data/static_algorithms/khop/hyperlink2012_sym.dat"
 #touch data/static_algorithms/khop/hyperlink2012_sym.dat
-#numactl -i all ./run_static_algorithm -BS 40 -t KHOP -nsrc 120 -s -m -c -nparts 16 -f inputs/hyperlink2012_sym.bytepda >> data/static_algorithms/khop/hyperlink2012_sym.dat
+#numactl -i all ./run_static_algorithm -BS 40 -t KHOP -nsrc 120 -s -m -c -f inputs/hyperlink2012_sym.bytepda >> data/static_algorithms/khop/hyperlink2012_sym.dat
@@ -15,5 +15,5 @@ for graph in "${graphs[@]}"; do
 done
 
 for graph in "${c_graphs[@]}"; do
-  numactl -i all ./memory_footprint -c -nparts 16 -s -m -f inputs/${graph} > data/memory_footprint/${graph}.dat
+  numactl -i all ./memory_footprint -c -s -m -f inputs/${graph} > data/memory_footprint/${graph}.dat
 done
@@ -23,12 +23,12 @@ numactl -i all ./run_static_algorithm -BS 144 -t NIBBLE -nsrc 1024 -s -m -f inpu
 #
 #echo "Running Nibble queries on clueweb_sym. Data written to data/static_algorithms/nibble/clueweb_sym.dat"
 #touch data/static_algorithms/nibble/clueweb_sym.dat
-#numactl -i all ./run_static_algorithm -BS 144 -t NIBBLE -nsrc 1024 -s -m -c -nparts 8 -f inputs/clueweb_sym.bytepda >> data/static_algorithms/nibble/clueweb_sym.dat
+#numactl -i all ./run_static_algorithm -BS 144 -t NIBBLE -nsrc 1024 -s -m -c -f inputs/clueweb_sym.bytepda >> data/static_algorithms/nibble/clueweb_sym.dat
 #
 #echo "Running Nibble queries on hyperlink2014_sym. Data written to data/static_algorithms/nibble/hyperlink2014_sym.dat"
 #touch data/static_algorithms/nibble/hyperlink2014_sym.dat
-#numactl -i all ./run_static_algorithm -BS 144 -t NIBBLE -nsrc 1024 -s -m -c nparts 10 -f inputs/hyperlink2014_sym.bytepda >> data/static_algorithms/nibble/hyperlink2014_sym.dat
+#numactl -i all ./run_static_algorithm -BS 144 -t NIBBLE -nsrc 1024 -s -m -c -f inputs/hyperlink2014_sym.bytepda >> data/static_algorithms/nibble/hyperlink2014_sym.dat
 #
 #echo "Running Nibble queries on hyperlink2012_sym. Data written to data/static_algorithms/nibble/hyperlink2012_sym.dat"
 #touch data/static_algorithms/nibble/hyperlink2012_sym.dat
-#numactl -i all ./run_static_algorithm -BS 144 -t NIBBLE -nsrc 1024 -s -m -c -nparts 16 -f inputs/hyperlink2012_sym.bytepda >> data/static_algorithms/nibble/hyperlink2012_sym.dat
+#numactl -i all ./run_static_algorithm -BS 144 -t NIBBLE -nsrc 1024 -s -m -c -f inputs/hyperlink2012_sym.bytepda >> data/static_algorithms/nibble/hyperlink2012_sym.dat
@@ -42,28 +42,28 @@ numactl -i all ./run_simultaneous_updates_queries -noquery -m -s -f inputs/twitt
 # echo "Data will be written to data/simultaneous_updates_queries/clueweb.dat.\n"
 # touch data/simultaneous_updates_queries/clueweb.dat
 # echo "Running simultaneous queries and updates on clueweb_sym\n" > data/simultaneous_updates_queries/clueweb.dat
-# numactl -i all ./run_simultaneous_updates_queries -queryiters 30 -m -s -c -nparts 8 -f inputs/clueweb_sym.bytepda >> data/simultaneous_updates_queries/clueweb.dat
+# numactl -i all ./run_simultaneous_updates_queries -queryiters 30 -m -s -c -f inputs/clueweb_sym.bytepda >> data/simultaneous_updates_queries/clueweb.dat
 # echo "\nRunning just queries on clueweb_sym\n" >> data/simultaneous_updates_queries/clueweb.dat
-# numactl -i all ./run_simultaneous_updates_queries -noupdate -queryiters 30 -m -s -c -nparts 8 -f inputs/clueweb_sym.bytepda >> data/simultaneous_updates_queries/clueweb.dat
+# numactl -i all ./run_simultaneous_updates_queries -noupdate -queryiters 30 -m -s -c -f inputs/clueweb_sym.bytepda >> data/simultaneous_updates_queries/clueweb.dat
 # echo "\nRunning just updates on clueweb_sym\n" >> data/simultaneous_updates_queries/clueweb.dat
-# numactl -i all ./run_simultaneous_updates_queries -noquery -m -s -c -nparts 8  -f inputs/clueweb_sym.bytepda >> data/simultaneous_updates_queries/clueweb.dat
+# numactl -i all ./run_simultaneous_updates_queries -noquery -m -s -c  -f inputs/clueweb_sym.bytepda >> data/simultaneous_updates_queries/clueweb.dat
 #
 # echo "Running simultaneous queries and updates on hyperlink2014_sym\n"
 # echo "Data will be written to data/simultaneous_updates_queries/hyperlink2014_sym.dat.\n"
 # touch data/simultaneous_updates_queries/hyperlink2014_sym.dat
 # echo "Running simultaneous queries and updates on hyperlink2014_sym\n" > data/simultaneous_updates_queries/hyperlink2014_sym.dat
-# numactl -i all ./run_simultaneous_updates_queries -queryiters 30 -m -s -c -nparts 8 -f inputs/hyperlink2014_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
+# numactl -i all ./run_simultaneous_updates_queries -queryiters 30 -m -s -c -f inputs/hyperlink2014_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
 # echo "\nRunning just queries on hyperlink2014_sym\n" >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
-# numactl -i all ./run_simultaneous_updates_queries -noupdate -queryiters 30 -m -s -c -nparts 8 -f inputs/hyperlink2014_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
+# numactl -i all ./run_simultaneous_updates_queries -noupdate -queryiters 30 -m -s -c -f inputs/hyperlink2014_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
 # echo "\nRunning just updates on hyperlink2014_sym\n" >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
-# numactl -i all ./run_simultaneous_updates_queries -noquery -m -s -c -nparts 8  -f inputs/hyperlink2014_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
+# numactl -i all ./run_simultaneous_updates_queries -noquery -m -s -c  -f inputs/hyperlink2014_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2014_sym.dat
 #
 # echo "Running simultaneous queries and updates on hyperlink2012_sym\n"
 # echo "Data will be written to data/simultaneous_updates_queries/hyperlink2012_sym.dat.\n"
 # touch data/simultaneous_updates_queries/hyperlink2012_sym.dat
 # echo "Running simultaneous queries and updates on hyperlink2012_sym\n" > data/simultaneous_updates_queries/hyperlink2012_sym.dat
-# numactl -i all ./run_simultaneous_updates_queries -queryiters 30 -m -s -c -nparts 8 -f inputs/hyperlink2012_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
+# numactl -i all ./run_simultaneous_updates_queries -queryiters 30 -m -s -c -f inputs/hyperlink2012_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
 # echo "\nRunning just queries on hyperlink2012_sym\n" >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
-# numactl -i all ./run_simultaneous_updates_queries -noupdate -queryiters 30 -m -s -c -nparts 8 -f inputs/hyperlink2012_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
+# numactl -i all ./run_simultaneous_updates_queries -noupdate -queryiters 30 -m -s -c -f inputs/hyperlink2012_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
 # echo "\nRunning just updates on hyperlink2012_sym\n" >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
-# numactl -i all ./run_simultaneous_updates_queries -noquery -m -s -c -nparts 8  -f inputs/hyperlink2012_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
+# numactl -i all ./run_simultaneous_updates_queries -noquery -m -s -c  -f inputs/hyperlink2012_sym.bytepda >> data/simultaneous_updates_queries/hyperlink2012_sym.dat
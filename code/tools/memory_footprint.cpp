@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <cmath>
+#include <unistd.h>
 
 using namespace std;
 using edge_seq = pair<uintV, uintV>;
@@ -12,6 +13,59 @@ void print_stats(Graph& G) {
   Graph::print_stats();
 }
 
+// Resident set size of the process in bytes.
+size_t resident_bytes() {
+  size_t pages = 0, resident = 0;
+  FILE* f = fopen("/proc/self/statm", "r");
+  if (f) {
+    if (fscanf(f, "%zu %zu", &pages, &resident) != 2) resident = 0;
+    fclose(f);
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+// Deletes -delete_frac of the edges of the graph and releases the old
+// version, then returns the freed memory to the OS, either with an explicit
+// trim or, with -trim_bg, by a background trimmer. Reports the memory of
+// each allocator and the resident set size at each step.
+void trim_after_deletions(commandLine& P) {
+  double frac = P.getOptionDoubleValue("-delete_frac", 0.5);
+  auto VG = initialize_treeplus_graph(P);
+  cout << "after build: resident " << resident_bytes() << " bytes" << endl;
+  allocator_registry::print_stats();
+
+  {
+    auto S = VG.acquire_version();
+    auto edges = S.graph.retrieve_edges();
+    // Deletes both directions of an edge, so symmetric graphs stay symmetric.
+    auto chosen = [&] (const tuple<uintV, uintV>& e) {
+      uintV u = std::min(get<0>(e), get<1>(e)), v = std::max(get<0>(e), get<1>(e));
+      return (pbbs::hash64((((uint64_t)u) << 32) | v) % 1000000) < frac * 1000000;
+    };
+    auto deletions = pbbs::filter(edges, chosen);
+    VG.release_version(std::move(S));
+    timer dt; dt.start();
+    VG.delete_edges_batch(deletions.size(), deletions.begin());
+    dt.stop();
+    cout << "deleted " << deletions.size() << " of " << edges.size() << " edges in "
+         << dt.get_total() << " seconds" << endl;
+  }
+  cout << "after deletions: resident " << resident_bytes() << " bytes" << endl;
+  allocator_registry::print_stats();
+
+  timer tt; tt.start();
+  if (P.getOption("-trim_bg")) {
+    allocator_registry::background_trimmer trimmer(/* threshold */ 0, /* period_ms */ 100);
+    sleep(1);
+  } else {
+    size_t bytes = allocator_registry::trim_all();
+    cout << "trim returned " << bytes << " bytes" << endl;
+  }
+  tt.stop();
+  cout << "after trim (" << tt.get_total() << " seconds): resident " << resident_bytes() << " bytes" << endl;
+  allocator_registry::print_stats();
+}
+
 void memory_footprint(commandLine& P) {
   // Initialize the graph.
   auto VG = initialize_treeplus_graph(P);
@@ -21,6 +75,7 @@ void memory_footprint(commandLine& P) {
 
   S.graph.print_compression_stats();
   print_stats(S.graph);
+  allocator_registry::print_stats();
 
   size_t rep_size = S.graph.size_in_bytes();
   cout << "calculated size in GB (bytes/1024**3) = " << ((rep_size*1.0)/1024/1024/1024) << endl;
@@ -28,6 +83,10 @@ void memory_footprint(commandLine& P) {
 
 int main(int argc, char** argv) {
   cout << "Running Aspen using " << num_workers() << " threads." << endl;
-  commandLine P(argc, argv, "./memory_footprint [-f graph_file -m (mmap)]");
-  memory_footprint(P);
+  commandLine P(argc, argv, "./memory_footprint [-f graph_file -m (mmap)] [-trim -delete_frac f -trim_bg]");
+  if (P.getOption("-trim")) {
+    trim_after_deletions(P);
+  } else {
+    memory_footprint(P);
+  }
 }
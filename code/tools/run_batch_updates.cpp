@@ -1,4 +1,7 @@
 #include "../graph/api.h"
+#include "../algorithms/Connectivity.h"
+#include "../algorithms/PageRank.h"
+#include "../algorithms/Triangle.h"
 #include "../trees/utils.h"
 #include "../lib_extensions/sparse_table_hash.h"
 #include "../pbbslib/random_shuffle.h"
@@ -6,6 +9,7 @@
 #include <cstring>
 
 #include <vector>
+#include <map>
 #include <algorithm>
 #include <chrono>
 #include <thread>
@@ -107,9 +111,378 @@ void parallel_updates(commandLine& P) {
   }
 }
 
+// Producers submit small batches of insertions concurrently through an
+// update_pipeline, which merges them into larger batches. The throughput is
+// compared against applying the same small batches one at a time.
+void pipelined_updates(commandLine& P) {
+  size_t n_producers = P.getOptionLongValue("-producers", 4);
+  size_t chunk_size = P.getOptionLongValue("-chunk", 1000);
+  size_t total = P.getOptionLongValue("-total", 1000000);
+  size_t max_batch = P.getOptionLongValue("-batch", 1 << 16);
+  size_t publish_usec = P.getOptionLongValue("-publish_usec", 1000);
+
+  auto VG = initialize_treeplus_graph(P);
+  auto S = VG.acquire_version();
+  size_t n = S.graph.num_vertices();
+  VG.release_version(std::move(S));
+
+  using pair_vertex = tuple<uintV, uintV>;
+  size_t nn = 1 << (pbbs::log2_up(n) - 1);
+  size_t per_producer = total / n_producers;
+  auto r = pbbs::random();
+  auto make_updates = [&] (size_t p, size_t seed) {
+    auto rmat = rMat<uintV>(nn, r.ith_rand(seed + p), 0.5, 0.1, 0.1);
+    std::vector<pair_vertex> updates(per_producer);
+    for (size_t i=0; i<per_producer; i++) {
+      auto e = rmat(i);
+      updates[i] = make_tuple(e.first, e.second);
+    }
+    return updates;
+  };
+
+  // serial: each chunk is published as its own version
+  {
+    std::vector<std::vector<pair_vertex>> updates;
+    for (size_t p=0; p<n_producers; p++) updates.push_back(make_updates(p, 0));
+    timer st; st.start();
+    for (size_t p=0; p<n_producers; p++) {
+      for (size_t i=0; i<per_producer; i += chunk_size) {
+        size_t m = std::min(chunk_size, per_producer - i);
+        VG.insert_edges_batch(m, updates[p].data() + i, false, true, nn, false);
+      }
+    }
+    double t = st.stop();
+    cout << "serial: " << (n_producers*per_producer) << " updates in " << t
+         << "s, " << ((n_producers*per_producer) / t) << " updates/s" << endl;
+  }
+
+  // pipelined
+  {
+    std::vector<std::vector<pair_vertex>> updates;
+    for (size_t p=0; p<n_producers; p++) updates.push_back(make_updates(p, n_producers));
+    update_pipeline<decltype(VG)> pipe(VG, max_batch, publish_usec);
+    timer st; st.start();
+    std::vector<std::thread> producers;
+    for (size_t p=0; p<n_producers; p++) {
+      producers.emplace_back([&, p] () {
+        for (size_t i=0; i<per_producer; i += chunk_size) {
+          size_t m = std::min(chunk_size, per_producer - i);
+          pipe.insert_edges(m, updates[p].data() + i);
+        }
+      });
+    }
+    std::thread closer([&] () {
+      for (auto& t : producers) t.join();
+      pipe.close();
+    });
+    pipe.run();
+    closer.join();
+    double t = st.stop();
+    cout << "pipelined: " << (n_producers*per_producer) << " updates in " << t
+         << "s, " << ((n_producers*per_producer) / t) << " updates/s" << endl;
+    pipe.print_stats();
+  }
+}
+
+// Applies -batches batches of -batch_size insertions while keeping the last
+// -retain versions, then reads every retained version back with
+// acquire_version_at and reports the memory that each one alone keeps alive.
+void retained_versions(commandLine& P) {
+  size_t keep_last = P.getOptionLongValue("-retain", 8);
+  size_t n_batches = P.getOptionLongValue("-batches", 16);
+  size_t batch_size = P.getOptionLongValue("-batch_size", 10000);
+
+  auto VG = initialize_treeplus_graph(P);
+  VG.set_retention(retention_policy(keep_last));
+
+  using pair_vertex = tuple<uintV, uintV>;
+  std::map<size_t, size_t> edges_at; // edge count of every version
+  auto S = VG.acquire_version();
+  size_t n = S.graph.num_vertices();
+  edges_at[S.timestamp] = S.graph.num_edges();
+  VG.release_version(std::move(S));
+
+  size_t nn = 1 << (pbbs::log2_up(n) - 1);
+  auto r = pbbs::random();
+  auto updates = pbbs::sequence<pair_vertex>(batch_size);
+  for (size_t b=0; b<n_batches; b++) {
+    auto rmat = rMat<uintV>(nn, r.ith_rand(b), 0.5, 0.1, 0.1);
+    parallel_for(0, batch_size, [&] (size_t i) {
+      auto e = rmat(i);
+      updates[i] = make_tuple(e.first, e.second);
+    });
+    VG.insert_edges_batch(batch_size, updates.begin(), false, true, nn, false);
+    auto S = VG.acquire_version();
+    edges_at[S.timestamp] = S.graph.num_edges();
+    VG.release_version(std::move(S));
+  }
+
+  size_t total_bytes = 0;
+  for (auto& tb : VG.retained_bytes()) {
+    auto S = VG.acquire_version_at(tb.first);
+    size_t m = S.graph.num_edges();
+    if (m != edges_at[S.timestamp]) {
+      cout << "version " << S.timestamp << " has " << m << " edges, expected "
+           << edges_at[S.timestamp] << endl;
+      exit(0);
+    }
+    VG.release_version(std::move(S));
+    cout << "version " << tb.first << ": m = " << m << " unshared bytes = " << tb.second << endl;
+    total_bytes += tb.second;
+  }
+  cout << "retained " << VG.retained_timestamps().size() << " versions, "
+       << total_bytes << " unshared bytes" << endl;
+}
+
+// Applies a mixed batch of -batch_size updates, half of which delete existing
+// edges, and diffs the versions before and after it. The diff is checked
+// against, and timed against, comparing all edges of both versions.
+void version_diff(commandLine& P) {
+  size_t batch_size = P.getOptionLongValue("-batch_size", 10000);
+
+  auto VG = initialize_treeplus_graph(P);
+  using edge = tuple<uintV, uintV>;
+  auto A = VG.acquire_version();
+  size_t n = A.graph.num_vertices();
+  auto edges_a = A.graph.retrieve_edges();
+
+  auto r = pbbs::random();
+  size_t nn = 1 << (pbbs::log2_up(n) - 1);
+  auto rmat = rMat<uintV>(nn, r.ith_rand(0), 0.5, 0.1, 0.1);
+  auto updates = pbbs::sequence<edge_update>(batch_size, [&] (size_t i) {
+    if (i % 2 == 0) {
+      auto e = rmat(i);
+      return make_tuple(e.first, e.second, true);
+    }
+    auto e = edges_a[r.ith_rand(i) % edges_a.size()];
+    return make_tuple(get<0>(e), get<1>(e), false);
+  });
+  VG.apply_updates_batch(batch_size, updates.begin());
+  auto B = VG.acquire_version();
+
+  timer dt; dt.start();
+  auto D = VG.diff(A, B);
+  double diff_time = dt.stop();
+
+  timer st; st.start();
+  auto edges_b = B.graph.retrieve_edges();
+  auto less = [&] (const edge& x, const edge& y) { return x < y; };
+  auto inserted = pbbs::sequence<edge>(edges_b.size());
+  auto deleted = pbbs::sequence<edge>(edges_a.size());
+  size_t n_ins = std::set_difference(edges_b.begin(), edges_b.end(), edges_a.begin(),
+                                     edges_a.end(), inserted.begin(), less) - inserted.begin();
+  size_t n_del = std::set_difference(edges_a.begin(), edges_a.end(), edges_b.begin(),
+                                     edges_b.end(), deleted.begin(), less) - deleted.begin();
+  double scan_time = st.stop();
+
+  bool ok = (n_ins == D.inserted.size()) && (n_del == D.deleted.size());
+  for (size_t i=0; ok && i<n_ins; i++) ok = (inserted[i] == D.inserted[i]);
+  for (size_t i=0; ok && i<n_del; i++) ok = (deleted[i] == D.deleted[i]);
+  if (!ok) {
+    cout << "diff mismatch: inserted " << D.inserted.size() << " (expected " << n_ins
+         << "), deleted " << D.deleted.size() << " (expected " << n_del << ")" << endl;
+    exit(0);
+  }
+  cout << "diff: inserted = " << n_ins << " deleted = " << n_del
+       << " touched vertices = " << D.touched.size() << endl;
+  cout << "diff time = " << diff_time << " full comparison time = " << scan_time << endl;
+  VG.release_version(std::move(A));
+  VG.release_version(std::move(B));
+}
+
+// A batch of batch_size symmetric edge updates to a graph with n vertices and
+// (sorted) edges, with both directions of each edge. Half of the updates
+// insert rMat edges and half delete existing edges. Self-loops are dropped.
+template <class E>
+pbbs::sequence<edge_update> symmetric_mixed_batch(size_t n, E& edges, size_t batch_size, size_t seed) {
+  auto r = pbbs::random(seed);
+  size_t nn = 1 << (pbbs::log2_up(n) - 1);
+  auto rmat = rMat<uintV>(nn, r.ith_rand(0), 0.5, 0.1, 0.1);
+  auto updates = pbbs::sequence<edge_update>(2*batch_size);
+  parallel_for(0, batch_size, [&] (size_t i) {
+    uintV u, v; bool insert = (i % 2 == 0);
+    if (insert) {
+      auto e = rmat(i);
+      u = e.first; v = e.second;
+    } else {
+      auto e = edges[r.ith_rand(i+1) % edges.size()];
+      u = get<0>(e); v = get<1>(e);
+    }
+    updates[2*i] = make_tuple(u, v, insert);
+    updates[2*i+1] = make_tuple(v, u, insert);
+  });
+  return pbbs::filter(updates, [&] (const edge_update& e) { return get<0>(e) != get<1>(e); });
+}
+
+// Maintains PageRank across -batches batches of -batch_size symmetric edge
+// updates, half of which delete existing edges. Each incremental update, with
+// tolerance -inc_e, is compared with recomputing the ranks from scratch.
+void incremental_pagerank(commandLine& P) {
+  size_t n_batches = P.getOptionLongValue("-batches", 4);
+  size_t batch_size = P.getOptionLongValue("-batch_size", 1000);
+  double epsilon = P.getOptionDoubleValue("-e", 1e-7);
+  double inc_epsilon = P.getOptionDoubleValue("-inc_e", epsilon);
+  bool print_stats = P.getOptionValue("-stats");
+
+  auto VG = initialize_treeplus_graph(P);
+  pbbs::sequence<double> p;
+  {
+    auto S = VG.acquire_version();
+    p = PageRank(S.graph, epsilon);
+    VG.release_version(std::move(S));
+  }
+
+  for (size_t b=0; b<n_batches; b++) {
+    auto A = VG.acquire_version();
+    auto edges_a = A.graph.retrieve_edges();
+    auto updates = symmetric_mixed_batch(A.graph.num_vertices(), edges_a, batch_size, b);
+    VG.apply_updates_batch(updates.size(), updates.begin());
+    auto B = VG.acquire_version();
+
+    timer it; it.start();
+    auto D = VG.diff(A, B);
+    PageRank_incremental(B.graph, p, D, inc_epsilon, 0.85, print_stats);
+    double inc_time = it.stop();
+
+    timer ft; ft.start();
+    auto q = PageRank(B.graph, epsilon);
+    double full_time = ft.stop();
+
+    auto diffs = pbbs::delayed_seq<double>(q.size(), [&] (size_t i) { return std::fabs(p[i] - q[i]); });
+    double L1 = pbbs::reduce(diffs, pbbs::addm<double>());
+    cout << "batch " << b << ": updates = " << (D.inserted.size() + D.deleted.size())
+         << " incremental time = " << inc_time << " recompute time = " << full_time
+         << " L1 distance = " << L1 << endl;
+    VG.release_version(std::move(A));
+    VG.release_version(std::move(B));
+  }
+}
+
+// Maintains the triangle count across -batches batches of -batch_size
+// symmetric edge updates, half of which delete existing edges. Each
+// incremental count is checked against, and timed against, a full recount.
+void incremental_triangles(commandLine& P) {
+  size_t n_batches = P.getOptionLongValue("-batches", 4);
+  size_t batch_size = P.getOptionLongValue("-batch_size", 1000);
+  bool print_stats = P.getOptionValue("-stats");
+
+  auto VG = initialize_treeplus_graph(P);
+  size_t count;
+  {
+    auto S = VG.acquire_version();
+    count = TriangleCount(S.graph, print_stats);
+    VG.release_version(std::move(S));
+  }
+
+  for (size_t b=0; b<n_batches; b++) {
+    auto A = VG.acquire_version();
+    auto edges_a = A.graph.retrieve_edges();
+    auto updates = symmetric_mixed_batch(A.graph.num_vertices(), edges_a, batch_size, b);
+    VG.apply_updates_batch(updates.size(), updates.begin());
+    auto B = VG.acquire_version();
+
+    timer it; it.start();
+    auto D = VG.diff(A, B);
+    count = TriangleCount_incremental(A.graph, B.graph, D, count, print_stats);
+    double inc_time = it.stop();
+
+    timer ft; ft.start();
+    size_t full_count = TriangleCount(B.graph);
+    double full_time = ft.stop();
+
+    if (count != full_count) {
+      cout << "triangle count mismatch: incremental " << count << " recount " << full_count << endl;
+      exit(0);
+    }
+    cout << "batch " << b << ": updates = " << (D.inserted.size() + D.deleted.size())
+         << " triangles = " << count << " incremental time = " << inc_time
+         << " recount time = " << full_time << endl;
+    VG.release_version(std::move(A));
+    VG.release_version(std::move(B));
+  }
+}
+
+// Whether the components S's readers see match labels, the components of S
+// computed from scratch.
+template <class VG_t, class version>
+bool components_match(VG_t& VG, const version& S, pbbs::sequence<uintV>& labels) {
+  size_t n = labels.size();
+  auto roots = pbbs::sequence<uintV>(n, [&] (size_t i) { return VG.component_of(S, i); });
+  auto wrong = pbbs::delayed_seq<size_t>(n, [&] (size_t i) { return (size_t)(labels[roots[i]] != labels[i]); });
+  auto is_root = pbbs::delayed_seq<size_t>(n, [&] (size_t i) { return (size_t)(roots[i] == i); });
+  auto is_least = pbbs::delayed_seq<size_t>(n, [&] (size_t i) { return (size_t)(labels[i] == i); });
+  return pbbs::reduce(wrong, pbbs::addm<size_t>()) == 0 &&
+         pbbs::reduce(is_root, pbbs::addm<size_t>()) == pbbs::reduce(is_least, pbbs::addm<size_t>());
+}
+
+// Maintains connected components across -batches batches of -batch_size
+// symmetric edge updates, half of which delete existing edges (none with
+// -insert_only). After each batch, the components seen by readers of the new
+// version and of the one before it are checked against recomputing them.
+void incremental_components(commandLine& P) {
+  size_t n_batches = P.getOptionLongValue("-batches", 4);
+  size_t batch_size = P.getOptionLongValue("-batch_size", 1000);
+  bool insert_only = P.getOptionValue("-insert_only");
+
+  auto VG = initialize_treeplus_graph(P);
+  timer it; it.start();
+  VG.track_connectivity();
+  cout << "initial components time = " << it.stop() << endl;
+  pbbs::sequence<uintV> labels;
+  {
+    auto S = VG.acquire_version();
+    labels = Connectivity(S.graph);
+    VG.release_version(std::move(S));
+  }
+
+  for (size_t b=0; b<n_batches; b++) {
+    auto A = VG.acquire_version();
+    auto edges_a = A.graph.retrieve_edges();
+    auto updates = symmetric_mixed_batch(A.graph.num_vertices(), edges_a, batch_size, b);
+    if (insert_only) updates = pbbs::filter(updates, [] (const edge_update& u) { return get<2>(u); });
+
+    timer ut; ut.start();
+    VG.apply_updates_batch(updates.size(), updates.begin());
+    double update_time = ut.stop();
+    auto B = VG.acquire_version();
+
+    timer ft; ft.start();
+    auto new_labels = Connectivity(B.graph);
+    double full_time = ft.stop();
+
+    if (!components_match(VG, B, new_labels) || !components_match(VG, A, labels)) {
+      cout << "component mismatch after batch " << b << endl;
+      exit(0);
+    }
+    auto is_least = pbbs::delayed_seq<size_t>(new_labels.size(), [&] (size_t i) { return (size_t)(new_labels[i] == i); });
+    cout << "batch " << b << ": updates = " << updates.size()
+         << " components = " << pbbs::reduce(is_least, pbbs::addm<size_t>())
+         << " update time (with components) = " << update_time
+         << " recompute time = " << full_time << endl;
+    labels = std::move(new_labels);
+    VG.release_version(std::move(A));
+    VG.release_version(std::move(B));
+  }
+  VG.connectivity->print_stats();
+}
+
 int main(int argc, char** argv) {
   cout << "Running with " << num_workers() << " threads" << endl;
-  commandLine P(argc, argv, "./test_graph [-f file -m (mmap) <testid>]");
+  commandLine P(argc, argv, "./test_graph [-f file -m (mmap) <testid>] [-pipeline -producers p -chunk c -total t -batch b -publish_usec u] [-retain k -batches b -batch_size s] [-diff -batch_size s] [-pagerank -batches b -batch_size s -e eps -inc_e eps] [-triangles -batches b -batch_size s] [-connectivity -batches b -batch_size s -insert_only]");
 
-  parallel_updates(P);
+  if (P.getOption("-pipeline")) {
+    pipelined_updates(P);
+  } else if (P.getOption("-retain")) {
+    retained_versions(P);
+  } else if (P.getOption("-diff")) {
+    version_diff(P);
+  } else if (P.getOption("-pagerank")) {
+    incremental_pagerank(P);
+  } else if (P.getOption("-triangles")) {
+    incremental_triangles(P);
+  } else if (P.getOption("-connectivity")) {
+    incremental_components(P);
+  } else {
+    parallel_updates(P);
+  }
 }
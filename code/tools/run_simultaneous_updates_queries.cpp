@@ -86,6 +86,15 @@ void sequential_update_parallel_query(commandLine& P) {
 
   versioned_graph<treeplus_graph> VG = initialize_treeplus_graph(P);
 
+  // Optional write-ahead log of the updates. An existing log is replayed on
+  // top of the input graph before any new updates are logged.
+  string log_fname = P.getOptionValue("-log", "");
+  size_t group_bytes = P.getOptionLongValue("-group_bytes", 1 << 20);
+  size_t group_usec = P.getOptionLongValue("-group_usec", 1000);
+  if (log_fname != "") {
+    update_log::replay(VG, log_fname.c_str());
+  }
+
 // The following may be needed if you are running on large graphs and tight on
 // memory.
 //  int ok;
@@ -160,6 +169,12 @@ void sequential_update_parallel_query(commandLine& P) {
 
   VG.delete_edges_batch(2*n_inserts, immediate_deletions, false, true);
 
+  update_log* log = nullptr;
+  if (log_fname != "") {
+    log = new update_log(log_fname.c_str(), group_bytes, group_usec);
+    VG.attach_log(log);
+  }
+
   // auto S2 = VG.acquire_version();
   // S2.graph.check_edges();
   // S2.graph.size_in_bytes();
@@ -213,8 +228,10 @@ void sequential_update_parallel_query(commandLine& P) {
           VG.delete_edges_batch(2, next_batch, /*sorted=*/true, /*remove_dups=*/false, n, /*run_seq=*/true);
         }
       }
+      if (log) log->sync();
       total_update_time = ut.stop();
       pbbs::free_array(next_batch);
+      if (log) log->print_stats();
 
       cout << "Update throughput = " << (updates_to_run / total_update_time) << endl;
       cout << "Average_latency = " << (total_update_time / updates_to_run) << endl;
@@ -281,6 +298,7 @@ void sequential_update_parallel_query(commandLine& P) {
         }
       }
       cout << "Average query time : " << (total_query_time / iters) << endl;
+      VG.flat_cache.print_stats();
     }
     return true;
   };
@@ -297,11 +315,129 @@ void sequential_update_parallel_query(commandLine& P) {
   while (!updates_finished) {
     std::this_thread::yield();
   }
+  if (log) {
+    VG.attach_log(nullptr);
+    delete log;
+  }
+}
+
+// Measures the latency of acquire_version and release_version while a single
+// writer applies a storm of updates, each inserting or deleting a batch of
+// -batch random edges. Readers acquire and release versions back-to-back on
+// the query scheduler. Build with WAITFREE=1 to measure the wait-free
+// versioning backend instead of the lock-free one. With -bg_reclaim t, dead
+// versions are freed by t background threads (at most -reclaim_rate vertex
+// nodes per second each, if given) instead of by the releasing thread.
+void acquire_latency(commandLine& P) {
+  size_t n_query_threads = P.getOptionLongValue("-query_threads", std::thread::hardware_concurrency()-1);
+  size_t n_readers = P.getOptionLongValue("-readers", n_query_threads);
+  size_t updates_to_run = P.getOptionLongValue("-updatestorun", 200000);
+  size_t batch = std::max(1L, P.getOptionLongValue("-batch", 1));
+  size_t bg_reclaim = P.getOptionLongValue("-bg_reclaim", 0);
+  size_t reclaim_rate = P.getOptionLongValue("-reclaim_rate", 0);
+
+  auto query_scheduler = fork_join_scheduler(n_query_threads, /* start offset */0, /* include_self */true, /* set affinity */ false);
+
+  versioned_graph<treeplus_graph> VG = initialize_treeplus_graph(P);
+  if (bg_reclaim > 0) VG.reclaim_in_background(bg_reclaim, reclaim_rate);
+  auto S = VG.acquire_version();
+  size_t n = S.graph.num_vertices();
+  VG.release_version(std::move(S));
+
+  volatile bool updates_finished = false;
+  double update_time = 0.0;
+  std::function<void()> updater = [&] () {
+    using pair_vertex = tuple<uintV, uintV>;
+    auto next_batch = pbbs::new_array_no_init<pair_vertex>(2*batch);
+    auto r = pbbs::random();
+    timer ut; ut.start();
+    for (size_t i=0; i<updates_to_run; i++) {
+      // update 2k inserts a batch of random edges, and update 2k+1 deletes it
+      size_t k = i / 2;
+      size_t m = 0;
+      for (size_t j=0; j<batch; j++) {
+        uintV u = r.ith_rand(2*(k*batch+j)) % n, v = r.ith_rand(2*(k*batch+j)+1) % n;
+        if (u == v) continue;
+        next_batch[m++] = make_tuple(u, v);
+        next_batch[m++] = make_tuple(v, u);
+      }
+      if (m == 0) continue;
+      bool sorted = (batch == 1);
+      if (sorted && get<0>(next_batch[0]) > get<0>(next_batch[1])) std::swap(next_batch[0], next_batch[1]);
+      if (i % 2 == 0) {
+        VG.insert_edges_batch(m, next_batch, sorted, /*remove_dups=*/!sorted, n, /*run_seq=*/true);
+      } else {
+        VG.delete_edges_batch(m, next_batch, sorted, /*remove_dups=*/!sorted, n, /*run_seq=*/true);
+      }
+    }
+    update_time = ut.stop();
+    pbbs::free_array(next_batch);
+    updates_finished = true;
+  };
+
+  auto latencies = pbbs::sequence<std::vector<double>>(n_readers);
+  auto release_latencies = pbbs::sequence<std::vector<double>>(n_readers);
+  auto update_scheduler = fork_join_scheduler(1, /* start offset */n_query_threads, /* include_self */false, /* set_affinity */ true);
+  update_scheduler.sched->send(&updater, 0);
+
+  parallel_for(0, n_readers, [&] (size_t i) {
+    auto& L = latencies[i];
+    auto& R = release_latencies[i];
+    while (!updates_finished) {
+      auto t0 = std::chrono::steady_clock::now();
+      auto S = VG.acquire_version();
+      auto t1 = std::chrono::steady_clock::now();
+      VG.release_version(std::move(S));
+      auto t2 = std::chrono::steady_clock::now();
+      L.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+      R.push_back(std::chrono::duration<double, std::micro>(t2 - t1).count());
+    }
+  }, 1);
+
+  while (!updates_finished) {
+    std::this_thread::yield();
+  }
+
+  auto merge = [&] (pbbs::sequence<std::vector<double>>& lats) {
+    std::vector<double> all;
+    for (size_t i=0; i<n_readers; i++) {
+      all.insert(all.end(), lats[i].begin(), lats[i].end());
+    }
+    std::sort(all.begin(), all.end());
+    return all;
+  };
+  auto all = merge(latencies);
+  auto all_release = merge(release_latencies);
+  auto pct = [&] (std::vector<double>& all, double p) {
+    return all.size() ? all[std::min(all.size()-1, (size_t)(p*all.size()))] : 0.0;
+  };
+#ifdef WAITFREE
+  cout << "backend = wait-free" << endl;
+#else
+  cout << "backend = lock-free" << endl;
+#endif
+  cout << "update throughput = " << (updates_to_run / update_time) << " updates/s" << endl;
+  cout << "acquires = " << all.size() << " readers = " << n_readers << endl;
+  cout << "acquire latency (us): p50 = " << pct(all, 0.5) << " p99 = " << pct(all, 0.99)
+       << " p99.9 = " << pct(all, 0.999) << " max = " << (all.size() ? all.back() : 0.0) << endl;
+  cout << "release latency (us): p50 = " << pct(all_release, 0.5) << " p99 = " << pct(all_release, 0.99)
+       << " p99.9 = " << pct(all_release, 0.999)
+       << " max = " << (all_release.size() ? all_release.back() : 0.0) << endl;
+  if (VG.reclaimer) {
+    timer wt; wt.start();
+    VG.wait_for_reclamation();
+    wt.report(wt.stop(), "reclamation drain time");
+    VG.reclaimer->print_stats();
+  }
 }
 
 int main(int argc, char** argv) {
 //  cout << "Running with " << num_workers() << " threads" << endl;
-  commandLine P(argc, argv, "./test_graph [-f file -m (mmap) <testid>]");
+  commandLine P(argc, argv, "./test_graph [-f file -m (mmap) -log update_log -group_bytes bytes -group_usec usec -acquire_latency -readers r -batch b -bg_reclaim t -reclaim_rate r <testid>]");
 //  create_star(P);
+  if (P.getOption("-acquire_latency")) {
+    acquire_latency(P);
+    return 0;
+  }
   sequential_update_parallel_query(P);
 }
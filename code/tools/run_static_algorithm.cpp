@@ -1,11 +1,14 @@
 #include "../graph/api.h"
 #include "../algorithms/BFS.h"
 #include "../algorithms/BC.h"
+#include "../algorithms/Connectivity.h"
 #include "../algorithms/LDD.h"
 #include "../algorithms/k-Hop.h"
 #include "../algorithms/mutual_friends.h"
 #include "../algorithms/MIS.h"
 #include "../algorithms/Nibble.h"
+#include "../algorithms/PageRank.h"
+#include "../algorithms/Triangle.h"
 #include "../trees/utils.h"
 
 #include <cstring>
@@ -20,6 +23,9 @@ string test_name[] = {
     "MIS",
     "KHOP",
     "NIBBLE",
+    "PR",
+    "TC",
+    "CC",
 };
 
 template <class G>
@@ -120,6 +126,51 @@ double test_nibble(G& GA, commandLine& P) {
   return (t.get_total() / num_sources);
 }
 
+template <class G>
+double test_pagerank(G& GA, commandLine& P) {
+  double epsilon = P.getOptionDoubleValue("-e", 1e-7);
+  size_t max_iters = P.getOptionLongValue("-iters", 100);
+  bool print_stats = P.getOptionValue("-stats");
+  std::cout << "Running PageRank, epsilon = " << epsilon << std::endl;
+  timer t; t.start();
+  auto p = PageRank(GA, epsilon, 0.85, max_iters, print_stats);
+  t.stop();
+  return t.get_total();
+}
+
+template <class G>
+double test_triangles(G& GA, commandLine& P) {
+  bool print_stats = P.getOptionValue("-stats");
+  timer t; t.start();
+  size_t count = TriangleCount(GA, print_stats);
+  t.stop();
+  std::cout << "triangles = " << count << std::endl;
+  return t.get_total();
+}
+
+template <class G>
+double test_connectivity(G& GA, commandLine& P) {
+  bool print_stats = P.getOptionValue("-stats");
+  bool forest = P.getOptionValue("-forest");
+  bool symmetric = !P.getOption("-d");
+  size_t n = GA.num_vertices();
+  timer t; t.start();
+  pbbs::sequence<uintV> labels;
+  size_t forest_edges = 0;
+  if (forest) {
+    auto res = SpanningForest(GA, symmetric, print_stats);
+    labels = std::move(res.first);
+    forest_edges = res.second.size();
+  } else {
+    labels = Connectivity(GA, symmetric, print_stats);
+  }
+  t.stop();
+  auto is_root = pbbs::delayed_seq<size_t>(n, [&] (size_t i) { return (size_t)(labels[i] == i); });
+  std::cout << "components = " << pbbs::reduce(is_root, pbbs::addm<size_t>()) << std::endl;
+  if (forest) std::cout << "spanning forest edges = " << forest_edges << std::endl;
+  return t.get_total();
+}
+
 template <class Graph>
 double execute(Graph& G, commandLine& P, string testname) {
   if (testname == "BFS") {
@@ -132,17 +183,23 @@ double execute(Graph& G, commandLine& P, string testname) {
     return test_mis(G, P);
   } else if (testname == "NIBBLE") {
     return test_nibble(G, P);
+  } else if (testname == "PR") {
+    return test_pagerank(G, P);
+  } else if (testname == "TC") {
+    return test_triangles(G, P);
+  } else if (testname == "CC") {
+    return test_connectivity(G, P);
   } else {
     std::cout << "Unknown test: " << testname << ". Quitting." << std::endl;
     exit(0);
   }
 }
 
-void run_algorithm(commandLine& P) {
+template <class VG_t>
+void run_rounds(VG_t& VG, commandLine& P) {
   auto test_id = P.getOptionValue("-t", "BFS");
   size_t threads = num_workers();
 
-  auto VG = initialize_treeplus_graph(P);
   // Run the algorithm on it
   size_t rounds = P.getOptionLongValue("-rounds", 4);
   double total_time = 0.0;
@@ -168,8 +225,19 @@ void run_algorithm(commandLine& P) {
   	<< "\tp=" << threads << std::endl;
 }
 
+void run_algorithm(commandLine& P) {
+  if (P.getOption("-d")) { // directed input
+    string fname = string(P.getOptionValue("-f", default_file_name.c_str()));
+    auto VG = initialize_directed_graph(fname, P.getOption("-m"));
+    run_rounds(VG, P);
+  } else {
+    auto VG = initialize_treeplus_graph(P);
+    run_rounds(VG, P);
+  }
+}
+
 int main(int argc, char** argv) {
   std::cout << "Running Aspen using " << num_workers() << " threads." << std::endl;
-  commandLine P(argc, argv, "./test_parallel [-t testname -r rounds -f file -m (mmap)]");
+  commandLine P(argc, argv, "./test_parallel [-t testname -r rounds -f file -m (mmap) -d (directed)]");
   run_algorithm(P);
 }
@@ -0,0 +1,48 @@
+#include "../graph/api.h"
+#include "../trees/utils.h"
+
+using namespace std;
+
+// Converts a graph in the AdjacencyGraph format into the binary CSR format
+// (see write_binary_csr in common/IO.h). The output can be loaded by the
+// other tools by passing -b -f <binary_file>.
+void write_binary_graph(commandLine& P) {
+  string fname = string(P.getOptionValue("-f", default_file_name.c_str()));
+  string out_fname = string(P.getOptionValue("-o", ""));
+  bool mmap = P.getOption("-m");
+  if (fname == "" || out_fname == "") {
+    cout << "specify an input file with -f and an output file with -o" << endl;
+    exit(0);
+  }
+  size_t n; size_t m;
+  uintE* offsets; uintV* edges;
+  timer t; t.start();
+  std::tie(n, m, offsets, edges) = read_unweighted_graph(fname.c_str(), /*is_symmetric=*/true, mmap);
+  t.next("Text read time");
+  write_binary_csr(out_fname.c_str(), n, m, offsets, edges);
+  t.next("Binary write time");
+  pbbs::free_array(offsets); pbbs::free_array(edges);
+
+  if (P.getOption("-verify")) {
+    auto VG = initialize_graph(fname, mmap);
+    auto VG2 = initialize_graph_from_binary(out_fname);
+    auto S = VG.acquire_version();
+    auto S2 = VG2.acquire_version();
+    bool ok = (S.graph.num_vertices() == S2.graph.num_vertices()) &&
+              (S.graph.num_edges() == S2.graph.num_edges());
+    auto edges1 = S.graph.retrieve_edges();
+    auto edges2 = S2.graph.retrieve_edges();
+    for (size_t i = 0; ok && i < edges1.size(); i++) {
+      ok = (edges1[i] == edges2[i]);
+    }
+    cout << (ok ? "binary graph verified" : "binary graph mismatch!") << endl;
+    VG.release_version(std::move(S));
+    VG2.release_version(std::move(S2));
+  }
+}
+
+int main(int argc, char** argv) {
+  cout << "Running Aspen using " << num_workers() << " threads." << endl;
+  commandLine P(argc, argv, "./write_binary_graph [-f graph_file -m (mmap) -o binary_file -verify]");
+  write_binary_graph(P);
+}
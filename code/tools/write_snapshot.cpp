@@ -0,0 +1,42 @@
+#include "../graph/api.h"
+#include "../trees/utils.h"
+
+#include <cstring>
+
+using namespace std;
+
+// Converts an input graph (any format accepted by initialize_treeplus_graph)
+// into Aspen's native snapshot format. The snapshot can be loaded by the other
+// tools by passing -snap -f <snapshot_file>.
+void write_snapshot(commandLine& P) {
+  string out_fname = string(P.getOptionValue("-o", ""));
+  if (out_fname == "") {
+    cout << "specify an output file with -o" << endl;
+    exit(0);
+  }
+  auto VG = initialize_treeplus_graph(P);
+  write_snapshot(VG, out_fname);
+
+  if (P.getOption("-verify")) {
+    auto VG2 = initialize_graph_from_snapshot(out_fname);
+    auto S = VG.acquire_version();
+    auto S2 = VG2.acquire_version();
+    size_t n = S.graph.num_vertices(), m = S.graph.num_edges();
+    size_t n2 = S2.graph.num_vertices(), m2 = S2.graph.num_edges();
+    auto edges = S.graph.retrieve_edges();
+    auto edges2 = S2.graph.retrieve_edges();
+    bool ok = (n == n2) && (m == m2);
+    for (size_t i = 0; ok && i < m; i++) {
+      ok = (edges[i] == edges2[i]);
+    }
+    cout << (ok ? "snapshot verified" : "snapshot mismatch!") << endl;
+    VG.release_version(std::move(S));
+    VG2.release_version(std::move(S2));
+  }
+}
+
+int main(int argc, char** argv) {
+  cout << "Running Aspen using " << num_workers() << " threads." << endl;
+  commandLine P(argc, argv, "./write_snapshot [-f graph_file -m (mmap) -s (symmetric) -c (compressed) -o snapshot_file -verify]");
+  write_snapshot(P);
+}